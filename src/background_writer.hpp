@@ -0,0 +1,153 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A fixed pool of slots passed from one producing thread to a background thread that writes them out in order,
+// so the producer never waits on the disk unless every slot is queued. The producer acquires a free slot, fills it
+// and queues it; the background thread calls write on it unlocked and frees it again.
+template <typename Slot>
+class BackgroundWriter {
+public:
+    // write runs on the background thread only and returns false if the slot could not be written
+    BackgroundWriter(std::vector<Slot> slots, std::function<bool(Slot&)> write)
+        : m_slots(std::move(slots))
+        , m_write(std::move(write))
+        , m_free()
+        , m_queue()
+        , m_writing(false)
+        , m_stopping(false)
+        , m_failed(false)
+        , m_mutex()
+        , m_slot_freed()
+        , m_slot_queued()
+        , m_thread()
+    {
+        for (size_t i = 0; i < m_slots.size(); ++i) {
+            m_free.push_back(i);
+        }
+        m_thread = std::thread(&BackgroundWriter::write_slots, this);
+    }
+
+    BackgroundWriter(const BackgroundWriter&) = delete;
+    BackgroundWriter& operator=(const BackgroundWriter&) = delete;
+
+    ~BackgroundWriter()
+    {
+        finish();
+    }
+
+    // A free slot, waiting for one if wait is set. Returns nullopt once finished, or if none is free and not wait.
+    std::optional<size_t> acquire(const bool wait)
+    {
+        std::unique_lock lock(m_mutex);
+        if (wait) {
+            m_slot_freed.wait(lock, [this] { return m_stopping || !m_free.empty(); });
+        }
+        if (m_stopping || m_free.empty()) {
+            return std::nullopt;
+        }
+        const size_t slot = m_free.back();
+        m_free.pop_back();
+        return slot;
+    }
+
+    // The slot acquire() returned, for the producer to fill until it queues it
+    [[nodiscard]] Slot& slot(const size_t index)
+    {
+        return m_slots[index];
+    }
+
+    void queue(const size_t index)
+    {
+        {
+            const std::scoped_lock lock(m_mutex);
+            m_queue.push_back(index);
+        }
+        m_slot_queued.notify_one();
+    }
+
+    // Whether every queued slot has been written
+    [[nodiscard]] bool caught_up() const
+    {
+        const std::scoped_lock lock(m_mutex);
+        return m_queue.empty() && !m_writing;
+    }
+
+    // Waits until every queued slot has been written
+    void wait_caught_up()
+    {
+        std::unique_lock lock(m_mutex);
+        m_slot_freed.wait(lock, [this] { return m_queue.empty() && !m_writing; });
+    }
+
+    [[nodiscard]] bool finished() const
+    {
+        const std::scoped_lock lock(m_mutex);
+        return m_stopping;
+    }
+
+    [[nodiscard]] bool ok() const
+    {
+        const std::scoped_lock lock(m_mutex);
+        return !m_failed;
+    }
+
+    // Writes the queued slots and stops the thread. Returns false if any write failed.
+    bool finish()
+    {
+        {
+            const std::scoped_lock lock(m_mutex);
+            if (m_stopping) {
+                return !m_failed;
+            }
+            m_stopping = true;
+        }
+        m_slot_queued.notify_one();
+        m_slot_freed.notify_all();
+        m_thread.join();
+        const std::scoped_lock lock(m_mutex);
+        return !m_failed;
+    }
+
+private:
+    void write_slots()
+    {
+        std::unique_lock lock(m_mutex);
+        while (true) {
+            m_slot_queued.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_queue.empty()) {
+                return;
+            }
+            const size_t index = m_queue.front();
+            m_queue.pop_front();
+            m_writing = true;
+            lock.unlock();
+            const bool written = m_write(m_slots[index]);
+            lock.lock();
+            m_writing = false;
+            m_failed |= !written;
+            m_free.push_back(index);
+            m_slot_freed.notify_all();
+        }
+    }
+
+    std::vector<Slot> m_slots;
+    const std::function<bool(Slot&)> m_write;
+    std::vector<size_t> m_free;
+    std::deque<size_t> m_queue;
+    bool m_writing;
+    bool m_stopping;
+    bool m_failed;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_slot_freed;
+    std::condition_variable m_slot_queued;
+    std::thread m_thread;
+};
@@ -0,0 +1,447 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef PLATFORM_WEB
+#include <BS_thread_pool.hpp>
+
+#include "lossless_codec.hpp"
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CHECKPOINT_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Binary checkpoint files for the sims: a fixed header followed by buffers ("sections"), each starting on a
+// page boundary so a mapped file can be read straight from the page cache. Sections are stored raw or with the
+// lossless codec, optionally XORed with an earlier section; both restore bit for bit.
+// Values are stored in host byte order; checkpoints are meant to restart a run on the same kind of machine.
+
+enum class CheckpointKind : uint32_t {
+    wave = 1,
+    schrodinger = 2,
+    // the tiles of a wave sim that changed since the full checkpoint at base_step
+    wave_delta = 3,
+};
+
+enum class CheckpointCodec : uint32_t {
+    raw = 0,
+    // lossless::compress, not available in web builds
+    lossless = 1,
+};
+
+struct CheckpointSection {
+    uint64_t offset;
+    // stored bytes
+    uint64_t bytes;
+    // bytes once decoded
+    uint64_t raw_bytes;
+    CheckpointCodec codec;
+    // index of the section this one was XORed with before compression, or -1
+    int32_t base;
+};
+
+struct CheckpointHeader {
+    static constexpr std::array<char, 8> sc_magic { 'S', 'I', 'M', 'C', 'K', 'P', 'T', '\0' };
+    static constexpr uint32_t sc_version = 3;
+    static constexpr size_t sc_max_sections = 8;
+
+    std::array<char, 8> magic;
+    uint32_t version;
+    CheckpointKind kind;
+    // bytes per stored floating point value
+    uint32_t value_bytes;
+    int32_t size;
+    uint64_t step;
+    // delta checkpoints only
+    uint64_t base_step;
+    // the sim's Properties; which entry is which is up to each sim
+    std::array<double, 8> parameters;
+    std::array<uint32_t, 4> options;
+    uint32_t section_count;
+    std::array<CheckpointSection, sc_max_sections> sections;
+};
+
+// Renames a fully written temp_path over path. Where supported the data is flushed to disk before the rename and
+// the rename after it, so a power loss leaves either the old file or the complete new one.
+inline bool replace_file(const std::string& temp_path, const std::string& path)
+{
+#ifdef CHECKPOINT_MMAP
+    const auto sync = [](const std::string& sync_path) {
+        const int fd = ::open(sync_path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        const bool synced = fsync(fd) == 0;
+        close(fd);
+        return synced;
+    };
+    if (!sync(temp_path)) {
+        return false;
+    }
+#endif
+    std::error_code error;
+    std::filesystem::rename(temp_path, path, error);
+    if (error) {
+        return false;
+    }
+#ifdef CHECKPOINT_MMAP
+    const std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    return sync(parent.empty() ? std::string(".") : parent.string());
+#else
+    return true;
+#endif
+}
+
+class CheckpointWriter {
+public:
+    explicit CheckpointWriter(const CheckpointHeader& header)
+        : m_header(header)
+        , m_sections()
+    {
+        m_header.magic = CheckpointHeader::sc_magic;
+        m_header.version = CheckpointHeader::sc_version;
+        m_header.section_count = 0;
+    }
+
+    // data must stay valid until write(). Compressed sections shuffle the bytes of element_bytes wide values and
+    // are XORed with section base if it is not -1, which pays off when the two hold similar values.
+    void add_section(const void* data, const size_t bytes, const size_t element_bytes = 1, const int base = -1)
+    {
+        m_sections.push_back({ .data = data, .bytes = bytes, .element_bytes = element_bytes, .base = base });
+    }
+
+    // Copies the sections' data into storage, reusing its capacity, so the writer no longer needs the buffers it was
+    // given and can be written later or on another thread
+    void copy_sections(std::vector<char>& storage)
+    {
+        size_t bytes = 0;
+        for (const PendingSection& section : m_sections) {
+            bytes += section.bytes;
+        }
+        storage.resize(bytes);
+        size_t offset = 0;
+        for (PendingSection& section : m_sections) {
+            std::memcpy(storage.data() + offset, section.data, section.bytes);
+            section.data = storage.data() + offset;
+            offset += section.bytes;
+        }
+    }
+
+    // Writes the sections raw to a temporary file next to path and renames it over path, so a crash mid-write leaves
+    // the previous checkpoint intact. Returns false if anything failed.
+    bool write(const std::string& path)
+    {
+        return write_sections(path, {});
+    }
+
+    // Same as write() into memory, replacing the contents of out; MappedCheckpoint::view() reads it back
+    bool write(std::vector<char>& out)
+    {
+        return write_sections(out, {});
+    }
+
+#ifndef PLATFORM_WEB
+    // Same as write() with every section compressed by the lossless codec
+    bool write_lossless(const std::string& path, BS::thread_pool& pool)
+    {
+        std::vector<std::vector<uint8_t>> compressed;
+        return compress_sections(compressed, pool) && write_sections(path, compressed);
+    }
+
+    // Same as write_lossless() into memory, replacing the contents of out; MappedCheckpoint::view() reads it back
+    bool write_lossless(std::vector<char>& out, BS::thread_pool& pool)
+    {
+        std::vector<std::vector<uint8_t>> compressed;
+        return compress_sections(compressed, pool) && write_sections(out, compressed);
+    }
+#endif
+
+private:
+    static constexpr uint64_t sc_alignment = 4096;
+
+    struct PendingSection {
+        const void* data;
+        size_t bytes;
+        size_t element_bytes;
+        int base;
+    };
+
+    static uint64_t align(const uint64_t offset)
+    {
+        return (offset + sc_alignment - 1) / sc_alignment * sc_alignment;
+    }
+
+#ifndef PLATFORM_WEB
+    bool compress_sections(std::vector<std::vector<uint8_t>>& compressed, BS::thread_pool& pool) const
+    {
+        compressed.resize(m_sections.size());
+        for (size_t i = 0; i < m_sections.size(); ++i) {
+            const PendingSection& section = m_sections[i];
+            const void* base = nullptr;
+            if (section.base >= 0) {
+                if (static_cast<size_t>(section.base) >= i || m_sections[section.base].bytes != section.bytes) {
+                    return false;
+                }
+                base = m_sections[section.base].data;
+            }
+            lossless::compress(section.data, section.bytes, section.element_bytes, base, compressed[i], pool);
+        }
+        return true;
+    }
+#endif
+
+    // Bytes stored for section i: compressed[i] if compressed is not empty, else the section's data
+    [[nodiscard]] std::pair<const void*, size_t> stored(
+        const std::vector<std::vector<uint8_t>>& compressed, const size_t i) const
+    {
+        if (!compressed.empty()) {
+            return { compressed[i].data(), compressed[i].size() };
+        }
+        return { m_sections[i].data, m_sections[i].bytes };
+    }
+
+    // Fills in the header's section table
+    bool layout_sections(const std::vector<std::vector<uint8_t>>& compressed)
+    {
+        if (m_sections.size() > CheckpointHeader::sc_max_sections) {
+            return false;
+        }
+        const bool is_compressed = !compressed.empty();
+        uint64_t offset = align(sizeof(CheckpointHeader));
+        m_header.section_count = static_cast<uint32_t>(m_sections.size());
+        for (size_t i = 0; i < m_sections.size(); ++i) {
+            m_header.sections[i] = { .offset = offset,
+                                     .bytes = stored(compressed, i).second,
+                                     .raw_bytes = m_sections[i].bytes,
+                                     .codec = is_compressed ? CheckpointCodec::lossless : CheckpointCodec::raw,
+                                     .base = is_compressed ? m_sections[i].base : -1 };
+            offset = align(offset + stored(compressed, i).second);
+        }
+        return true;
+    }
+
+    // Passes the header, padding and stored sections in file order to emit(data, bytes)
+    template <typename Emit>
+    void emit_sections(const std::vector<std::vector<uint8_t>>& compressed, Emit&& emit) const
+    {
+        emit(&m_header, sizeof(m_header));
+        uint64_t written = sizeof(m_header);
+        const std::vector<char> padding(sc_alignment, 0);
+        for (size_t i = 0; i < m_sections.size(); ++i) {
+            const CheckpointSection& section = m_header.sections[i];
+            emit(padding.data(), section.offset - written);
+            emit(stored(compressed, i).first, section.bytes);
+            written = section.offset + section.bytes;
+        }
+    }
+
+    // Writes compressed[i] in place of section i if compressed is not empty
+    bool write_sections(const std::string& path, const std::vector<std::vector<uint8_t>>& compressed)
+    {
+        if (!layout_sections(compressed)) {
+            return false;
+        }
+        const std::string temp_path = path + ".tmp";
+        {
+            std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+            emit_sections(compressed, [&](const void* data, const size_t bytes) {
+                file.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+            });
+            if (!file) {
+                return false;
+            }
+        }
+        return replace_file(temp_path, path);
+    }
+
+    bool write_sections(std::vector<char>& out, const std::vector<std::vector<uint8_t>>& compressed)
+    {
+        if (!layout_sections(compressed)) {
+            return false;
+        }
+        out.clear();
+        emit_sections(compressed, [&](const void* data, const size_t bytes) {
+            out.insert(out.end(), static_cast<const char*>(data), static_cast<const char*>(data) + bytes);
+        });
+        return true;
+    }
+
+    CheckpointHeader m_header;
+    std::vector<PendingSection> m_sections;
+};
+
+// A checkpoint file mapped read-only, or read into memory where mmap is unavailable
+class MappedCheckpoint {
+public:
+    // Returns nullopt if the file cannot be opened or is not a valid checkpoint of this version
+    static std::optional<MappedCheckpoint> open(const std::string& path)
+    {
+        MappedCheckpoint checkpoint;
+#ifdef CHECKPOINT_MMAP
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return std::nullopt;
+        }
+        struct stat info {};
+        if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(CheckpointHeader))) {
+            close(fd);
+            return std::nullopt;
+        }
+        void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            return std::nullopt;
+        }
+        // buffers are consumed front to back
+        // advice values are not flags, so each takes a call of its own
+        madvise(data, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+        madvise(data, static_cast<size_t>(info.st_size), MADV_WILLNEED);
+        checkpoint.m_data = static_cast<const char*>(data);
+        checkpoint.m_bytes = static_cast<size_t>(info.st_size);
+#else
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) {
+            return std::nullopt;
+        }
+        checkpoint.m_buffer.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(checkpoint.m_buffer.data(), static_cast<std::streamsize>(checkpoint.m_buffer.size()));
+        if (!file || checkpoint.m_buffer.size() < sizeof(CheckpointHeader)) {
+            return std::nullopt;
+        }
+        checkpoint.m_data = checkpoint.m_buffer.data();
+        checkpoint.m_bytes = checkpoint.m_buffer.size();
+#endif
+        std::memcpy(&checkpoint.m_header, checkpoint.m_data, sizeof(CheckpointHeader));
+        if (!checkpoint.valid()) {
+            return std::nullopt;
+        }
+        return checkpoint;
+    }
+
+    // Reads a checkpoint already in memory, such as one from CheckpointWriter::write_lossless(), without copying it.
+    // data must outlive the returned checkpoint.
+    static std::optional<MappedCheckpoint> view(const void* data, const size_t bytes)
+    {
+        if (bytes < sizeof(CheckpointHeader)) {
+            return std::nullopt;
+        }
+        MappedCheckpoint checkpoint;
+        checkpoint.m_data = static_cast<const char*>(data);
+        checkpoint.m_bytes = bytes;
+        checkpoint.m_owned = false;
+        std::memcpy(&checkpoint.m_header, checkpoint.m_data, sizeof(CheckpointHeader));
+        if (!checkpoint.valid()) {
+            return std::nullopt;
+        }
+        return checkpoint;
+    }
+
+    MappedCheckpoint(MappedCheckpoint&& other) noexcept
+        : m_header(other.m_header)
+        , m_data(std::exchange(other.m_data, nullptr))
+        , m_bytes(std::exchange(other.m_bytes, 0))
+        , m_owned(other.m_owned)
+        , m_buffer(std::move(other.m_buffer))
+    {
+        if (!m_buffer.empty()) {
+            m_data = m_buffer.data();
+        }
+    }
+
+    MappedCheckpoint(const MappedCheckpoint&) = delete;
+    MappedCheckpoint& operator=(const MappedCheckpoint&) = delete;
+    MappedCheckpoint& operator=(MappedCheckpoint&&) = delete;
+
+    ~MappedCheckpoint()
+    {
+#ifdef CHECKPOINT_MMAP
+        if (m_data != nullptr && m_owned) {
+            munmap(const_cast<char*>(m_data), m_bytes);
+        }
+#endif
+    }
+
+    [[nodiscard]] const CheckpointHeader& header() const
+    {
+        return m_header;
+    }
+
+    // Copies raw section i into destination. Returns false if the section is compressed or does not hold exactly
+    // expected_bytes.
+    bool read_section(const size_t i, void* destination, const size_t expected_bytes) const
+    {
+        if (i >= m_header.section_count || m_header.sections[i].codec != CheckpointCodec::raw
+            || m_header.sections[i].bytes != expected_bytes) {
+            return false;
+        }
+        std::memcpy(destination, m_data + m_header.sections[i].offset, expected_bytes);
+        return true;
+    }
+
+#ifndef PLATFORM_WEB
+    // Copies section i into destination, decompressing it if needed. base must hold the decoded section it was XORed
+    // with, if any. Returns false if the section is damaged or does not decode to exactly expected_bytes.
+    bool read_section(
+        const size_t i, void* destination, const size_t expected_bytes, const void* base, BS::thread_pool& pool) const
+    {
+        if (i >= m_header.section_count || m_header.sections[i].raw_bytes != expected_bytes) {
+            return false;
+        }
+        const CheckpointSection& section = m_header.sections[i];
+        if (section.codec == CheckpointCodec::raw) {
+            return read_section(i, destination, expected_bytes);
+        }
+        if (section.codec != CheckpointCodec::lossless || (section.base >= 0) != (base != nullptr)) {
+            return false;
+        }
+        return lossless::decompress(m_data + section.offset, section.bytes, destination, expected_bytes, base, pool);
+    }
+#endif
+
+private:
+    MappedCheckpoint()
+        : m_header()
+        , m_data(nullptr)
+        , m_bytes(0)
+        , m_owned(true)
+        , m_buffer()
+    {
+    }
+
+    [[nodiscard]] bool valid() const
+    {
+        if (m_header.magic != CheckpointHeader::sc_magic || m_header.version != CheckpointHeader::sc_version
+            || m_header.value_bytes != sizeof(double) || m_header.section_count > CheckpointHeader::sc_max_sections) {
+            return false;
+        }
+        for (uint32_t i = 0; i < m_header.section_count; ++i) {
+            const CheckpointSection& section = m_header.sections[i];
+            if (section.offset > m_bytes || section.bytes > m_bytes - section.offset) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    CheckpointHeader m_header;
+    const char* m_data;
+    size_t m_bytes;
+    // false for view(), whose data belongs to the caller
+    bool m_owned;
+    // file contents when not mapped
+    std::vector<char> m_buffer;
+};
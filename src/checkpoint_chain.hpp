@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "checkpoint.hpp"
+
+// A full checkpoint every few saves with delta checkpoints against it in between, listed in a text index so the
+// latest state can be restored. Deltas hold every tile changed since their full checkpoint, so a restore loads the
+// last full checkpoint and only the last delta after it. Checkpoint files sit next to the index, named after it.
+// The chain marks the sim's delta base itself when it saves or restores a full checkpoint, so other checkpoints of
+// the same sim do not disturb it; a sim the chain has not marked, like a fresh one next to an existing index, gets a
+// full checkpoint on its next save.
+//
+// Index layout: a "checkpoint-chain 1" line, then one "<step> full|delta <file name>" line per checkpoint, oldest
+// first. It is rewritten through a temporary file like the checkpoints themselves.
+class CheckpointChain {
+public:
+    struct Entry {
+        uint64_t step;
+        bool full;
+        std::string file;
+    };
+
+    CheckpointChain(std::string index_path, const int deltas_per_full)
+        : c_index_path(std::move(index_path))
+        , c_deltas_per_full(deltas_per_full)
+        , m_entries(read_index(c_index_path).value_or(std::vector<Entry> {}))
+        , m_base_token()
+    {
+    }
+
+    [[nodiscard]] const std::vector<Entry>& entries() const
+    {
+        return m_entries;
+    }
+
+    // Saves a full checkpoint if enough deltas followed the last one or the sim's delta base is not the chain's,
+    // else a delta. Files of the previous chain are removed once a new full checkpoint is indexed. Returns false on
+    // failure.
+    template <typename Sim>
+    bool save(Sim& sim, const CheckpointCodec codec = CheckpointCodec::raw)
+    {
+        int deltas = 0;
+        for (auto it = m_entries.rbegin(); it != m_entries.rend() && !it->full; ++it) {
+            ++deltas;
+        }
+        const bool full
+            = !m_base_token.has_value() || !sim.has_delta_base(*m_base_token) || deltas >= c_deltas_per_full;
+        const std::string file = std::filesystem::path(c_index_path).filename().string() + "."
+            + std::to_string(sim.step()) + (full ? ".full" : ".delta");
+        const std::string path = sibling_path(file);
+        if (full) {
+            m_base_token.reset();
+            if (!sim.save_checkpoint(path, codec)) {
+                return false;
+            }
+            m_base_token = sim.mark_delta_base();
+        }
+        else if (!sim.save_delta_checkpoint(path, *m_base_token, codec)) {
+            return false;
+        }
+        std::vector<Entry> entries = m_entries;
+        if (full) {
+            entries.clear();
+        }
+        std::erase_if(entries, [&](const Entry& entry) { return entry.file == file; });
+        entries.push_back({ .step = sim.step(), .full = full, .file = file });
+        if (!write_index(entries)) {
+            // a new full checkpoint that is not indexed cannot be a base
+            if (full) {
+                m_base_token.reset();
+            }
+            return false;
+        }
+        if (full) {
+            for (const Entry& entry : m_entries) {
+                if (entry.file != file) {
+                    std::error_code error;
+                    std::filesystem::remove(sibling_path(entry.file), error);
+                }
+            }
+        }
+        m_entries = std::move(entries);
+        return true;
+    }
+
+    // Loads the last full checkpoint and the last delta after it into sim, which later saves continue from. Returns
+    // false if there is nothing to restore or a file fails to load; sim may then hold the full checkpoint without
+    // the delta.
+    template <typename Sim>
+    bool restore(Sim& sim)
+    {
+        std::optional<Entry> full;
+        std::optional<Entry> delta;
+        for (const Entry& entry : m_entries) {
+            if (entry.full) {
+                full = entry;
+                delta.reset();
+            }
+            else {
+                delta = entry;
+            }
+        }
+        m_base_token.reset();
+        if (!full.has_value() || !sim.load_checkpoint(sibling_path(full->file))) {
+            return false;
+        }
+        m_base_token = sim.mark_delta_base();
+        return !delta.has_value() || sim.load_delta_checkpoint(sibling_path(delta->file), *m_base_token);
+    }
+
+private:
+    static constexpr const char* sc_index_magic = "checkpoint-chain";
+    static constexpr int sc_index_version = 1;
+
+    [[nodiscard]] std::string sibling_path(const std::string& file) const
+    {
+        return (std::filesystem::path(c_index_path).parent_path() / file).string();
+    }
+
+    static std::optional<std::vector<Entry>> read_index(const std::string& path)
+    {
+        std::ifstream file(path);
+        std::string magic;
+        int version = 0;
+        if (!(file >> magic >> version) || magic != sc_index_magic || version != sc_index_version) {
+            return std::nullopt;
+        }
+        std::vector<Entry> entries;
+        std::string line;
+        std::getline(file, line);
+        while (std::getline(file, line)) {
+            std::istringstream fields(line);
+            Entry entry {};
+            std::string kind;
+            if (!(fields >> entry.step >> kind >> entry.file) || (kind != "full" && kind != "delta")) {
+                return std::nullopt;
+            }
+            entry.full = kind == "full";
+            entries.push_back(std::move(entry));
+        }
+        return entries;
+    }
+
+    [[nodiscard]] bool write_index(const std::vector<Entry>& entries) const
+    {
+        const std::string temp_path = c_index_path + ".tmp";
+        {
+            std::ofstream file(temp_path, std::ios::trunc);
+            file << sc_index_magic << ' ' << sc_index_version << '\n';
+            for (const Entry& entry : entries) {
+                file << entry.step << (entry.full ? " full " : " delta ") << entry.file << '\n';
+            }
+            if (!file) {
+                return false;
+            }
+        }
+        return replace_file(temp_path, c_index_path);
+    }
+
+    const std::string c_index_path;
+    const int c_deltas_per_full;
+    std::vector<Entry> m_entries;
+    // names the sim's delta base while it is the last full checkpoint of the chain
+    std::optional<uint64_t> m_base_token;
+};
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+struct ColorRGB {
+    double r;
+    double g;
+    double b;
+};
+
+// Packs a color the way raylib lays out PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 in memory (little-endian)
+[[nodiscard]] inline uint32_t pack_color(const ColorRGB color)
+{
+    auto channel = [](const double value) {
+        return static_cast<uint32_t>(std::clamp(value, 0.0, 1.0) * 255.0);
+    };
+    return channel(color.r) | channel(color.g) << 8 | channel(color.b) << 16 | 255u << 24;
+}
+
+[[nodiscard]] inline uint32_t pack_color(const unsigned char r, const unsigned char g, const unsigned char b)
+{
+    return static_cast<uint32_t>(r) | static_cast<uint32_t>(g) << 8 | static_cast<uint32_t>(b) << 16 | 255u << 24;
+}
+
+// Looks up each value of a row in lut at (value - min) * factor, clamped to the table with NaN at the first entry,
+// and writes the entry to pixels, or ORs it in if combine is set
+template <size_t N>
+inline void map_lut_row(
+    const std::array<uint32_t, N>& lut,
+    const double* values,
+    uint32_t* pixels,
+    const int count,
+    const double min,
+    const double factor,
+    const bool absolute,
+    const bool combine)
+{
+    const auto store = [&](const int i, const uint32_t color) {
+        pixels[i] = combine ? pixels[i] | color : color;
+    };
+    int i = 0;
+#ifdef __SSE2__
+    const __m128d v_min = _mm_set1_pd(min);
+    const __m128d v_factor = _mm_set1_pd(factor);
+    const __m128d v_zero = _mm_setzero_pd();
+    const __m128d v_top = _mm_set1_pd(N - 1);
+    const __m128d v_sign_mask = _mm_set1_pd(-0.0);
+    for (; i + 2 <= count; i += 2) {
+        __m128d v = _mm_loadu_pd(values + i);
+        if (absolute) {
+            v = _mm_andnot_pd(v_sign_mask, v);
+        }
+        v = _mm_mul_pd(_mm_sub_pd(v, v_min), v_factor);
+        // max returns the second operand for NaN so invalid values map to the first entry
+        v = _mm_min_pd(_mm_max_pd(v, v_zero), v_top);
+        const __m128i idx = _mm_cvttpd_epi32(v);
+        store(i, lut[_mm_cvtsi128_si32(idx)]);
+        store(i + 1, lut[_mm_cvtsi128_si32(_mm_shuffle_epi32(idx, 1))]);
+    }
+#endif
+    for (; i < count; ++i) {
+        const double scaled = ((absolute ? std::abs(values[i]) : values[i]) - min) * factor;
+        // written so NaN falls through to 0
+        store(i, lut[scaled > 0.0 ? static_cast<size_t>(std::min(scaled, static_cast<double>(N - 1))) : 0]);
+    }
+}
+
+class Colormap {
+public:
+    enum class Preset {
+        grayscale,
+        diverging,
+        viridis,
+    };
+
+    explicit Colormap(const Preset preset)
+        : m_lut()
+    {
+        for (int i = 0; i < sc_lut_size; ++i) {
+            m_lut[i] = pack_color(color_at(preset, static_cast<double>(i) / (sc_lut_size - 1)));
+        }
+    }
+
+    [[nodiscard]] uint32_t map(const double value, const double min, const double max) const
+    {
+        return m_lut[lut_idx((value - min) * scale(min, max))];
+    }
+
+    // Maps a contiguous row of values in [min, max] to packed RGBA pixels.
+    void map_row(
+        const double* values, uint32_t* pixels, const int count, const double min, const double max, const bool absolute)
+        const
+    {
+        map_lut_row(m_lut, values, pixels, count, min, scale(min, max), absolute, false);
+    }
+
+private:
+    static constexpr int sc_lut_size = 4096;
+
+    [[nodiscard]] static double scale(const double min, const double max)
+    {
+        return (sc_lut_size - 1) / (max - min);
+    }
+
+    [[nodiscard]] static int lut_idx(const double scaled)
+    {
+        // written so NaN falls through to 0
+        return scaled > 0.0 ? static_cast<int>(std::min(scaled, static_cast<double>(sc_lut_size - 1))) : 0;
+    }
+
+    [[nodiscard]] static ColorRGB lerp(const ColorRGB a, const ColorRGB b, const double t)
+    {
+        return { a.r + (b.r - a.r) * t, a.g + (b.g - a.g) * t, a.b + (b.b - a.b) * t };
+    }
+
+    [[nodiscard]] static ColorRGB color_at(const Preset preset, const double t)
+    {
+        switch (preset) {
+        case Preset::grayscale:
+            return { t, t, t };
+        case Preset::diverging: {
+            constexpr ColorRGB cold { 0.230, 0.299, 0.754 };
+            constexpr ColorRGB neutral { 0.865, 0.865, 0.865 };
+            constexpr ColorRGB warm { 0.706, 0.016, 0.150 };
+            return t < 0.5 ? lerp(cold, neutral, t * 2.0) : lerp(neutral, warm, (t - 0.5) * 2.0);
+        }
+        case Preset::viridis: {
+            // polynomial fit of matplotlib's viridis
+            constexpr std::array<ColorRGB, 7> coeffs { {
+                { 0.2777273272234177, 0.005407344544966578, 0.3340998053353061 },
+                { 0.1050930431085774, 1.404613529898575, 1.384590162594685 },
+                { -0.3308618287255563, 0.214847559468213, 0.09509516302823659 },
+                { -4.634230498983486, -5.799100973351585, -19.33244095627987 },
+                { 6.228269936347081, 14.17993336680509, 56.69055260068105 },
+                { 4.776384997670288, -13.74514537774601, -65.35303263337234 },
+                { -5.435455855934631, 4.645852612178535, 26.3124352495832 },
+            } };
+            ColorRGB color { 0.0, 0.0, 0.0 };
+            for (auto it = coeffs.rbegin(); it != coeffs.rend(); ++it) {
+                color = { color.r * t + it->r, color.g * t + it->g, color.b * t + it->b };
+            }
+            return color;
+        }
+        }
+        return { 0.0, 0.0, 0.0 };
+    }
+
+    std::array<uint32_t, sc_lut_size> m_lut;
+};
+
+// Colors a pair of values per pixel, the first in the red channel and the second in the green one, each scaled
+// from [min, max] to the channel's full range, such as the real and imaginary parts of a complex field
+class TwoChannelColormap {
+public:
+    TwoChannelColormap()
+        : m_red_lut()
+        , m_green_lut()
+    {
+        for (int i = 0; i < sc_lut_size; ++i) {
+            const auto intensity = static_cast<unsigned char>(static_cast<double>(i) / (sc_lut_size - 1) * 255.0);
+            m_red_lut[i] = pack_color(intensity, 0, 0);
+            m_green_lut[i] = pack_color(0, intensity, 0);
+        }
+    }
+
+    void map_row(
+        const double* first,
+        const double* second,
+        uint32_t* pixels,
+        const int count,
+        const double min,
+        const double max) const
+    {
+        const double factor = (sc_lut_size - 1) / (max - min);
+        map_lut_row(m_red_lut, first, pixels, count, min, factor, false, false);
+        map_lut_row(m_green_lut, second, pixels, count, min, factor, false, true);
+    }
+
+private:
+    static constexpr int sc_lut_size = 1024;
+
+    std::array<uint32_t, sc_lut_size> m_red_lut;
+    std::array<uint32_t, sc_lut_size> m_green_lut;
+};
+
+// Colors complex values with hue from the phase and brightness from the magnitude using a 2D lookup table.
+class PhaseColormap {
+public:
+    PhaseColormap()
+        : m_lut()
+    {
+        for (int m = 0; m < sc_magnitude_steps; ++m) {
+            const double value = static_cast<double>(m) / (sc_magnitude_steps - 1);
+            for (int p = 0; p < sc_phase_steps; ++p) {
+                const double hue = 6.0 * static_cast<double>(p) / sc_phase_steps;
+                m_lut[m * sc_phase_steps + p] = pack_color(hue_to_rgb(hue, value));
+            }
+        }
+    }
+
+    // Maps a row of magnitudes in [0, max_magnitude] and phases in [-pi, pi] to packed RGBA pixels
+    void map_row(
+        const double* magnitudes, const double* phases, uint32_t* pixels, const int count, const double max_magnitude)
+        const
+    {
+        const double magnitude_factor = (sc_magnitude_steps - 1) / max_magnitude;
+        constexpr double phase_factor = sc_phase_steps / (2.0 * std::numbers::pi);
+        for (int i = 0; i < count; ++i) {
+            const double magnitude = magnitudes[i] * magnitude_factor;
+            const int m = magnitude > 0.0 ? static_cast<int>(std::min(magnitude, sc_magnitude_steps - 1.0)) : 0;
+            const double phase = (phases[i] + std::numbers::pi) * phase_factor;
+            const int p = phase > 0.0 ? static_cast<int>(phase) % sc_phase_steps : 0;
+            pixels[i] = m_lut[m * sc_phase_steps + p];
+        }
+    }
+
+private:
+    static constexpr int sc_phase_steps = 256;
+    static constexpr int sc_magnitude_steps = 64;
+
+    [[nodiscard]] static ColorRGB hue_to_rgb(const double hue, const double value)
+    {
+        const double x = value * (1.0 - std::abs(std::fmod(hue, 2.0) - 1.0));
+        switch (static_cast<int>(hue)) {
+        case 0:
+            return { value, x, 0.0 };
+        case 1:
+            return { x, value, 0.0 };
+        case 2:
+            return { 0.0, value, x };
+        case 3:
+            return { 0.0, x, value };
+        case 4:
+            return { x, 0.0, value };
+        default:
+            return { value, 0.0, x };
+        }
+    }
+
+    std::array<uint32_t, sc_phase_steps * sc_magnitude_steps> m_lut;
+};
@@ -3,4 +3,13 @@
 struct Vector2i {
     int x;
     int y;
+};
+
+struct Recti {
+    int x;
+    int y;
+    int width;
+    int height;
+
+    bool operator==(const Recti&) const = default;
 };
\ No newline at end of file
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+// Measures where each frame's time goes and adapts the amount of work per frame to a frame budget:
+// how many sim steps to batch, how much to lower the render resolution, and whether a frame needs recolorizing.
+class FrameGovernor {
+public:
+    enum class Phase {
+        input,
+        sim,
+        // sim work that runs concurrently with the render phases (on another thread)
+        sim_overlapped,
+        normalize,
+        colorize,
+        upload,
+        draw,
+        count,
+    };
+
+    explicit FrameGovernor(const int target_fps)
+        : c_target_frame_seconds(1.0 / target_fps)
+        , m_phase_seconds()
+        , m_last_phase_seconds()
+        , m_sim_steps(1)
+        , m_render_scale(1.0f)
+        , m_last_render_key(0)
+        , m_has_rendered(false)
+        , m_frame_start(std::chrono::steady_clock::now())
+        , m_last_frame_seconds(0.0)
+    {
+    }
+
+    class ScopedTimer {
+    public:
+        ScopedTimer(FrameGovernor& governor, const Phase phase)
+            : m_governor(governor)
+            , m_phase(phase)
+            , m_start(std::chrono::steady_clock::now())
+        {
+        }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+        ~ScopedTimer()
+        {
+            m_governor.record(m_phase, seconds_since(m_start));
+        }
+
+    private:
+        FrameGovernor& m_governor;
+        Phase m_phase;
+        std::chrono::steady_clock::time_point m_start;
+    };
+
+    [[nodiscard]] ScopedTimer time(const Phase phase)
+    {
+        return { *this, phase };
+    }
+
+    void record(const Phase phase, const double seconds)
+    {
+        m_phase_seconds[static_cast<size_t>(phase)] += seconds;
+    }
+
+    [[nodiscard]] static double seconds_since(const std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Number of sim steps to run this frame
+    [[nodiscard]] int sim_steps() const
+    {
+        return m_sim_steps;
+    }
+
+    // Multiplier for the render resolution, in [sc_min_render_scale, 1]
+    [[nodiscard]] float render_scale() const
+    {
+        return m_render_scale;
+    }
+
+    // Returns false when nothing that affects the rendered image changed since the last frame that rendered.
+    // render_key should combine the sim state revision with anything else that changes the image.
+    [[nodiscard]] bool needs_render(const uint64_t render_key)
+    {
+        if (m_has_rendered && render_key == m_last_render_key) {
+            return false;
+        }
+        m_has_rendered = true;
+        m_last_render_key = render_key;
+        return true;
+    }
+
+    [[nodiscard]] double phase_seconds(const Phase phase) const
+    {
+        return m_last_phase_seconds[static_cast<size_t>(phase)];
+    }
+
+    // Wall time between the last two end_frame() calls
+    [[nodiscard]] double frame_seconds() const
+    {
+        return m_last_frame_seconds;
+    }
+
+    [[nodiscard]] static const char* phase_name(const Phase phase)
+    {
+        switch (phase) {
+        case Phase::input:
+            return "input";
+        case Phase::sim:
+            return "sim";
+        case Phase::sim_overlapped:
+            return "sim (overlap)";
+        case Phase::normalize:
+            return "normalize";
+        case Phase::colorize:
+            return "colorize";
+        case Phase::upload:
+            return "upload";
+        case Phase::draw:
+            return "draw";
+        default:
+            return "";
+        }
+    }
+
+    [[nodiscard]] double target_frame_seconds() const
+    {
+        return c_target_frame_seconds;
+    }
+
+    // Adapts the batch size and render scale from this frame's timings and starts a new frame
+    void end_frame()
+    {
+        m_last_phase_seconds = m_phase_seconds;
+        m_phase_seconds = {};
+        const auto now = std::chrono::steady_clock::now();
+        m_last_frame_seconds = std::chrono::duration<double>(now - m_frame_start).count();
+        m_frame_start = now;
+
+        const double sim = phase_seconds(Phase::sim) + phase_seconds(Phase::sim_overlapped)
+            + phase_seconds(Phase::normalize);
+        const double render = phase_seconds(Phase::colorize) + phase_seconds(Phase::upload) + phase_seconds(Phase::draw);
+
+        if (render > c_target_frame_seconds * sc_render_share_high) {
+            m_render_scale = std::max(m_render_scale * 0.85f, sc_min_render_scale);
+        }
+        else if (render < c_target_frame_seconds * sc_render_share_low) {
+            m_render_scale = std::min(m_render_scale * 1.05f, 1.0f);
+        }
+
+        // step one at a time towards the batch that fills the budget so a single slow frame does not swing it
+        if (sim > 0.0) {
+            const double step_seconds = sim / m_sim_steps;
+            const double sim_budget = c_target_frame_seconds * sc_sim_share - phase_seconds(Phase::input)
+                - (phase_seconds(Phase::sim_overlapped) > 0.0 ? 0.0 : render);
+            const int desired = std::clamp(static_cast<int>(sim_budget / step_seconds), 1, sc_max_sim_steps);
+            if (desired > m_sim_steps) {
+                ++m_sim_steps;
+            }
+            else if (desired < m_sim_steps) {
+                --m_sim_steps;
+            }
+        }
+    }
+
+private:
+    static constexpr int sc_max_sim_steps = 64;
+    static constexpr float sc_min_render_scale = 0.25f;
+    static constexpr double sc_sim_share = 0.8;
+    static constexpr double sc_render_share_high = 0.5;
+    static constexpr double sc_render_share_low = 0.25;
+
+    const double c_target_frame_seconds;
+    std::array<double, static_cast<size_t>(Phase::count)> m_phase_seconds;
+    std::array<double, static_cast<size_t>(Phase::count)> m_last_phase_seconds;
+    int m_sim_steps;
+    float m_render_scale;
+    uint64_t m_last_render_key;
+    bool m_has_rendered;
+    std::chrono::steady_clock::time_point m_frame_start;
+    double m_last_frame_seconds;
+};
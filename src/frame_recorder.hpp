@@ -0,0 +1,378 @@
+#pragma once
+
+// Records sim frames to a file without stalling the solver. record() copies the present field into one of a fixed
+// pool of buffers and queues it; a background thread converts it to the file's precision, or compresses it within
+// an error bound, and writes it.
+//
+// File layout: FrameFileHeader, one chunk per frame (FrameChunkHeader and size * size * components values, row-major
+// with a cell's components adjacent), then the index (one FrameIndexEntry per frame) and FrameFileFooter.
+// A file cut short by a crash has no footer, but its chunks can still be read by scanning from the start.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <BS_thread_pool.hpp>
+
+#include "background_writer.hpp"
+#include "lossy_codec.hpp"
+
+struct FrameFileHeader {
+    static constexpr std::array<char, 8> sc_magic { 'S', 'I', 'M', 'F', 'R', 'A', 'M', 'E' };
+    static constexpr uint32_t sc_version = 2;
+
+    std::array<char, 8> magic;
+    uint32_t version;
+    // 4 for float, 8 for double
+    uint32_t value_bytes;
+    int32_t size;
+    uint32_t components;
+    // above zero, chunks are lossy::compress streams within this absolute error instead of raw values
+    double error_bound;
+};
+
+struct FrameChunkHeader {
+    uint64_t step;
+    uint64_t bytes;
+};
+
+struct FrameIndexEntry {
+    uint64_t step;
+    // of the chunk header
+    uint64_t offset;
+};
+
+struct FrameFileFooter {
+    static constexpr std::array<char, 8> sc_magic { 'F', 'R', 'A', 'M', 'E', 'I', 'D', 'X' };
+
+    uint64_t index_offset;
+    uint64_t frame_count;
+    std::array<char, 8> magic;
+};
+
+class FrameRecorder {
+public:
+    enum class Precision {
+        float32,
+        float64,
+    };
+
+    // What record() does when every buffer is still waiting to be written
+    enum class Backpressure {
+        // skip the frame
+        drop,
+        // wait for the writer, stalling the caller
+        block,
+        // skip the frame and record every other due frame from now on, relaxing again once the writer catches up
+        decimate,
+    };
+
+    struct Properties {
+        int size = 512;
+        int components = 1;
+        // record every interval steps
+        int interval = 1;
+        Precision precision = Precision::float32;
+        // above zero, frames are compressed to within this absolute error instead of stored at precision
+        double error_bound = 0.0;
+        Backpressure backpressure = Backpressure::drop;
+        // frames that may wait for the writer at once
+        int queue_frames = 4;
+    };
+
+    // Opens path for writing; check ok() before recording
+    FrameRecorder(const std::string& path, const Properties& props)
+        : c_size(props.size)
+        , c_components(props.components)
+        , c_interval(std::max(props.interval, 1))
+        , c_precision(props.error_bound > 0.0 ? Precision::float64 : props.precision)
+        , c_error_bound(props.error_bound)
+        , c_backpressure(props.backpressure)
+        , m_file(path, std::ios::binary | std::ios::trunc)
+        , m_index()
+        , m_converted(c_precision == Precision::float32 ? frame_values() : 0)
+        , m_compressed()
+        , m_frames_written(0)
+        , m_decimation(1)
+        , m_dropped(0)
+        , m_failed(false)
+        , m_compress_pool()
+        , m_writer(
+              std::vector<Frame>(
+                  std::max(props.queue_frames, 1), Frame { .step = 0, .values = std::vector<double>(frame_values()) }),
+              [this](Frame& frame) { return write_frame(frame); })
+    {
+        if (c_error_bound > 0.0) {
+            m_compress_pool.emplace();
+        }
+        const FrameFileHeader header { .magic = FrameFileHeader::sc_magic,
+                                       .version = FrameFileHeader::sc_version,
+                                       .value_bytes = value_bytes(),
+                                       .size = c_size,
+                                       .components = static_cast<uint32_t>(c_components),
+                                       .error_bound = c_error_bound };
+        m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        m_failed = !m_file;
+    }
+
+    FrameRecorder(const FrameRecorder&) = delete;
+    FrameRecorder& operator=(const FrameRecorder&) = delete;
+
+    ~FrameRecorder()
+    {
+        finish();
+    }
+
+    [[nodiscard]] bool ok() const
+    {
+        return !m_failed && m_writer.ok();
+    }
+
+    // Call once per sim step with the sim's step count. When a frame is due, fill is called with a
+    // size * size * components buffer to copy the present field into.
+    template <typename Fill>
+    void record(const uint64_t step, Fill&& fill)
+    {
+        if (m_writer.finished() || step % (static_cast<uint64_t>(c_interval) * m_decimation) != 0) {
+            return;
+        }
+        const std::optional<size_t> slot = m_writer.acquire(c_backpressure == Backpressure::block);
+        if (!slot.has_value()) {
+            ++m_dropped;
+            if (c_backpressure == Backpressure::decimate) {
+                m_decimation = std::min(m_decimation * 2, sc_max_decimation);
+            }
+            return;
+        }
+        if (c_backpressure == Backpressure::decimate && m_decimation > 1 && m_writer.caught_up()) {
+            m_decimation /= 2;
+        }
+        Frame& frame = m_writer.slot(*slot);
+        frame.step = step;
+        fill(frame.values.data());
+        m_writer.queue(*slot);
+    }
+
+    // Writes the queued frames, the index and the footer and closes the file. Returns false if any write failed.
+    bool finish()
+    {
+        if (m_writer.finished()) {
+            return ok();
+        }
+        m_writer.finish();
+
+        const FrameFileFooter footer { .index_offset = static_cast<uint64_t>(m_file.tellp()),
+                                       .frame_count = m_index.size(),
+                                       .magic = FrameFileFooter::sc_magic };
+        m_file.write(
+            reinterpret_cast<const char*>(m_index.data()),
+            static_cast<std::streamsize>(m_index.size() * sizeof(FrameIndexEntry)));
+        m_file.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+        m_file.close();
+        m_failed |= !m_file;
+        return ok();
+    }
+
+    [[nodiscard]] uint64_t frames_written() const
+    {
+        return m_frames_written;
+    }
+
+    // Frames skipped because the writer fell behind; read from the thread that records
+    [[nodiscard]] uint64_t frames_dropped() const
+    {
+        return m_dropped;
+    }
+
+    // Current multiple of the interval between recorded frames, above 1 only while decimating; read from the thread
+    // that records
+    [[nodiscard]] uint64_t decimation() const
+    {
+        return m_decimation;
+    }
+
+private:
+    static constexpr uint64_t sc_max_decimation = 1024;
+
+    struct Frame {
+        uint64_t step;
+        std::vector<double> values;
+    };
+
+    [[nodiscard]] size_t frame_values() const
+    {
+        return static_cast<size_t>(c_size) * c_size * c_components;
+    }
+
+    [[nodiscard]] uint32_t value_bytes() const
+    {
+        return c_precision == Precision::float32 ? sizeof(float) : sizeof(double);
+    }
+
+    bool write_frame(const Frame& frame)
+    {
+        const char* data = reinterpret_cast<const char*>(frame.values.data());
+        uint64_t bytes = frame.values.size() * sizeof(double);
+        if (m_compress_pool.has_value()) {
+            lossy::compress(
+                frame.values.data(), c_size, c_size, c_components, c_error_bound, m_compressed, *m_compress_pool);
+            data = reinterpret_cast<const char*>(m_compressed.data());
+            bytes = m_compressed.size();
+        }
+        else if (c_precision == Precision::float32) {
+            for (size_t i = 0; i < frame.values.size(); ++i) {
+                m_converted[i] = static_cast<float>(frame.values[i]);
+            }
+            data = reinterpret_cast<const char*>(m_converted.data());
+            bytes = m_converted.size() * sizeof(float);
+        }
+        const FrameChunkHeader chunk { .step = frame.step, .bytes = bytes };
+        m_index.push_back({ .step = frame.step, .offset = static_cast<uint64_t>(m_file.tellp()) });
+        m_file.write(reinterpret_cast<const char*>(&chunk), sizeof(chunk));
+        m_file.write(data, static_cast<std::streamsize>(chunk.bytes));
+        ++m_frames_written;
+        return static_cast<bool>(m_file);
+    }
+
+    const int c_size;
+    const int c_components;
+    const int c_interval;
+    const Precision c_precision;
+    const double c_error_bound;
+    const Backpressure c_backpressure;
+    // the file, index and conversion buffers belong to the writer thread until it is finished
+    std::ofstream m_file;
+    std::vector<FrameIndexEntry> m_index;
+    std::vector<float> m_converted;
+    std::vector<uint8_t> m_compressed;
+    std::atomic<uint64_t> m_frames_written;
+    // of the recording thread
+    uint64_t m_decimation;
+    uint64_t m_dropped;
+    bool m_failed;
+    std::optional<BS::thread_pool> m_compress_pool;
+    BackgroundWriter<Frame> m_writer;
+};
+
+// Reads frames back from a finished recording through its index
+class FrameReader {
+public:
+    // Returns nullopt if the file is missing, not a recording, has no footer or an index that does not fit the file
+    static std::optional<FrameReader> open(const std::string& path)
+    {
+        FrameReader reader(path);
+        std::ifstream& file = reader.m_file;
+        file.read(reinterpret_cast<char*>(&reader.m_header), sizeof(FrameFileHeader));
+        const FrameFileHeader& header = reader.m_header;
+        if (!file || header.magic != FrameFileHeader::sc_magic || header.version != FrameFileHeader::sc_version
+            || header.size <= 0 || header.components == 0
+            || (header.value_bytes != sizeof(float) && header.value_bytes != sizeof(double))) {
+            return std::nullopt;
+        }
+        file.seekg(0, std::ios::end);
+        reader.m_file_bytes = static_cast<uint64_t>(file.tellg());
+        FrameFileFooter footer {};
+        if (!file || reader.m_file_bytes < sizeof(FrameFileHeader) + sizeof(footer)) {
+            return std::nullopt;
+        }
+        const uint64_t footer_offset = reader.m_file_bytes - sizeof(footer);
+        file.seekg(static_cast<std::streamoff>(footer_offset));
+        file.read(reinterpret_cast<char*>(&footer), sizeof(footer));
+        // the index runs from its offset up to the footer, so a damaged count cannot ask for more than the file holds
+        if (!file || footer.magic != FrameFileFooter::sc_magic || footer.index_offset > footer_offset
+            || (footer_offset - footer.index_offset) % sizeof(FrameIndexEntry) != 0
+            || footer.frame_count != (footer_offset - footer.index_offset) / sizeof(FrameIndexEntry)) {
+            return std::nullopt;
+        }
+        reader.m_index.resize(footer.frame_count);
+        file.seekg(static_cast<std::streamoff>(footer.index_offset));
+        file.read(
+            reinterpret_cast<char*>(reader.m_index.data()),
+            static_cast<std::streamsize>(reader.m_index.size() * sizeof(FrameIndexEntry)));
+        if (!file) {
+            return std::nullopt;
+        }
+        if (reader.m_header.error_bound > 0.0) {
+            reader.m_decompress_pool = std::make_unique<BS::thread_pool>();
+        }
+        return reader;
+    }
+
+    [[nodiscard]] const FrameFileHeader& header() const
+    {
+        return m_header;
+    }
+
+    [[nodiscard]] size_t frame_count() const
+    {
+        return m_index.size();
+    }
+
+    // Step of frame, or nullopt if there is no such frame
+    [[nodiscard]] std::optional<uint64_t> step(const size_t frame) const
+    {
+        if (frame >= m_index.size()) {
+            return std::nullopt;
+        }
+        return m_index[frame].step;
+    }
+
+    // Reads frame as doubles, whatever precision or compression it was written with. Returns false if there is no such
+    // frame or it is damaged; later reads are unaffected.
+    bool read(const size_t frame, std::vector<double>& values)
+    {
+        if (frame >= m_index.size() || m_index[frame].offset > m_file_bytes - sizeof(FrameChunkHeader)) {
+            return false;
+        }
+        FrameChunkHeader chunk {};
+        m_file.clear();
+        m_file.seekg(static_cast<std::streamoff>(m_index[frame].offset));
+        m_file.read(reinterpret_cast<char*>(&chunk), sizeof(chunk));
+        if (!m_file || chunk.bytes > m_file_bytes - sizeof(FrameChunkHeader) - m_index[frame].offset) {
+            return false;
+        }
+        const size_t count = static_cast<size_t>(m_header.size) * m_header.size * m_header.components;
+        if (m_decompress_pool != nullptr) {
+            std::vector<uint8_t> compressed(chunk.bytes);
+            m_file.read(reinterpret_cast<char*>(compressed.data()), static_cast<std::streamsize>(chunk.bytes));
+            return m_file && lossy::decompress(compressed.data(), compressed.size(), values, *m_decompress_pool)
+                && values.size() == count;
+        }
+        if (chunk.bytes != count * m_header.value_bytes) {
+            return false;
+        }
+        values.resize(count);
+        if (m_header.value_bytes == sizeof(double)) {
+            m_file.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(chunk.bytes));
+        }
+        else {
+            std::vector<float> stored(count);
+            m_file.read(reinterpret_cast<char*>(stored.data()), static_cast<std::streamsize>(chunk.bytes));
+            std::ranges::copy(stored, values.begin());
+        }
+        return static_cast<bool>(m_file);
+    }
+
+private:
+    explicit FrameReader(const std::string& path)
+        : m_file(path, std::ios::binary)
+        , m_header()
+        , m_file_bytes(0)
+        , m_index()
+        , m_decompress_pool()
+    {
+    }
+
+    std::ifstream m_file;
+    FrameFileHeader m_header;
+    uint64_t m_file_bytes;
+    std::vector<FrameIndexEntry> m_index;
+    // only for compressed recordings
+    std::unique_ptr<BS::thread_pool> m_decompress_pool;
+};
@@ -0,0 +1,190 @@
+#pragma once
+
+// Records the edits the wave app makes to its sim, each with the step it was made at, so a session can be replayed
+// bit for bit without a window. A log starts from a checkpoint of the sim saved next to it; replaying loads that,
+// applies every event at its step and updates in between, which is all the app does to the sim.
+//
+// File layout: InputLogHeader, then one InputEvent per edit in the order they were applied. A finished log ends with
+// an InputAction::end event at the step recording stopped; a log cut short by a crash ends at its last whole event.
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "common.hpp"
+#include "wave_sim.hpp"
+
+// The effect of a mouse button in a mode, so the log does not depend on the app's key bindings
+enum class InputAction : uint32_t {
+    // adds amount to the cell
+    add = 1,
+    // zeroes the cells within radius and fixes them
+    paint_walls = 2,
+    // zeroes the fixed cells within radius and frees them
+    erase_walls = 3,
+    clear = 4,
+    end = 5,
+};
+
+struct InputEvent {
+    uint64_t step;
+    InputAction action;
+    int32_t x;
+    int32_t y;
+    int32_t radius;
+    double amount;
+};
+
+struct InputLogHeader {
+    static constexpr std::array<char, 8> sc_magic { 'S', 'I', 'M', 'I', 'N', 'P', 'U', 'T' };
+    static constexpr uint32_t sc_version = 1;
+
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t event_bytes;
+    // step of the checkpoint the log starts from
+    uint64_t start_step;
+};
+
+// Applies an event to sim. The app edits through here too, so a replay makes exactly the same changes.
+// Returns whether the sim changed.
+inline bool apply_input(WaveSim& sim, const InputEvent& event)
+{
+    const Vector2i center { event.x, event.y };
+    const auto brush = [&](const auto& paint) {
+        bool changed = false;
+        for (int x = -event.radius; x < event.radius; ++x) {
+            for (int y = -event.radius; y < event.radius; ++y) {
+                if (const Vector2i pos { center.x + x, center.y + y };
+                    sim.in_bounds(pos) && std::sqrt(x * x + y * y) <= event.radius) {
+                    changed |= paint(pos);
+                }
+            }
+        }
+        return changed;
+    };
+    switch (event.action) {
+    case InputAction::add:
+        if (!sim.in_bounds(center)) {
+            return false;
+        }
+        sim.add_at(center, event.amount);
+        return true;
+    case InputAction::paint_walls:
+        return brush([&](const Vector2i pos) {
+            sim.set_at(pos, 0.0);
+            sim.set_fixed_at(pos, true);
+            return true;
+        });
+    case InputAction::erase_walls:
+        return brush([&](const Vector2i pos) {
+            if (!sim.fixed_at(pos)) {
+                return false;
+            }
+            sim.set_at(pos, 0.0);
+            sim.set_fixed_at(pos, false);
+            return true;
+        });
+    case InputAction::clear:
+        sim.clear();
+        return true;
+    case InputAction::end:
+        return false;
+    }
+    return false;
+}
+
+// Appends events to a log as they happen. Each event is flushed, so a session that crashes keeps its edits.
+class InputLogWriter {
+public:
+    // The sim's state at start_step has to be saved to InputLog::checkpoint_path(path) for the log to be replayed
+    InputLogWriter(const std::string& path, const uint64_t start_step)
+        : m_file(path, std::ios::binary | std::ios::trunc)
+        , m_events(0)
+    {
+        const InputLogHeader header { .magic = InputLogHeader::sc_magic,
+                                      .version = InputLogHeader::sc_version,
+                                      .event_bytes = sizeof(InputEvent),
+                                      .start_step = start_step };
+        m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        m_file.flush();
+    }
+
+    void write(const InputEvent& event)
+    {
+        m_file.write(reinterpret_cast<const char*>(&event), sizeof(event));
+        m_file.flush();
+        ++m_events;
+    }
+
+    // Ends the log at step, which replay runs up to. Returns false if any write failed.
+    bool finish(const uint64_t step)
+    {
+        const InputEvent end { .step = step, .action = InputAction::end, .x = 0, .y = 0, .radius = 0, .amount = 0.0 };
+        write(end);
+        m_file.close();
+        return !m_file.fail();
+    }
+
+    // Including the end event once finished
+    [[nodiscard]] uint64_t events_written() const
+    {
+        return m_events;
+    }
+
+private:
+    std::ofstream m_file;
+    uint64_t m_events;
+};
+
+struct InputLog {
+    uint64_t start_step;
+    std::vector<InputEvent> events;
+
+    [[nodiscard]] static std::string checkpoint_path(const std::string& log_path)
+    {
+        return log_path + ".ckpt";
+    }
+
+    // Returns nullopt if the file is missing or not an input log. A partly written last event is left out.
+    static std::optional<InputLog> read(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        InputLogHeader header {};
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!file || header.magic != InputLogHeader::sc_magic || header.version != InputLogHeader::sc_version
+            || header.event_bytes != sizeof(InputEvent)) {
+            return std::nullopt;
+        }
+        InputLog log { .start_step = header.start_step, .events = {} };
+        InputEvent event {};
+        while (file.read(reinterpret_cast<char*>(&event), sizeof(event))) {
+            log.events.push_back(event);
+        }
+        return log;
+    }
+};
+
+// Replays log on sim, which must hold the log's starting checkpoint: updates up to each event's step and applies
+// it, then stops at the end event, or after the last event of an unfinished log. Returns false if the sim is not at
+// the start step or the events are out of order.
+inline bool replay_inputs(WaveSim& sim, const InputLog& log)
+{
+    if (sim.step() != log.start_step) {
+        return false;
+    }
+    for (const InputEvent& event : log.events) {
+        if (event.step < sim.step()) {
+            return false;
+        }
+        while (sim.step() < event.step) {
+            sim.update();
+        }
+        apply_input(sim, event);
+    }
+    return true;
+}
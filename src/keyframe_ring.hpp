@@ -0,0 +1,402 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#ifndef PLATFORM_WEB
+#include <BS_thread_pool.hpp>
+
+#include "background_writer.hpp"
+#include "checkpoint.hpp"
+#endif
+#include "trace.hpp"
+
+// Compressed keyframes of a sim taken every few steps, so any step since the oldest keyframe can be revisited by
+// restoring the keyframe before it and recomputing forward. The oldest keyframes are dropped to stay within a memory
+// budget, so the memory used grows with the steps covered divided by the interval rather than with every frame.
+// The stepping thread only copies the state into a free buffer; a background thread compresses it, and a keyframe
+// that comes due while every buffer is still being compressed is taken a step later. The web build has no threads
+// and stores its keyframes raw. The sim needs copy_keyframe() (off the web), save_keyframe() for a raw copy,
+// load_keyframe(), update(), step(), reversible() and step_backward().
+//
+// Recomputing only reproduces the run up to the next edit, so the edits must be reported with mark_edit(); steps
+// after an edit can only be reached from keyframes taken after it, and the next record() takes one. Safe to use from
+// two threads, e.g. a sim thread recording and the main thread reading the covered range, as long as only one of
+// them steps the sim.
+class KeyframeRing {
+public:
+    struct Properties {
+        // steps between keyframes, which is also the most steps a seek recomputes
+        uint64_t interval = 64;
+        size_t memory_budget = size_t { 256 } << 20;
+        // keyframes copied out and waiting to be compressed at once, and the threads compressing them
+        int queue_keyframes = 2;
+        int compress_threads = 2;
+        // raw states step_backward() keeps while recomputing, so it steps back through an interval without
+        // recomputing it for every step
+        size_t window_budget = size_t { 256 } << 20;
+    };
+
+    explicit KeyframeRing(const Properties& props)
+        : c_interval(std::max<uint64_t>(props.interval, 1))
+        , c_memory_budget(props.memory_budget)
+        , c_window_budget(props.window_budget)
+        , m_mutex()
+        , m_keyframes()
+        , m_bytes(0)
+        , m_last_step(0)
+        , m_taken_step()
+        , m_keyframe_due(true)
+        , m_reversal_floor(0)
+        , m_generation(0)
+        , m_window()
+        , m_window_bytes(0)
+        , m_window_generation(0)
+        , m_spare()
+#ifndef PLATFORM_WEB
+        , m_pool(std::max(props.compress_threads, 1))
+        , m_writer(std::vector<Pending>(std::max(props.queue_keyframes, 1)),
+                   [this](Pending& pending) { return compress(pending); })
+#endif
+    {
+    }
+
+    // Call after every step; takes a keyframe when one is due. Returns false if the sim failed to save one.
+    template <typename Sim>
+    bool record(Sim& sim)
+    {
+        const uint64_t step = sim.step();
+        uint64_t generation = 0;
+        {
+            const std::lock_guard lock(m_mutex);
+            m_last_step = std::max(m_last_step, step);
+            if (m_taken_step.has_value() && step < *m_taken_step + (m_keyframe_due ? 1 : c_interval)) {
+                return true;
+            }
+            generation = m_generation;
+        }
+        TRACE_ZONE("KeyframeRing::record");
+#ifndef PLATFORM_WEB
+        const std::optional<size_t> slot = m_writer.acquire(false);
+        if (!slot.has_value()) {
+            return m_writer.ok();
+        }
+        Pending& pending = m_writer.slot(*slot);
+        pending.step = step;
+        pending.generation = generation;
+        pending.writer = sim.copy_keyframe(pending.copy);
+        m_writer.queue(*slot);
+        taken(step, generation);
+        return m_writer.ok();
+#else
+        std::vector<char> data;
+        if (!sim.save_keyframe(data)) {
+            return false;
+        }
+        taken(step, generation);
+        add(step, generation, std::move(data));
+        return true;
+#endif
+    }
+
+    // The sim was edited at step, which drops the keyframes after it (there are some after a seek back) and stops
+    // seeks from recomputing past it from earlier keyframes
+    void mark_edit(const uint64_t step)
+    {
+        const std::lock_guard lock(m_mutex);
+        truncate(step);
+        m_reversal_floor = step;
+    }
+
+    // Restores the last keyframe at or before step and updates the sim up to step, or only up to the first edit
+    // after the keyframe. Returns the step reached, or nullopt, leaving the sim unchanged, if step is before the
+    // oldest keyframe or the keyframe does not fit the sim.
+    template <typename Sim>
+    std::optional<uint64_t> seek(Sim& sim, const uint64_t step)
+    {
+        TRACE_ZONE("KeyframeRing::seek");
+        wait_compressed();
+        uint64_t target = step;
+        {
+            const std::lock_guard lock(m_mutex);
+            const Keyframe* keyframe = keyframe_before(step);
+            if (keyframe == nullptr || !sim.load_keyframe(keyframe->data)) {
+                return std::nullopt;
+            }
+            target = std::min(target, keyframe->edit_step.value_or(target));
+            // the steps since the keyframe hold no edit, so a reversible sim can step back through them
+            m_reversal_floor = keyframe->step;
+        }
+        while (sim.step() < target) {
+            sim.update();
+        }
+        return target;
+    }
+
+    // Returns the sim to the state one step earlier: reversible sims step backward exactly down to the last edit or
+    // seek, other sims and earlier steps are recomputed from the keyframe before. Recomputing keeps states about
+    // every square root of the steps recomputed and every step just before the target, within window_budget, so
+    // stepping back through a whole interval recomputes it about twice. Returns false, leaving the sim unchanged, if
+    // the step before is not covered or lies behind an edit no keyframe was taken after.
+    template <typename Sim>
+    bool step_backward(Sim& sim)
+    {
+        TRACE_ZONE("KeyframeRing::step_backward");
+        const uint64_t step = sim.step();
+        if (step == 0) {
+            return false;
+        }
+        bool exact = false;
+        {
+            const std::lock_guard lock(m_mutex);
+            exact = sim.reversible() && step > m_reversal_floor;
+        }
+        if (!exact) {
+            wait_compressed();
+            return recompute_back(sim, step - 1);
+        }
+        if (!sim.step_backward()) {
+            return false;
+        }
+        // stepping forward again does not retrace the recorded steps bit for bit, so they are dropped like after an
+        // edit, but the exact steps back before this one stay open
+        const std::lock_guard lock(m_mutex);
+        truncate(step - 1);
+        return true;
+    }
+
+    // Step of the oldest keyframe, or nullopt if there are none yet
+    [[nodiscard]] std::optional<uint64_t> first_step() const
+    {
+        const std::lock_guard lock(m_mutex);
+        if (m_keyframes.empty()) {
+            return std::nullopt;
+        }
+        return m_keyframes.front().step;
+    }
+
+    // Latest step recorded or edited
+    [[nodiscard]] uint64_t last_step() const
+    {
+        const std::lock_guard lock(m_mutex);
+        return m_last_step;
+    }
+
+    [[nodiscard]] size_t memory_bytes() const
+    {
+        const std::lock_guard lock(m_mutex);
+        return m_bytes;
+    }
+
+private:
+    struct Keyframe {
+        uint64_t step;
+        std::vector<char> data;
+        // the earliest edit between this keyframe and the next, if any
+        std::optional<uint64_t> edit_step;
+    };
+
+#ifndef PLATFORM_WEB
+    // A keyframe copied out of the sim, waiting to be compressed
+    struct Pending {
+        uint64_t step = 0;
+        uint64_t generation = 0;
+        // the copied state, which writer points into; kept between keyframes to reuse the allocation
+        std::vector<char> copy;
+        std::optional<CheckpointWriter> writer;
+    };
+
+    // Runs on the writer thread
+    bool compress(Pending& pending)
+    {
+        TRACE_ZONE("KeyframeRing::compress");
+        std::vector<char> data;
+        const bool written = pending.writer->write_lossless(data, m_pool);
+        pending.writer.reset();
+        if (written) {
+            add(pending.step, pending.generation, std::move(data));
+        }
+        return written;
+    }
+#endif
+
+    // Returns the sim to target, an earlier step, from the closest state kept since the keyframe before it, or else
+    // from the keyframe, keeping states on the way for the next steps back; see step_backward()
+    template <typename Sim>
+    bool recompute_back(Sim& sim, const uint64_t target)
+    {
+        TRACE_ZONE("KeyframeRing::recompute_back");
+        bool from_keyframe = false;
+        {
+            const std::lock_guard lock(m_mutex);
+            const Keyframe* keyframe = keyframe_before(target);
+            if (keyframe == nullptr || keyframe->edit_step.value_or(target) < target) {
+                return false;
+            }
+            // the kept states end at the last edit or exact step back, as the keyframes do
+            if (m_window_generation != m_generation) {
+                trim_window(0);
+                m_window_generation = m_generation;
+            }
+            trim_window(target + 1);
+            // states before the keyframe may lie behind an edit
+            from_keyframe = m_window.empty() || m_window.back().step < keyframe->step;
+            if (from_keyframe && !sim.load_keyframe(keyframe->data)) {
+                return false;
+            }
+            m_reversal_floor = from_keyframe ? keyframe->step : m_window.back().step;
+        }
+        if (!from_keyframe && !sim.load_keyframe(m_window.back().data)) {
+            return false;
+        }
+        const uint64_t base = sim.step();
+        if (from_keyframe) {
+            keep(sim);
+        }
+        if (base == target) {
+            return true;
+        }
+        // with every state kept, stepping back recomputes at most stride steps each time and each of them once
+        const uint64_t distance = target - base;
+        const size_t state_bytes = m_window.empty() ? 0 : m_window.back().data.size();
+        const uint64_t room = state_bytes == 0 || m_window_bytes >= c_window_budget
+            ? 0
+            : (c_window_budget - m_window_bytes) / state_bytes;
+        // a smaller budget spaces the states out further, and without room every step back recomputes
+        const uint64_t stride = room == 0
+            ? distance
+            : std::max(static_cast<uint64_t>(std::ceil(std::sqrt(static_cast<double>(distance)))),
+                       (2 * distance + room - 1) / room);
+        const uint64_t sparse = (distance - 1) / stride;
+        const uint64_t dense = std::min(stride - 1, room > sparse ? room - sparse : 0);
+        while (sim.step() < target) {
+            sim.update();
+            const uint64_t step = sim.step();
+            if (step < target && (target - step <= dense || (step - base) % stride == 0)) {
+                keep(sim);
+            }
+        }
+        return true;
+    }
+
+    // Adds the sim's state to the window if it fits the budget
+    template <typename Sim>
+    void keep(Sim& sim)
+    {
+        if (!m_window.empty() && m_window_bytes + m_window.back().data.size() > c_window_budget) {
+            return;
+        }
+        std::vector<char> data;
+        if (!m_spare.empty()) {
+            data = std::move(m_spare.back());
+            m_spare.pop_back();
+        }
+        if (!sim.save_keyframe(data) || m_window_bytes + data.size() > c_window_budget) {
+            m_spare.push_back(std::move(data));
+            return;
+        }
+        m_window_bytes += data.size();
+        m_window.push_back({ .step = sim.step(), .data = std::move(data), .edit_step = std::nullopt });
+    }
+
+    // Drops the kept states from step on, keeping their buffers for the next ones
+    void trim_window(const uint64_t step)
+    {
+        while (!m_window.empty() && m_window.back().step >= step) {
+            m_window_bytes -= m_window.back().data.size();
+            m_spare.push_back(std::move(m_window.back().data));
+            m_window.pop_back();
+        }
+    }
+
+    // Waits for the keyframes being compressed to be added
+    void wait_compressed()
+    {
+#ifndef PLATFORM_WEB
+        m_writer.wait_caught_up();
+#endif
+    }
+
+    // A keyframe was taken at step and will be added
+    void taken(const uint64_t step, const uint64_t generation)
+    {
+        const std::lock_guard lock(m_mutex);
+        if (generation == m_generation) {
+            m_taken_step = step;
+            m_keyframe_due = false;
+        }
+    }
+
+    // Adds the keyframe taken at step, unless the run was truncated since it was taken
+    void add(const uint64_t step, const uint64_t generation, std::vector<char> data)
+    {
+        const std::lock_guard lock(m_mutex);
+        if (generation != m_generation) {
+            return;
+        }
+        m_bytes += data.size();
+        m_keyframes.push_back({ .step = step, .data = std::move(data), .edit_step = std::nullopt });
+        // the newest keyframe stays even if it alone is over budget
+        while (m_bytes > c_memory_budget && m_keyframes.size() > 1) {
+            m_bytes -= m_keyframes.front().data.size();
+            m_keyframes.pop_front();
+        }
+    }
+
+    // The last keyframe at or before step, or nullptr; call with the mutex held
+    [[nodiscard]] const Keyframe* keyframe_before(const uint64_t step) const
+    {
+        const auto keyframe
+            = std::find_if(m_keyframes.rbegin(), m_keyframes.rend(), [&](const Keyframe& k) { return k.step <= step; });
+        return keyframe == m_keyframes.rend() ? nullptr : &*keyframe;
+    }
+
+    // Ends the recorded run at step, which the sim leaves differently than recorded; call with the mutex held
+    void truncate(const uint64_t step)
+    {
+        while (!m_keyframes.empty() && m_keyframes.back().step > step) {
+            m_bytes -= m_keyframes.back().data.size();
+            m_keyframes.pop_back();
+        }
+        if (!m_keyframes.empty()) {
+            std::optional<uint64_t>& edit_step = m_keyframes.back().edit_step;
+            edit_step = std::min(edit_step.value_or(step), step);
+        }
+        m_last_step = step;
+        m_taken_step = m_keyframes.empty() ? std::nullopt : std::optional(m_keyframes.back().step);
+        m_keyframe_due = true;
+        // keyframes still being compressed may be from after step
+        ++m_generation;
+    }
+
+    const uint64_t c_interval;
+    const size_t c_memory_budget;
+    const size_t c_window_budget;
+    mutable std::mutex m_mutex;
+    std::deque<Keyframe> m_keyframes;
+    size_t m_bytes;
+    uint64_t m_last_step;
+    // step of the newest keyframe taken, including one still being compressed
+    std::optional<uint64_t> m_taken_step;
+    // set after an edit, so the steps after it can be reached without waiting for the interval
+    bool m_keyframe_due;
+    // the sim may step backward exactly down to this step, the last one edited or sought
+    uint64_t m_reversal_floor;
+    // counts truncations, so keyframes taken before one are not added after it
+    uint64_t m_generation;
+    // states recomputed by step_backward(), by step, and the truncation they belong to; only the thread stepping the
+    // sim touches them
+    std::vector<Keyframe> m_window;
+    size_t m_window_bytes;
+    uint64_t m_window_generation;
+    std::vector<std::vector<char>> m_spare;
+#ifndef PLATFORM_WEB
+    BS::thread_pool m_pool;
+    BackgroundWriter<Pending> m_writer;
+#endif
+};
@@ -0,0 +1,329 @@
+#pragma once
+
+// Lossless compression of arrays of fixed-size elements, meant for doubles. Each chunk is optionally XORed with a
+// previous version of the same array, so unchanged bits become zero, then byte-shuffled so byte b of every element
+// lands in plane b, then LZ compressed. Sign and exponent planes of slowly varying or near-zero fields are long
+// runs of a few byte values, which the LZ stage collapses. Chunks are independent and run in parallel.
+//
+// Layout: Header, one ChunkEntry per chunk, then the chunks' LZ streams (or raw shuffled bytes where LZ did not
+// help). The LZ stream is a series of sequences in the style of LZ4: a token with the literal count in its high
+// nibble and the match length - 4 in its low nibble (15 meaning more length bytes follow), the literals, then a
+// two byte offset and the match. The last sequence has literals only.
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <BS_thread_pool.hpp>
+
+namespace lossless {
+
+struct Header {
+    static constexpr std::array<char, 4> sc_magic { 'L', 'S', 'L', '1' };
+
+    std::array<char, 4> magic;
+    uint32_t element_bytes;
+    uint64_t bytes;
+    uint32_t chunk_bytes;
+    uint32_t chunk_count;
+    // whether chunks were XORed with a previous version of the array, which decompress() then needs too
+    uint32_t delta;
+    uint32_t padding;
+};
+
+struct ChunkEntry {
+    uint64_t bytes;
+    // 1 if the shuffled bytes are stored as is because LZ did not make them smaller
+    uint32_t stored;
+    uint32_t padding;
+};
+
+// a multiple of every element size that makes sense, and small enough for 16 bit match offsets to reach far
+constexpr uint32_t sc_chunk_bytes = 1 << 18;
+
+namespace detail {
+
+    constexpr size_t sc_min_match = 4;
+    constexpr size_t sc_max_offset = 65535;
+    constexpr int sc_hash_bits = 14;
+
+    inline uint32_t read_32(const uint8_t* data)
+    {
+        uint32_t value = 0;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    inline uint32_t hash(const uint32_t value)
+    {
+        return value * 2654435761U >> (32 - sc_hash_bits);
+    }
+
+    inline void write_length(std::vector<uint8_t>& out, size_t length)
+    {
+        while (length >= 255) {
+            out.push_back(255);
+            length -= 255;
+        }
+        out.push_back(static_cast<uint8_t>(length));
+    }
+
+    inline void write_sequence(
+        std::vector<uint8_t>& out,
+        const uint8_t* literals,
+        const size_t literal_count,
+        const size_t offset,
+        const size_t match_length)
+    {
+        const size_t match_code = match_length == 0 ? 0 : match_length - sc_min_match;
+        out.push_back(static_cast<uint8_t>(std::min<size_t>(literal_count, 15) << 4 | std::min<size_t>(match_code, 15)));
+        if (literal_count >= 15) {
+            write_length(out, literal_count - 15);
+        }
+        out.insert(out.end(), literals, literals + literal_count);
+        if (match_length == 0) {
+            return;
+        }
+        out.push_back(static_cast<uint8_t>(offset));
+        out.push_back(static_cast<uint8_t>(offset >> 8));
+        if (match_code >= 15) {
+            write_length(out, match_code - 15);
+        }
+    }
+
+    inline void lz_compress(const uint8_t* data, const size_t bytes, std::vector<uint8_t>& out)
+    {
+        std::vector<uint32_t> table(size_t { 1 } << sc_hash_bits, 0);
+        size_t position = 0;
+        size_t anchor = 0;
+        while (position + sc_min_match <= bytes) {
+            const uint32_t value = read_32(data + position);
+            const uint32_t h = hash(value);
+            const size_t candidate = table[h];
+            table[h] = static_cast<uint32_t>(position);
+            if (candidate >= position || position - candidate > sc_max_offset || read_32(data + candidate) != value) {
+                // step faster through data that does not match
+                position += 1 + ((position - anchor) >> 6);
+                continue;
+            }
+            size_t length = sc_min_match;
+            while (position + length < bytes && data[candidate + length] == data[position + length]) {
+                ++length;
+            }
+            write_sequence(out, data + anchor, position - anchor, position - candidate, length);
+            position += length;
+            anchor = position;
+        }
+        write_sequence(out, data + anchor, bytes - anchor, 0, 0);
+    }
+
+    // Returns false if the stream is malformed or does not decode to exactly bytes
+    inline bool lz_decompress(const uint8_t* in, const size_t in_bytes, uint8_t* out, const size_t bytes)
+    {
+        const auto read_length = [&](size_t& in_position, size_t& length) {
+            uint8_t more = 255;
+            while (more == 255) {
+                if (in_position >= in_bytes) {
+                    return false;
+                }
+                more = in[in_position++];
+                length += more;
+            }
+            return true;
+        };
+        size_t in_position = 0;
+        size_t position = 0;
+        while (in_position < in_bytes) {
+            const uint8_t token = in[in_position++];
+            size_t literal_count = token >> 4;
+            if (literal_count == 15 && !read_length(in_position, literal_count)) {
+                return false;
+            }
+            if (literal_count > in_bytes - in_position || literal_count > bytes - position) {
+                return false;
+            }
+            std::memcpy(out + position, in + in_position, literal_count);
+            in_position += literal_count;
+            position += literal_count;
+            if (in_position == in_bytes) {
+                break;
+            }
+            if (in_bytes - in_position < 2) {
+                return false;
+            }
+            const size_t offset = in[in_position] | static_cast<size_t>(in[in_position + 1]) << 8;
+            in_position += 2;
+            size_t length = token & 15;
+            if (length == 15 && !read_length(in_position, length)) {
+                return false;
+            }
+            length += sc_min_match;
+            if (offset == 0 || offset > position || length > bytes - position) {
+                return false;
+            }
+            if (offset == 1) {
+                std::memset(out + position, out[position - 1], length);
+            }
+            else if (offset >= length) {
+                std::memcpy(out + position, out + position - offset, length);
+            }
+            else {
+                for (size_t i = 0; i < length; ++i) {
+                    out[position + i] = out[position + i - offset];
+                }
+            }
+            position += length;
+        }
+        return position == bytes;
+    }
+
+    // XOR with base if given, then gather byte b of every element into plane b
+    inline void shuffle(
+        const uint8_t* data, const uint8_t* base, const size_t bytes, const size_t element_bytes, uint8_t* out)
+    {
+        const size_t elements = bytes / element_bytes;
+        for (size_t e = 0; e < elements; ++e) {
+            for (size_t b = 0; b < element_bytes; ++b) {
+                const size_t i = e * element_bytes + b;
+                out[b * elements + e] = base == nullptr ? data[i] : static_cast<uint8_t>(data[i] ^ base[i]);
+            }
+        }
+    }
+
+    inline void unshuffle(
+        const uint8_t* planes, const uint8_t* base, const size_t bytes, const size_t element_bytes, uint8_t* out)
+    {
+        const size_t elements = bytes / element_bytes;
+        for (size_t e = 0; e < elements; ++e) {
+            for (size_t b = 0; b < element_bytes; ++b) {
+                const size_t i = e * element_bytes + b;
+                out[i] = base == nullptr ? planes[b * elements + e] : static_cast<uint8_t>(planes[b * elements + e] ^ base[i]);
+            }
+        }
+    }
+
+}
+
+// Compresses bytes of data made of element_bytes wide elements into out, replacing its contents. With a base of the
+// same size, only the bits that differ from it are coded and decompress() needs the same base.
+inline void compress(
+    const void* data,
+    const size_t bytes,
+    const size_t element_bytes,
+    const void* base,
+    std::vector<uint8_t>& out,
+    BS::thread_pool& pool)
+{
+    const auto* input = static_cast<const uint8_t*>(data);
+    const auto* base_input = static_cast<const uint8_t*>(base);
+    // bytes that are not whole elements are not shuffled
+    const size_t width = bytes % element_bytes == 0 ? element_bytes : 1;
+    // chunks hold whole elements
+    const size_t chunk_bytes = sc_chunk_bytes / width * width;
+    const auto chunk_count = static_cast<int>((bytes + chunk_bytes - 1) / chunk_bytes);
+    std::vector<std::vector<uint8_t>> chunks(chunk_count);
+    std::vector<uint8_t> stored(chunk_count);
+    pool.detach_blocks<int>(0, chunk_count, [&](const int start, const int end) {
+        std::vector<uint8_t> shuffled;
+        for (int chunk = start; chunk < end; ++chunk) {
+            const size_t offset = chunk * chunk_bytes;
+            const size_t size = std::min(chunk_bytes, bytes - offset);
+            shuffled.resize(size);
+            detail::shuffle(
+                input + offset,
+                base_input == nullptr ? nullptr : base_input + offset,
+                size,
+                width,
+                shuffled.data());
+            detail::lz_compress(shuffled.data(), size, chunks[chunk]);
+            if (chunks[chunk].size() >= size) {
+                chunks[chunk] = shuffled;
+                stored[chunk] = 1;
+            }
+        }
+    });
+    pool.wait();
+
+    const Header header { .magic = Header::sc_magic,
+                          .element_bytes = static_cast<uint32_t>(width),
+                          .bytes = bytes,
+                          .chunk_bytes = static_cast<uint32_t>(chunk_bytes),
+                          .chunk_count = static_cast<uint32_t>(chunk_count),
+                          .delta = base == nullptr ? 0U : 1U,
+                          .padding = 0 };
+    out.resize(sizeof(header) + chunk_count * sizeof(ChunkEntry));
+    std::memcpy(out.data(), &header, sizeof(header));
+    for (int chunk = 0; chunk < chunk_count; ++chunk) {
+        const ChunkEntry entry { .bytes = chunks[chunk].size(), .stored = stored[chunk], .padding = 0 };
+        std::memcpy(out.data() + sizeof(header) + chunk * sizeof(ChunkEntry), &entry, sizeof(entry));
+    }
+    for (const std::vector<uint8_t>& chunk : chunks) {
+        out.insert(out.end(), chunk.begin(), chunk.end());
+    }
+}
+
+// Decompresses what compress() wrote into the bytes at destination, which must be exactly the original size.
+// base must be what was passed to compress(). Returns false if data is malformed or does not fit.
+inline bool decompress(
+    const void* data, const size_t bytes, void* destination, const size_t destination_bytes, const void* base, BS::thread_pool& pool)
+{
+    const auto* input = static_cast<const uint8_t*>(data);
+    Header header {};
+    if (bytes < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, input, sizeof(header));
+    if (header.magic != Header::sc_magic || header.bytes != destination_bytes || header.element_bytes == 0
+        || header.chunk_bytes == 0 || header.chunk_bytes % header.element_bytes != 0
+        || header.chunk_count != (header.bytes + header.chunk_bytes - 1) / header.chunk_bytes
+        || (header.delta != 0) != (base != nullptr)
+        || bytes < sizeof(header) + header.chunk_count * sizeof(ChunkEntry)) {
+        return false;
+    }
+    std::vector<ChunkEntry> entries(header.chunk_count);
+    // an empty array has no entries, and memcpy must not get the null data() of an empty vector
+    if (!entries.empty()) {
+        std::memcpy(entries.data(), input + sizeof(header), entries.size() * sizeof(ChunkEntry));
+    }
+    std::vector<uint64_t> offsets(header.chunk_count + 1, sizeof(header) + header.chunk_count * sizeof(ChunkEntry));
+    for (uint32_t chunk = 0; chunk < header.chunk_count; ++chunk) {
+        // checked before adding, so a damaged size cannot wrap the offset around
+        if (entries[chunk].bytes > bytes - offsets[chunk]) {
+            return false;
+        }
+        offsets[chunk + 1] = offsets[chunk] + entries[chunk].bytes;
+    }
+
+    auto* output = static_cast<uint8_t*>(destination);
+    const auto* base_input = static_cast<const uint8_t*>(base);
+    std::vector<uint8_t> chunk_ok(header.chunk_count);
+    pool.detach_blocks<int>(0, static_cast<int>(header.chunk_count), [&](const int start, const int end) {
+        std::vector<uint8_t> shuffled;
+        for (int chunk = start; chunk < end; ++chunk) {
+            const size_t offset = chunk * static_cast<size_t>(header.chunk_bytes);
+            const size_t size = std::min<size_t>(header.chunk_bytes, header.bytes - offset);
+            const uint8_t* planes = input + offsets[chunk];
+            if (entries[chunk].stored != 0) {
+                if (entries[chunk].bytes != size) {
+                    continue;
+                }
+            }
+            else {
+                shuffled.resize(size);
+                if (!detail::lz_decompress(input + offsets[chunk], entries[chunk].bytes, shuffled.data(), size)) {
+                    continue;
+                }
+                planes = shuffled.data();
+            }
+            detail::unshuffle(
+                planes, base_input == nullptr ? nullptr : base_input + offset, size, header.element_bytes, output + offset);
+            chunk_ok[chunk] = 1;
+        }
+    });
+    pool.wait();
+    return std::ranges::all_of(chunk_ok, [](const uint8_t ok) { return ok != 0; });
+}
+
+}
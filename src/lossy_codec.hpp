@@ -0,0 +1,373 @@
+#pragma once
+
+// Error-bounded lossy compression of 2D fields in the style of SZ. Each value is predicted from its already
+// decoded neighbors (Lorenzo predictor: left + up - up-left), the prediction error is quantized to bins of twice
+// the error bound and the bin numbers are Rice coded. Every decoded value is within the error bound of the original;
+// values the quantizer cannot bound (too far from the prediction, NaN or infinite) are stored exactly.
+// Bands of rows are predicted independently so they compress and decompress in parallel.
+//
+// Layout: Header, one uint64_t byte count per band, then the bands' bit streams.
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <BS_thread_pool.hpp>
+
+namespace lossy {
+
+struct Header {
+    static constexpr std::array<char, 4> sc_magic { 'L', 'S', 'Y', '1' };
+
+    std::array<char, 4> magic;
+    int32_t width;
+    int32_t height;
+    // values per cell, adjacent in memory; each component is predicted from the same component of its neighbors
+    uint32_t components;
+    double error_bound;
+    uint32_t band_count;
+    uint32_t band_rows;
+};
+
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& bytes)
+        : m_bytes(bytes)
+        , m_accumulator(0)
+        , m_bits(0)
+    {
+    }
+
+    // Appends the low count bits of value, count <= 32
+    void write(const uint64_t value, const int count)
+    {
+        m_accumulator |= (value & ((uint64_t { 1 } << count) - 1)) << m_bits;
+        m_bits += count;
+        while (m_bits >= 8) {
+            m_bytes.push_back(static_cast<uint8_t>(m_accumulator));
+            m_accumulator >>= 8;
+            m_bits -= 8;
+        }
+    }
+
+    void write_64(const uint64_t value)
+    {
+        write(value & 0xffffffff, 32);
+        write(value >> 32, 32);
+    }
+
+    void flush()
+    {
+        if (m_bits > 0) {
+            m_bytes.push_back(static_cast<uint8_t>(m_accumulator));
+        }
+        m_accumulator = 0;
+        m_bits = 0;
+    }
+
+private:
+    std::vector<uint8_t>& m_bytes;
+    uint64_t m_accumulator;
+    int m_bits;
+};
+
+// Reads what BitWriter wrote; reading past the end yields zero bits and sets overrun()
+class BitReader {
+public:
+    BitReader(const uint8_t* data, const size_t bytes)
+        : m_data(data)
+        , m_bytes(bytes)
+        , m_position(0)
+        , m_accumulator(0)
+        , m_bits(0)
+        , m_overrun(false)
+    {
+    }
+
+    // count <= 32
+    uint64_t read(const int count)
+    {
+        while (m_bits < count) {
+            uint64_t byte = 0;
+            if (m_position < m_bytes) {
+                byte = m_data[m_position++];
+            }
+            else {
+                m_overrun = true;
+            }
+            m_accumulator |= byte << m_bits;
+            m_bits += 8;
+        }
+        const uint64_t value = m_accumulator & ((uint64_t { 1 } << count) - 1);
+        m_accumulator >>= count;
+        m_bits -= count;
+        return value;
+    }
+
+    uint64_t read_64()
+    {
+        const uint64_t low = read(32);
+        return low | read(32) << 32;
+    }
+
+    [[nodiscard]] bool overrun() const
+    {
+        return m_overrun;
+    }
+
+private:
+    const uint8_t* m_data;
+    size_t m_bytes;
+    size_t m_position;
+    uint64_t m_accumulator;
+    int m_bits;
+    bool m_overrun;
+};
+
+constexpr int sc_band_rows = 32;
+// Rice quotients at or above this are followed by the raw symbol instead
+constexpr uint64_t sc_max_quotient = 24;
+// symbol 0 marks a value stored exactly; bins are zigzag coded from 1
+constexpr uint64_t sc_exact_symbol = 0;
+constexpr double sc_max_bin = 1e15;
+
+namespace detail {
+
+    // Shared by the encoder and decoder so both round the same way. An explicit fused multiply-add rounds once on
+    // every target; a separate multiply and add could still be contracted under -ffp-contract=fast (GCC's default
+    // outside strict ISO mode) where FMA is available, and the decoder built elsewhere would then drift off the
+    // values the encoder checked against the bound.
+    inline double reconstruct(const double prediction, const double bin_width, const double bin)
+    {
+        return std::fma(bin_width, bin, prediction);
+    }
+
+    // decoded holds the band's values decoded so far, with the band's first row at index 0
+    inline double predict(
+        const double* decoded, const int x, const int y, const int c, const int width, const int components)
+    {
+        const auto at = [&](const int at_x, const int at_y) {
+            return decoded[(static_cast<size_t>(at_y) * width + at_x) * components + c];
+        };
+        if (x > 0 && y > 0) {
+            const double sum = at(x - 1, y) + at(x, y - 1);
+            return sum - at(x - 1, y - 1);
+        }
+        if (x > 0) {
+            return at(x - 1, y);
+        }
+        if (y > 0) {
+            return at(x, y - 1);
+        }
+        return 0.0;
+    }
+
+    inline void write_rice(BitWriter& writer, const uint64_t symbol, const int k)
+    {
+        const uint64_t quotient = symbol >> k;
+        if (quotient >= sc_max_quotient) {
+            writer.write((uint64_t { 1 } << sc_max_quotient) - 1, static_cast<int>(sc_max_quotient));
+            writer.write_64(symbol);
+            return;
+        }
+        // quotient ones and a terminating zero
+        writer.write((uint64_t { 1 } << quotient) - 1, static_cast<int>(quotient) + 1);
+        writer.write(symbol, k);
+    }
+
+    inline uint64_t read_rice(BitReader& reader, const int k)
+    {
+        uint64_t quotient = 0;
+        while (quotient < sc_max_quotient && reader.read(1) == 1) {
+            ++quotient;
+        }
+        if (quotient == sc_max_quotient) {
+            return reader.read_64();
+        }
+        return quotient << k | reader.read(k);
+    }
+
+    inline void compress_band(
+        const double* values,
+        const int width,
+        const int rows,
+        const int components,
+        const double error_bound,
+        std::vector<uint8_t>& out)
+    {
+        const size_t count = static_cast<size_t>(width) * rows * components;
+        const double bin_width = 2.0 * error_bound;
+        std::vector<double> decoded(count);
+        std::vector<uint64_t> symbols(count);
+        std::vector<double> exact;
+        uint64_t symbol_sum = 0;
+        for (int y = 0; y < rows; ++y) {
+            for (int x = 0; x < width; ++x) {
+                for (int c = 0; c < components; ++c) {
+                    const size_t i = (static_cast<size_t>(y) * width + x) * components + c;
+                    const double prediction = predict(decoded.data(), x, y, c, width, components);
+                    const double bin = std::round((values[i] - prediction) / bin_width);
+                    if (std::abs(bin) < sc_max_bin) {
+                        const double value = reconstruct(prediction, bin_width, bin);
+                        if (std::abs(value - values[i]) <= error_bound) {
+                            const auto signed_bin = static_cast<int64_t>(bin);
+                            const uint64_t zigzag = static_cast<uint64_t>(signed_bin) << 1 ^ (signed_bin < 0 ? ~0ULL : 0);
+                            symbols[i] = zigzag + 1;
+                            symbol_sum += std::min<uint64_t>(symbols[i], uint64_t { 1 } << 32);
+                            decoded[i] = value;
+                            continue;
+                        }
+                    }
+                    symbols[i] = sc_exact_symbol;
+                    exact.push_back(values[i]);
+                    decoded[i] = values[i];
+                }
+            }
+        }
+        // the Rice parameter that suits the mean symbol
+        const uint64_t mean = count == 0 ? 0 : symbol_sum / count;
+        const int k = mean == 0 ? 0 : std::min(static_cast<int>(std::bit_width(mean)) - 1, 32);
+
+        BitWriter writer(out);
+        writer.write(static_cast<uint64_t>(k), 6);
+        size_t next_exact = 0;
+        for (const uint64_t symbol : symbols) {
+            write_rice(writer, symbol, k);
+            if (symbol == sc_exact_symbol) {
+                writer.write_64(std::bit_cast<uint64_t>(exact[next_exact++]));
+            }
+        }
+        writer.flush();
+    }
+
+    inline bool decompress_band(
+        const uint8_t* data,
+        const size_t bytes,
+        double* values,
+        const int width,
+        const int rows,
+        const int components,
+        const double error_bound)
+    {
+        const double bin_width = 2.0 * error_bound;
+        BitReader reader(data, bytes);
+        const int k = static_cast<int>(reader.read(6));
+        if (k > 32) {
+            return false;
+        }
+        for (int y = 0; y < rows; ++y) {
+            for (int x = 0; x < width; ++x) {
+                for (int c = 0; c < components; ++c) {
+                    const size_t i = (static_cast<size_t>(y) * width + x) * components + c;
+                    const uint64_t symbol = read_rice(reader, k);
+                    if (symbol == sc_exact_symbol) {
+                        values[i] = std::bit_cast<double>(reader.read_64());
+                        continue;
+                    }
+                    const uint64_t zigzag = symbol - 1;
+                    const auto signed_bin = static_cast<int64_t>(zigzag >> 1 ^ (~(zigzag & 1) + 1));
+                    values[i] = reconstruct(
+                        predict(values, x, y, c, width, components), bin_width, static_cast<double>(signed_bin));
+                }
+            }
+        }
+        return !reader.overrun();
+    }
+
+}
+
+// Compresses width x height cells of components adjacent doubles each into out, replacing its contents.
+// An error bound of zero stores every value exactly.
+inline void compress(
+    const double* values,
+    const int width,
+    const int height,
+    const int components,
+    const double error_bound,
+    std::vector<uint8_t>& out,
+    BS::thread_pool& pool)
+{
+    const int band_count = (height + sc_band_rows - 1) / sc_band_rows;
+    const size_t band_values = static_cast<size_t>(width) * sc_band_rows * components;
+    std::vector<std::vector<uint8_t>> bands(band_count);
+    pool.detach_blocks<int>(0, band_count, [&](const int start, const int end) {
+        for (int band = start; band < end; ++band) {
+            const int rows = std::min(sc_band_rows, height - band * sc_band_rows);
+            detail::compress_band(values + band * band_values, width, rows, components, error_bound, bands[band]);
+        }
+    });
+    pool.wait();
+
+    const Header header { .magic = Header::sc_magic,
+                          .width = width,
+                          .height = height,
+                          .components = static_cast<uint32_t>(components),
+                          .error_bound = error_bound,
+                          .band_count = static_cast<uint32_t>(band_count),
+                          .band_rows = sc_band_rows };
+    out.resize(sizeof(header) + band_count * sizeof(uint64_t));
+    std::memcpy(out.data(), &header, sizeof(header));
+    for (int band = 0; band < band_count; ++band) {
+        const uint64_t bytes = bands[band].size();
+        std::memcpy(out.data() + sizeof(header) + band * sizeof(uint64_t), &bytes, sizeof(bytes));
+    }
+    for (const std::vector<uint8_t>& band : bands) {
+        out.insert(out.end(), band.begin(), band.end());
+    }
+}
+
+// Decompresses what compress() wrote into values, resizing it. Returns false if data is malformed.
+inline bool decompress(const uint8_t* data, const size_t bytes, std::vector<double>& values, BS::thread_pool& pool)
+{
+    Header header {};
+    if (bytes < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != Header::sc_magic || header.width < 0 || header.height < 0 || header.band_rows <= 0
+        || header.band_count != (static_cast<uint32_t>(header.height) + header.band_rows - 1) / header.band_rows
+        || bytes < sizeof(header) + header.band_count * sizeof(uint64_t)) {
+        return false;
+    }
+    std::vector<uint64_t> offsets(header.band_count + 1, sizeof(header) + header.band_count * sizeof(uint64_t));
+    for (uint32_t band = 0; band < header.band_count; ++band) {
+        uint64_t band_bytes = 0;
+        std::memcpy(&band_bytes, data + sizeof(header) + band * sizeof(uint64_t), sizeof(band_bytes));
+        // checked before adding, so a damaged size cannot wrap the offset around
+        if (band_bytes > bytes - offsets[band]) {
+            return false;
+        }
+        offsets[band + 1] = offsets[band] + band_bytes;
+    }
+
+    // every value takes at least one bit of Rice code, so a damaged header cannot ask for more values than that
+    const uint64_t cells = static_cast<uint64_t>(header.width) * static_cast<uint64_t>(header.height);
+    if (header.components != 0 && cells > bytes * 8 / header.components) {
+        return false;
+    }
+    const int width = header.width;
+    const int components = static_cast<int>(header.components);
+    const auto band_rows = static_cast<int>(header.band_rows);
+    values.resize(cells * header.components);
+    std::vector<uint8_t> band_ok(header.band_count);
+    pool.detach_blocks<int>(0, static_cast<int>(header.band_count), [&](const int start, const int end) {
+        for (int band = start; band < end; ++band) {
+            band_ok[band] = detail::decompress_band(
+                data + offsets[band],
+                offsets[band + 1] - offsets[band],
+                values.data() + static_cast<size_t>(band) * band_rows * width * components,
+                width,
+                std::min(band_rows, header.height - band * band_rows),
+                components,
+                header.error_bound);
+        }
+    });
+    pool.wait();
+    return std::ranges::all_of(band_ok, [](const uint8_t ok) { return ok != 0; });
+}
+
+}
@@ -1,4 +1,8 @@
+#include <chrono>
+#include <cstring>
+#include <future>
 #include <optional>
+#include <vector>
 
 #ifdef PLATFORM_WEB
 #include <emscripten/emscripten.h>
@@ -8,10 +12,17 @@
 #define RAYGUI_IMPLEMENTATION
 #include <raygui.h>
 
+#include "frame_governor.hpp"
+#include "frame_recorder.hpp"
+#include "input_log.hpp"
+#include "keyframe_ring.hpp"
+#include "perf_hud.hpp"
 #include "res/roboto-regular.h"
 #include "schrodinger_renderer.hpp"
 #include "schrodinger_sim.hpp"
+#include "trace.hpp"
 #include "ui.hpp"
+#include "viewport.hpp"
 #include "wave_sim.hpp"
 #include "wave_sim_renderer.hpp"
 
@@ -19,6 +30,16 @@ namespace rl = raylib;
 
 constexpr int sim_size = 1024;
 constexpr int base_font_size = 16;
+constexpr int target_fps = 60;
+#ifndef PLATFORM_WEB
+// a compressed keyframe of the 1024 x 1024 field takes a few MB, so this covers several thousand steps
+constexpr auto keyframe_props = KeyframeRing::Properties { .interval = 128, .memory_budget = size_t { 512 } << 20 };
+#else
+// web keyframes are not compressed, so each takes 17 MB, as does each state kept while rewinding
+constexpr auto keyframe_props = KeyframeRing::Properties {
+    .interval = 32, .memory_budget = size_t { 48 } << 20, .window_budget = size_t { 96 } << 20
+};
+#endif
 
 static rl::Rectangle sim_screen_rect(const int toolbar_height)
 {
@@ -29,11 +50,10 @@ static rl::Rectangle sim_screen_rect(const int toolbar_height)
              static_cast<float>(size) };
 }
 
-static std::optional<Vector2i> mouse_to_sim(const rl::Vector2 mouse_pos, const int toolbar_height)
+static std::optional<Vector2i> mouse_to_sim(
+    const rl::Vector2 mouse_pos, const SimViewport& viewport, const int toolbar_height)
 {
-    const rl::Vector2 sim_pos_f = (mouse_pos - sim_screen_rect(toolbar_height).GetPosition()) * sim_size
-        / sim_screen_rect(toolbar_height).GetWidth();
-    return Vector2i { static_cast<int>(sim_pos_f.x), static_cast<int>(sim_pos_f.y) };
+    return viewport.screen_to_sim(mouse_pos, sim_screen_rect(toolbar_height));
 }
 
 static void resize_font(rl::Font& font, const int size)
@@ -44,6 +64,24 @@ static void resize_font(rl::Font& font, const int size)
     GuiSetStyle(DEFAULT, TEXT_SIZE, size);
 }
 
+// F9 starts a trace capture and stops it again, writing it as Chrome trace JSON
+static void handle_trace_inputs()
+{
+    if (!IsKeyPressed(KEY_F9)) {
+        return;
+    }
+    if (!trace::capturing()) {
+        trace::start_capture();
+        TraceLog(LOG_INFO, "TRACE: Capture started");
+    }
+    else if (trace::stop_capture("wave_simulation_trace.json")) {
+        TraceLog(LOG_INFO, "TRACE: Capture written to wave_simulation_trace.json");
+    }
+    else {
+        TraceLog(LOG_WARNING, "TRACE: Failed to write wave_simulation_trace.json");
+    }
+}
+
 static void handle_font_scale_inputs(rl::Font& font)
 {
     std::optional<int> new_size;
@@ -60,43 +98,37 @@ static void handle_font_scale_inputs(rl::Font& font)
 
 enum class Mode { none, interact, walls };
 
-static void handle_sim_inputs(const Mode mode, WaveSim& wave_sim, const int toolbar_height)
+// Returns the edits the mouse makes to the sim this frame, in the order to apply them
+static std::vector<InputEvent> handle_sim_inputs(
+    const Mode mode, const WaveSim& wave_sim, const SimViewport& viewport, const int toolbar_height)
 {
+    std::vector<InputEvent> events;
     const rl::Vector2 mouse_pos = GetMousePosition();
-    if (const std::optional<Vector2i> sim_pos = mouse_to_sim(mouse_pos, toolbar_height);
+    if (const std::optional<Vector2i> sim_pos = mouse_to_sim(mouse_pos, viewport, toolbar_height);
         sim_pos.has_value() && wave_sim.in_bounds(sim_pos.value())) {
+        const auto event = [&](const InputAction action, const int radius, const double amount) {
+            return InputEvent { .step = wave_sim.step(),
+                                .action = action,
+                                .x = sim_pos->x,
+                                .y = sim_pos->y,
+                                .radius = radius,
+                                .amount = amount };
+        };
         if (mode == Mode::walls) {
             if (IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
-                constexpr int radius = 10;
-                for (int x = -radius; x < radius; ++x) {
-                    for (int y = -radius; y < radius; ++y) {
-                        if (const Vector2i pos { sim_pos->x + x, sim_pos->y + y };
-                            wave_sim.in_bounds(pos) && std::sqrt(x * x + y * y) <= radius) {
-                            wave_sim.set_at(pos, 0.0);
-                            wave_sim.set_fixed_at(pos, true);
-                        }
-                    }
-                }
+                events.push_back(event(InputAction::paint_walls, 10, 0.0));
             }
             if (IsMouseButtonDown(MOUSE_BUTTON_RIGHT)) {
-                constexpr int radius = 20;
-                for (int x = -radius; x < radius; ++x) {
-                    for (int y = -radius; y < radius; ++y) {
-                        if (const Vector2i pos { sim_pos->x + x, sim_pos->y + y };
-                            wave_sim.in_bounds(pos) && std::sqrt(x * x + y * y) <= radius && wave_sim.fixed_at(pos)) {
-                            wave_sim.set_at(pos, 0.0);
-                            wave_sim.set_fixed_at(pos, false);
-                        }
-                    }
-                }
+                events.push_back(event(InputAction::erase_walls, 20, 0.0));
             }
         }
         else if (mode == Mode::interact) {
             if (IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
-                wave_sim.add_at(sim_pos.value(), 10.0);
+                events.push_back(event(InputAction::add, 0, 10.0));
             }
         }
     }
+    return events;
 }
 
 struct State {
@@ -104,22 +136,138 @@ struct State {
     float scale;
     WaveSim wave_sim;
     WaveSimRenderer sim_renderer;
+    SimViewport viewport;
     Mode mode;
     LabelledDropdown mode_dropdown;
     LabelledDropdown theme_dropdown;
+    LabelledDropdown filter_dropdown;
     WaveSimRenderer::Theme renderer_theme;
     int show_fps;
+    bool clear_requested;
+    FrameGovernor governor;
+    PerfHud perf_hud;
+    KeyframeRing keyframes;
+#ifndef PLATFORM_WEB
+    std::optional<FrameRecorder> recorder;
+    std::optional<InputLogWriter> input_log;
+    // set while the timeline scrubber is held, to the step the sim was moved to
+    std::optional<uint64_t> scrub_step;
+#endif
 };
 
+#ifndef PLATFORM_WEB
+// F10 starts recording every fourth step to a frame file, compressed to within 1e-4, and stops it again
+static void handle_record_inputs(State* s)
+{
+    if (!IsKeyPressed(KEY_F10)) {
+        return;
+    }
+    if (!s->recorder.has_value()) {
+        s->recorder.emplace(
+            "wave_simulation_frames.bin",
+            FrameRecorder::Properties { .size = s->wave_sim.size(),
+                                        .interval = 4,
+                                        .error_bound = 1.0e-4,
+                                        .backpressure = FrameRecorder::Backpressure::decimate });
+        TraceLog(LOG_INFO, "RECORD: Recording started");
+        return;
+    }
+    const uint64_t dropped = s->recorder->frames_dropped();
+    if (s->recorder->finish()) {
+        TraceLog(
+            LOG_INFO,
+            "RECORD: %llu frames written to wave_simulation_frames.bin, %llu dropped",
+            static_cast<unsigned long long>(s->recorder->frames_written()),
+            static_cast<unsigned long long>(dropped));
+    }
+    else {
+        TraceLog(LOG_WARNING, "RECORD: Failed to write wave_simulation_frames.bin");
+    }
+    s->recorder.reset();
+}
+
+// F8 starts logging the edits to the sim from its present state, for the benchmark to replay, and stops it again.
+// The state is saved next to the log.
+static void handle_input_log_inputs(State* s)
+{
+    if (!IsKeyPressed(KEY_F8)) {
+        return;
+    }
+    constexpr const char* path = "wave_simulation_inputs.bin";
+    if (!s->input_log.has_value()) {
+        if (!s->wave_sim.save_checkpoint(InputLog::checkpoint_path(path), CheckpointCodec::lossless)) {
+            TraceLog(LOG_WARNING, "INPUT: Failed to write %s", InputLog::checkpoint_path(path).c_str());
+            return;
+        }
+        s->input_log.emplace(path, s->wave_sim.step());
+        TraceLog(LOG_INFO, "INPUT: Logging started");
+        return;
+    }
+    if (s->input_log->finish(s->wave_sim.step())) {
+        TraceLog(
+            LOG_INFO,
+            "INPUT: %llu events written to %s",
+            static_cast<unsigned long long>(s->input_log->events_written()),
+            path);
+    }
+    else {
+        TraceLog(LOG_WARNING, "INPUT: Failed to write %s", path);
+    }
+    s->input_log.reset();
+}
+#endif
+
+// Hands the present state to the keyframe ring and to the recorder if one is running; call after every step
+static void record_frame(State* s)
+{
+    s->keyframes.record(s->wave_sim);
+#ifndef PLATFORM_WEB
+    if (!s->recorder.has_value()) {
+        return;
+    }
+    s->recorder->record(s->wave_sim.step(), [s](double* values) {
+        const int size = s->wave_sim.size();
+        for (int y = 0; y < size; ++y) {
+            std::memcpy(values + static_cast<size_t>(y) * size, s->wave_sim.row_data(y), size * sizeof(double));
+        }
+    });
+#endif
+}
+
+// Applies an edit to the sim and reports it to the keyframe ring and the input log
+static void apply_edit(State* s, const InputEvent& event)
+{
+    if (!apply_input(s->wave_sim, event)) {
+        return;
+    }
+    s->keyframes.mark_edit(s->wave_sim.step());
+#ifndef PLATFORM_WEB
+    if (s->input_log.has_value()) {
+        s->input_log->write(event);
+    }
+#endif
+}
+
 void loop(void* state)
 {
+    TRACE_ZONE("frame");
     auto* s = static_cast<State*>(state);
+    using Phase = FrameGovernor::Phase;
 
+    const auto input_start = std::chrono::steady_clock::now();
     const int toolbar_height = static_cast<int>(std::round(100.0f * s->scale));
     handle_font_scale_inputs(s->font);
+    handle_trace_inputs();
+#ifndef PLATFORM_WEB
+    handle_record_inputs(s);
+    handle_input_log_inputs(s);
+#endif
 
-    if (IsKeyPressed(KEY_C)) {
-        s->wave_sim.clear();
+    if (IsKeyPressed(KEY_C) || s->clear_requested) {
+        apply_edit(
+            s,
+            { .step = s->wave_sim.step(), .action = InputAction::clear, .x = 0, .y = 0, .radius = 0, .amount = 0.0 });
+        s->clear_requested = false;
     }
 
     if (IsKeyPressed(KEY_N)) {
@@ -135,21 +283,126 @@ void loop(void* state)
         s->mode_dropdown.set_active(static_cast<int>(s->mode));
     }
 
-    handle_sim_inputs(s->mode, s->wave_sim, toolbar_height);
-    s->wave_sim.update();
-    s->sim_renderer.update(s->wave_sim, s->renderer_theme);
+    s->viewport.handle_inputs(sim_screen_rect(toolbar_height));
+    for (const InputEvent& event : handle_sim_inputs(s->mode, s->wave_sim, s->viewport, toolbar_height)) {
+        apply_edit(s, event);
+    }
+    s->governor.record(Phase::input, FrameGovernor::seconds_since(input_start));
 
+#ifndef PLATFORM_WEB
+    // the sim holds at the step the scrubber points to until it is released
+    const bool scrubbing = s->scrub_step.has_value();
+    if (scrubbing) {
+        if (*s->scrub_step != s->wave_sim.step()) {
+            const auto timer = s->governor.time(Phase::sim);
+            s->scrub_step = s->keyframes.seek(s->wave_sim, *s->scrub_step);
+        }
+        if (!IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
+            s->scrub_step.reset();
+        }
+    }
+#else
+    constexpr bool scrubbing = false;
+#endif
+
+    // nothing is shown while minimized so only the sim keeps running
+    const bool render = !IsWindowMinimized() && !IsWindowHidden();
+    const int render_resolution = static_cast<int>(
+        sim_screen_rect(toolbar_height).width * s->scale * s->governor.render_scale());
+    const int sim_steps = s->governor.sim_steps();
+    // holding backspace runs the sim backwards, as far as KeyframeRing::step_backward() can go, except while logging
+    // inputs since a replay only runs forwards
+#ifndef PLATFORM_WEB
+    const bool rewind = IsKeyDown(KEY_BACKSPACE) && !s->input_log.has_value();
+#else
+    const bool rewind = IsKeyDown(KEY_BACKSPACE);
+#endif
+    const bool advancing = !rewind && !scrubbing;
+    // for the HUD, which should not count steps that did not happen or were taken back as throughput
+    int steps_forward = 0;
+    int steps_back = 0;
+    if (!scrubbing) {
+        // batched steps beyond the last one run before rendering starts; rewinding takes every step here
+        const auto timer = s->governor.time(Phase::sim);
+        for (int i = rewind ? 0 : 1; i < sim_steps; ++i) {
+            if (rewind) {
+                steps_back += s->keyframes.step_backward(s->wave_sim) ? 1 : 0;
+                continue;
+            }
+            s->wave_sim.update();
+            record_frame(s);
+            ++steps_forward;
+        }
+    }
+#ifndef PLATFORM_WEB
+    // The present state is colorized, uploaded and drawn while the next state is computed on other threads,
+    // so the frame shows the state from before this step. The sim must not be edited until advance().
+    // Colorizing is not fused into compute_next() here, as the web build does, because the sweep would write the
+    // image being drawn; overlapping hides most of the separate colorize pass behind the step instead.
+    if (render) {
+        s->sim_renderer.prepare(s->wave_sim, s->renderer_theme, render_resolution, s->viewport.visible());
+    }
+    std::future<void> next_state;
+    if (advancing) {
+        next_state = std::async(std::launch::async, [s] {
+            const auto timer = s->governor.time(Phase::sim_overlapped);
+            s->wave_sim.compute_next();
+        });
+    }
+    if (render) {
+        {
+            const auto timer = s->governor.time(Phase::colorize);
+            s->sim_renderer.draw(s->wave_sim);
+        }
+        const auto timer = s->governor.time(Phase::upload);
+        s->sim_renderer.upload();
+    }
+#else
+    if (advancing) {
+        const auto timer = s->governor.time(Phase::sim);
+        s->wave_sim.update(
+            render ? s->sim_renderer.fused_target(s->renderer_theme, render_resolution, s->viewport.visible())
+                   : std::nullopt);
+        record_frame(s);
+        ++steps_forward;
+    }
+    if (render) {
+        const auto timer = s->governor.time(Phase::colorize);
+        s->sim_renderer.update(s->wave_sim, s->renderer_theme, render_resolution, s->viewport.visible());
+    }
+#endif
+
+    const auto draw_start = std::chrono::steady_clock::now();
     BeginDrawing();
     ClearBackground(LIGHTGRAY);
-    DrawTexturePro(
-        s->sim_renderer.texture(),
-        { 0.0f, 0.0f, sim_size, sim_size },
-        sim_screen_rect(toolbar_height),
-        { 0.0f, 0.0f },
-        0.0f,
-        WHITE);
+    if (render) {
+        DrawTexturePro(
+            s->sim_renderer.texture(),
+            { 0.0f,
+              0.0f,
+              static_cast<float>(s->sim_renderer.texture().width),
+              static_cast<float>(s->sim_renderer.texture().height) },
+            sim_screen_rect(toolbar_height),
+            { 0.0f, 0.0f },
+            0.0f,
+            WHITE);
+        DrawTexturePro(
+            s->sim_renderer.wall_texture(),
+            { 0.0f,
+              0.0f,
+              static_cast<float>(s->sim_renderer.wall_texture().width),
+              static_cast<float>(s->sim_renderer.wall_texture().height) },
+            sim_screen_rect(toolbar_height),
+            { 0.0f, 0.0f },
+            0.0f,
+            WHITE);
+    }
     if (s->show_fps) {
-        DrawFPS(10, toolbar_height + 10);
+        s->perf_hud.draw(
+            s->font,
+            { 10.0f, static_cast<float>(toolbar_height) + 10.0f },
+            std::round(s->scale * static_cast<float>(base_font_size)),
+            s->governor.target_frame_seconds());
     }
 
 #ifndef PLATFORM_WEB
@@ -164,10 +417,25 @@ void loop(void* state)
 
         float offset_x = ui_padding;
         if (GuiButton({ ui_padding, ui_padding, 70.0f * s->scale, ui_height }, "Clear [C]")) {
-            s->wave_sim.clear();
+            s->clear_requested = true;
         }
         offset_x += 70.0f * s->scale + ui_padding;
         GuiToggleSlider({ offset_x, ui_padding, 60.0f * s->scale, ui_height }, "FPS;FPS", &s->show_fps);
+#ifndef PLATFORM_WEB
+        offset_x += 60.0f * s->scale + ui_padding;
+        // scrubbing is off while logging inputs, like rewinding
+        if (const std::optional<uint64_t> first = s->keyframes.first_step();
+            first.has_value() && !s->input_log.has_value()) {
+            if (const std::optional<uint64_t> step = timeline_scrubber(
+                    { offset_x, ui_padding, 250.0f * s->scale, ui_height },
+                    *first,
+                    s->keyframes.last_step(),
+                    s->wave_sim.step());
+                step.has_value()) {
+                s->scrub_step = step;
+            }
+        }
+#endif
 
         offset_x = ui_padding;
         s->theme_dropdown.draw_and_update(
@@ -177,15 +445,41 @@ void loop(void* state)
         s->mode_dropdown.draw_and_update(
             { offset_x, ui_height + ui_padding * 1.5f, 90.0f * s->scale, ui_height * 2.0f });
         s->mode = static_cast<Mode>(s->mode_dropdown.active());
+        offset_x += 90.0f * s->scale + ui_padding;
+        s->filter_dropdown.draw_and_update(
+            { offset_x, ui_height + ui_padding * 1.5f, 90.0f * s->scale, ui_height * 2.0f });
+        s->sim_renderer.set_filter(static_cast<WaveSimRenderer::Filter>(s->filter_dropdown.active()));
     }
 
+    s->governor.record(Phase::draw, FrameGovernor::seconds_since(draw_start));
     EndDrawing();
+
+#ifndef PLATFORM_WEB
+    if (next_state.valid()) {
+        next_state.wait();
+        s->wave_sim.advance();
+        record_frame(s);
+        ++steps_forward;
+    }
+#endif
+    s->governor.end_frame();
+    // rewinding and scrubbing recompute steps from keyframes, whose counts would be charged to cells never counted
+    const perf::Counts counts = s->wave_sim.take_perf_counts();
+    s->perf_hud.push(
+        s->governor,
+        steps_forward,
+        steps_back,
+        s->wave_sim.size(),
+        WaveSim::bytes_per_cell_update(),
+        advancing ? counts : perf::Counts {});
 }
 
 int main()
 {
-    SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_MSAA_4X_HINT);
+    SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_MSAA_4X_HINT | FLAG_VSYNC_HINT);
     rl::Window window { 600, 700, "Wave Simulation" };
+    // also throttles frames when vsync is unavailable or the window is minimized
+    SetTargetFPS(target_fps);
     window.SetMinSize(600, 700);
     const int font_size = static_cast<int>(std::round(static_cast<float>(base_font_size) * GetWindowScaleDPI().x));
     rl::Font font = LoadFontFromMemory(
@@ -206,20 +500,34 @@ int main()
     auto mode = Mode::interact;
 
     LabelledDropdown theme_dropdown("Theme");
-    theme_dropdown.set_items({ "Grayscale", "Grayscale ABS" });
+    theme_dropdown.set_items({ "Grayscale", "Grayscale ABS", "Diverging", "Viridis ABS" });
     LabelledDropdown mode_dropdown("Mode");
     mode_dropdown.set_items({ "None [N]", "Interact [I]", "Walls [W]" });
     mode_dropdown.set_active(static_cast<int>(mode));
+    LabelledDropdown filter_dropdown("Filter");
+    filter_dropdown.set_items({ "Box", "Max ABS" });
 
     State state { .font = std::move(font),
                   .scale = 1.0f,
                   .wave_sim = WaveSim(sim_props),
                   .sim_renderer = WaveSimRenderer(sim_props.size),
+                  .viewport = SimViewport(sim_props.size),
                   .mode = mode,
                   .mode_dropdown = std::move(mode_dropdown),
                   .theme_dropdown = std::move(theme_dropdown),
+                  .filter_dropdown = std::move(filter_dropdown),
                   .renderer_theme = WaveSimRenderer::Theme::grayscale,
-                  .show_fps = 0 };
+                  .show_fps = 0,
+                  .clear_requested = false,
+                  .governor = FrameGovernor(target_fps),
+                  .perf_hud = PerfHud(),
+                  .keyframes = KeyframeRing(keyframe_props),
+#ifndef PLATFORM_WEB
+                  .recorder = std::nullopt,
+                  .input_log = std::nullopt,
+                  .scrub_step = std::nullopt,
+#endif
+    };
 
 #ifdef PLATFORM_WEB
     emscripten_set_main_loop_arg(loop, &state, 0, 1);
@@ -0,0 +1,334 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <numbers>
+#include <string>
+#include <vector>
+
+#include "schrodinger_sim.hpp"
+#include "wave_sim.hpp"
+
+// Runs scenarios with known analytic solutions through each engine variant and reports the error at the end
+// against the wall-clock time it took, so the cheapest configuration that meets a tolerance can be picked.
+
+struct ErrorNorms {
+    // ||sim - exact||_2 / ||exact||_2
+    double relative_l2;
+    // max |sim - exact| / max |exact|
+    double relative_max;
+};
+
+struct Result {
+    std::string variant;
+    double seconds;
+    ErrorNorms error;
+};
+
+class ErrorAccumulator {
+public:
+    void add(const double sim, const double exact)
+    {
+        m_diff_sq += (sim - exact) * (sim - exact);
+        m_exact_sq += exact * exact;
+        m_diff_max = std::max(m_diff_max, std::abs(sim - exact));
+        m_exact_max = std::max(m_exact_max, std::abs(exact));
+    }
+
+    [[nodiscard]] ErrorNorms norms() const
+    {
+        return { .relative_l2 = std::sqrt(m_diff_sq / m_exact_sq), .relative_max = m_diff_max / m_exact_max };
+    }
+
+private:
+    double m_diff_sq = 0.0;
+    double m_exact_sq = 0.0;
+    double m_diff_max = 0.0;
+    double m_exact_max = 0.0;
+};
+
+static double seconds_of(const std::function<void()>& work)
+{
+    const auto start = std::chrono::steady_clock::now();
+    work();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void print_results(const std::string& scenario, std::vector<Result> results, const double tolerance)
+{
+    std::printf("\n%s\n", scenario.c_str());
+    std::printf("%-40s %10s %12s %12s\n", "variant", "time (s)", "rel L2", "rel max");
+    for (const Result& result : results) {
+        std::printf(
+            "%-40s %10.3f %12.3e %12.3e\n",
+            result.variant.c_str(),
+            result.seconds,
+            result.error.relative_l2,
+            result.error.relative_max);
+    }
+    std::erase_if(results, [&](const Result& result) { return !(result.error.relative_l2 <= tolerance); });
+    if (results.empty()) {
+        std::printf("no variant is within rel L2 %.1e\n", tolerance);
+        return;
+    }
+    const Result& cheapest = *std::ranges::min_element(results, {}, &Result::seconds);
+    std::printf("cheapest within rel L2 %.1e: %s\n", tolerance, cheapest.variant.c_str());
+}
+
+// Boundary damping and per-step loss are disabled so the sim solves the plain wave equation u_tt = c^2 lap u.
+// The edges then act as u = 0 walls one cell outside the grid.
+static WaveSim make_wave_sim(const int size, const double timestep)
+{
+    return WaveSim({ .size = size,
+                     .wave_speed = 0.5,
+                     .grid_spacing = 1.0,
+                     .timestep = timestep,
+                     .loss = 1.0,
+                     .damping_strength = 0.0,
+                     .damping_width = 0.0 });
+}
+
+// Mode (m, n) of the square with walls at -1 and size: sin(kx (x + 1)) sin(ky (y + 1)) cos(omega t)
+static Result wave_standing_mode(const int size, const double timestep, const double end_time)
+{
+    constexpr int m = 3;
+    constexpr int n = 2;
+    constexpr double wave_speed = 0.5;
+    const double length = size + 1.0;
+    const double kx = std::numbers::pi * m / length;
+    const double ky = std::numbers::pi * n / length;
+    const double omega = wave_speed * std::sqrt(kx * kx + ky * ky);
+    const auto exact = [&](const int x, const int y, const double t) {
+        return std::sin(kx * (x + 1)) * std::sin(ky * (y + 1)) * std::cos(omega * t);
+    };
+
+    WaveSim sim = make_wave_sim(size, timestep);
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            sim.set_at({ x, y }, exact(x, y, 0.0));
+            sim.set_past_at({ x, y }, exact(x, y, -timestep));
+        }
+    }
+    const int steps = static_cast<int>(std::round(end_time / timestep));
+    const double seconds = seconds_of([&] {
+        for (int i = 0; i < steps; ++i) {
+            sim.update();
+        }
+    });
+    ErrorAccumulator error;
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            error.add(sim.value_at({ x, y }), exact(x, y, steps * timestep));
+        }
+    }
+    char name[64];
+    std::snprintf(name, sizeof(name), "wave dt=%.3g (%d steps)", timestep, steps);
+    return { .variant = name, .seconds = seconds, .error = error.norms() };
+}
+
+// Bessel function J0 from the rational and asymptotic approximations in Abramowitz & Stegun 9.4.1 and 9.4.3
+// (absolute error below 1e-7). std::cyl_bessel_j is not available in every standard library the apps build with.
+static double bessel_j0(const double x)
+{
+    const double ax = std::abs(x);
+    if (ax <= 3.0) {
+        const double y = ax * ax / 9.0;
+        return 1.0
+            + y
+            * (-2.2499997
+               + y * (1.2656208 + y * (-0.3163866 + y * (0.0444479 + y * (-0.0039444 + y * 0.0002100)))));
+    }
+    const double y = 3.0 / ax;
+    const double f0 = 0.79788456
+        + y
+            * (-0.00000077
+               + y * (-0.00552740 + y * (-0.00009512 + y * (0.00137237 + y * (-0.00072805 + y * 0.00014476)))));
+    const double theta0 = ax - 0.78539816
+        + y
+            * (-0.04166397
+               + y * (-0.00003954 + y * (0.00262573 + y * (-0.00054125 + y * (-0.00029333 + y * 0.00013558)))));
+    return f0 * std::cos(theta0) / std::sqrt(ax);
+}
+
+// Gaussian pulse u0 = exp(-r^2 / (2 sigma^2)) released from rest. In 2D the solution is the Hankel transform
+// u(r, t) = sigma^2 int_0^inf k exp(-k^2 sigma^2 / 2) cos(c k t) J0(k r) dk, integrated here with Simpson's rule.
+// The run ends before the front reaches the walls.
+static double radial_pulse(const double r, const double t, const double sigma, const double wave_speed)
+{
+    constexpr int intervals = 800;
+    const double k_max = 9.0 / sigma;
+    const double h = k_max / intervals;
+    double sum = 0.0;
+    for (int i = 0; i <= intervals; ++i) {
+        const double k = i * h;
+        const double weight = i == 0 || i == intervals ? 1.0 : i % 2 == 1 ? 4.0 : 2.0;
+        sum += weight * k * std::exp(-k * k * sigma * sigma / 2.0) * std::cos(wave_speed * k * t)
+            * bessel_j0(k * r);
+    }
+    return sigma * sigma * sum * h / 3.0;
+}
+
+static Result wave_radial_pulse(const int size, const double timestep, const double end_time)
+{
+    constexpr double sigma = 4.0;
+    constexpr double wave_speed = 0.5;
+    const double center = (size - 1) / 2.0;
+    const auto radius = [&](const int x, const int y) { return std::hypot(x - center, y - center); };
+
+    WaveSim sim = make_wave_sim(size, timestep);
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            const double r = radius(x, y);
+            const double u0 = std::exp(-r * r / (2.0 * sigma * sigma));
+            // from rest: u(-dt) = u0 + dt^2 / 2 c^2 lap u0 + O(dt^4)
+            const double laplacian = (r * r / std::pow(sigma, 4.0) - 2.0 / (sigma * sigma)) * u0;
+            sim.set_at({ x, y }, u0);
+            sim.set_past_at({ x, y }, u0 + timestep * timestep / 2.0 * wave_speed * wave_speed * laplacian);
+        }
+    }
+    const int steps = static_cast<int>(std::round(end_time / timestep));
+    const double seconds = seconds_of([&] {
+        for (int i = 0; i < steps; ++i) {
+            sim.update();
+        }
+    });
+
+    // the exact solution only depends on r, so tabulate it and interpolate
+    constexpr double table_step = 0.05;
+    const double t = steps * timestep;
+    std::vector<double> table(static_cast<size_t>(radius(0, 0) / table_step) + 2);
+    for (size_t i = 0; i < table.size(); ++i) {
+        table[i] = radial_pulse(static_cast<double>(i) * table_step, t, sigma, wave_speed);
+    }
+    ErrorAccumulator error;
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            const double position = radius(x, y) / table_step;
+            const auto i = static_cast<size_t>(position);
+            const double frac = position - static_cast<double>(i);
+            error.add(sim.value_at({ x, y }), table[i] * (1.0 - frac) + table[i + 1] * frac);
+        }
+    }
+    char name[64];
+    std::snprintf(name, sizeof(name), "wave dt=%.3g (%d steps)", timestep, steps);
+    return { .variant = name, .seconds = seconds, .error = error.norms() };
+}
+
+// Free Gaussian packet with hbar = m = 1 and initial width sigma moving along x with wave number k0:
+// psi = (1 + i tau)^-1/2 exp((-(x - x0)^2 / (4 sigma^2) + i k0 (x - x0) - i k0^2 t / 2) / (1 + i tau)) times
+// the k0 = 0 factor in y, with tau = t / (2 sigma^2). Compared as probability density so the global phase and
+// the staggered Visscher time levels do not count as error.
+static std::complex<double> free_packet_1d(const double x, const double t, const double sigma, const double k0)
+{
+    constexpr auto i = std::complex(0.0, 1.0);
+    const std::complex<double> spread = 1.0 + i * t / (2.0 * sigma * sigma);
+    return std::exp((-x * x / (4.0 * sigma * sigma) + i * k0 * x - i * k0 * k0 * t / 2.0) / spread)
+        / std::sqrt(spread);
+}
+
+static Result schrodinger_free_packet(
+    const int size,
+    const SchrodingerSim::Integrator integrator,
+    const SchrodingerSim::Layout layout,
+    const double timestep,
+    const double end_time)
+{
+    constexpr double sigma = 6.0;
+    constexpr double k0 = 0.5;
+    // centered on the path so the packet ends as far from the walls as it starts
+    const double x0 = size / 2.0 - k0 * end_time / 2.0;
+    const double y0 = size / 2.0;
+    const auto exact = [&](const int x, const int y, const double t) {
+        return free_packet_1d(x - x0, t, sigma, k0) * free_packet_1d(y - y0, t, sigma, 0.0);
+    };
+
+    SchrodingerSim sim({ .size = size,
+                         .grid_spacing = 1.0,
+                         .timestep = timestep,
+                         .hbar = 1.0,
+                         .mass = 1.0,
+                         .integrator = integrator,
+                         .layout = layout });
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            sim.set_at({ x, y }, exact(x, y, 0.0));
+        }
+    }
+    sim.normalize();
+    sim.stagger_imaginary();
+    const int steps = static_cast<int>(std::round(end_time / timestep));
+    const double seconds = seconds_of([&] {
+        for (int i = 0; i < steps; ++i) {
+            sim.update();
+        }
+    });
+
+    // the sim keeps sum |psi|^2 = 1, so normalize the exact density the same way
+    std::vector<double> exact_density(static_cast<size_t>(size) * size);
+    double exact_sum = 0.0;
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            exact_density[sim.pos_to_idx({ x, y })] = std::norm(exact(x, y, steps * timestep));
+            exact_sum += exact_density[sim.pos_to_idx({ x, y })];
+        }
+    }
+    ErrorAccumulator error;
+    for (int i = 0; i < size * size; ++i) {
+        error.add(std::norm(sim.value_at_idx(i)), exact_density[i] / exact_sum);
+    }
+    const char* name = integrator == SchrodingerSim::Integrator::visscher ? "visscher"
+        : layout == SchrodingerSim::Layout::split                         ? "euler split"
+                                                                          : "euler interleaved";
+    char variant[64];
+    std::snprintf(variant, sizeof(variant), "%s dt=%.3g (%d steps)", name, timestep, steps);
+    return { .variant = variant, .seconds = seconds, .error = error.norms() };
+}
+
+int main(const int argc, char** argv)
+{
+    const double tolerance = argc > 1 ? std::atof(argv[1]) : 1.0e-2;
+    const int size = argc > 2 ? std::atoi(argv[2]) : 192;
+    if (tolerance <= 0.0 || size < 64) {
+        std::fprintf(stderr, "usage: %s [tolerance] [size >= 64]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    std::printf("grid %dx%d, error tolerance %.1e\n", size, size, tolerance);
+
+    {
+        std::vector<Result> results;
+        for (const double timestep : { 1.0, 0.5, 0.25 }) {
+            results.push_back(wave_standing_mode(size, timestep, 400.0));
+        }
+        print_results("WaveSim standing mode (3, 2), t = 400", results, tolerance);
+    }
+    {
+        // the front travels c t = 0.5 * 0.3 size from the center, leaving the pulse tail clear of the walls
+        const double end_time = 0.6 * size;
+        std::vector<Result> results;
+        for (const double timestep : { 1.0, 0.5, 0.25 }) {
+            results.push_back(wave_radial_pulse(size, timestep, end_time));
+        }
+        char name[64];
+        std::snprintf(name, sizeof(name), "WaveSim radial Gaussian pulse, t = %.0f", end_time);
+        print_results(name, results, tolerance);
+    }
+    {
+        constexpr double end_time = 50.0;
+        std::vector<Result> results;
+        for (const double timestep : { 0.02, 0.05 }) {
+            results.push_back(schrodinger_free_packet(
+                size, SchrodingerSim::Integrator::euler, SchrodingerSim::Layout::interleaved, timestep, end_time));
+            results.push_back(schrodinger_free_packet(
+                size, SchrodingerSim::Integrator::euler, SchrodingerSim::Layout::split, timestep, end_time));
+        }
+        for (const double timestep : { 0.02, 0.05, 0.1, 0.2 }) {
+            results.push_back(schrodinger_free_packet(
+                size, SchrodingerSim::Integrator::visscher, SchrodingerSim::Layout::split, timestep, end_time));
+        }
+        print_results("SchrodingerSim free Gaussian packet, t = 50", results, tolerance);
+    }
+    return EXIT_SUCCESS;
+}
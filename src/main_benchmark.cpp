@@ -0,0 +1,393 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <BS_thread_pool.hpp>
+
+#include "checkpoint_chain.hpp"
+#include "input_log.hpp"
+#include "lossless_codec.hpp"
+#include "lossy_codec.hpp"
+#include "perf_counters.hpp"
+#include "probe_recorder.hpp"
+#include "schrodinger_sim.hpp"
+#include "wave_sim.hpp"
+
+struct BenchmarkResult {
+    double ms_per_step;
+    double cells_per_second;
+    double cells;
+    // hardware counters of the sim kernels, all zero without ENABLE_PERF_COUNTERS
+    perf::Counts counts;
+};
+
+static BenchmarkResult run_benchmark(
+    const int size,
+    const int steps,
+    const std::function<void()>& step,
+    const std::function<perf::Counts()>& take_counts = [] { return perf::Counts {}; })
+{
+    // warmup so thread pool start-up and first-touch page faults are not measured
+    for (int i = 0; i < std::max(steps / 10, 1); ++i) {
+        step();
+    }
+    static_cast<void>(take_counts());
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < steps; ++i) {
+        step();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const double cells = static_cast<double>(size) * size * steps;
+    return { .ms_per_step = seconds * 1000.0 / steps,
+             .cells_per_second = cells / seconds,
+             .cells = cells,
+             .counts = take_counts() };
+}
+
+static void print_result(const std::string& name, const BenchmarkResult& result)
+{
+    std::printf(
+        "%-32s %10.3f ms/step %10.2f Mcells/s\n",
+        name.c_str(),
+        result.ms_per_step,
+        result.cells_per_second / 1.0e6);
+    if (perf::get(result.counts, perf::Counter::cycles) == 0) {
+        return;
+    }
+    const auto per_cell = [&](const perf::Counter counter) {
+        return static_cast<double>(perf::get(result.counts, counter)) / result.cells;
+    };
+    std::printf(
+        "%-32s %10.2f IPC %8.2f cycles/cell %8.4f LLC miss/cell %8.5f dTLB miss/cell %8.5f branch miss/cell\n",
+        "",
+        perf::instructions_per_cycle(result.counts),
+        per_cell(perf::Counter::cycles),
+        per_cell(perf::Counter::llc_misses),
+        per_cell(perf::Counter::dtlb_misses),
+        per_cell(perf::Counter::branch_misses));
+}
+
+static void init_packet(SchrodingerSim& sim)
+{
+    constexpr auto i = std::complex(0.0, 1.0);
+    const int size = sim.size();
+    for (int j = 0; j < size * size; ++j) {
+        const auto [x, y] = sim.idx_to_pos(j);
+        const double sigma = size / 25.0;
+        const auto x_term = std::exp(-std::pow(x - size / 4.0, 2.0) / (2.0 * sigma * sigma));
+        const auto y_term = std::exp(-std::pow(y - size / 2.0, 2.0) / (2.0 * sigma * sigma));
+        sim.set_at({ x, y }, x_term * y_term * std::exp(i * 2.0 * static_cast<double>(x)));
+    }
+    sim.normalize();
+}
+
+static void benchmark_schrodinger(
+    const std::string& name,
+    const int size,
+    const int steps,
+    const SchrodingerSim::Integrator integrator,
+    const SchrodingerSim::Layout layout)
+{
+    SchrodingerSim sim({ .size = size,
+                         .grid_spacing = 1.0,
+                         .timestep = 0.002,
+                         .hbar = 1.0,
+                         .mass = 1.0,
+                         .integrator = integrator,
+                         .layout = layout });
+    init_packet(sim);
+    print_result(name, run_benchmark(size, steps, [&] { sim.update(); }, [&] { return sim.take_perf_counts(); }));
+}
+
+static void benchmark_wave(const std::string& name, const int size, const int steps)
+{
+    WaveSim sim({ .size = size });
+    sim.set_at({ size / 2, size / 2 }, 10.0);
+    print_result(name, run_benchmark(size, steps, [&] { sim.update(); }, [&] { return sim.take_perf_counts(); }));
+}
+
+// Separate colorize pass after each step versus colorizing inside the update sweep
+static void benchmark_wave_colorize(const int size, const int steps)
+{
+    const Colormap colormap(Colormap::Preset::grayscale);
+    std::vector<uint32_t> pixels(static_cast<size_t>(size) * size);
+    {
+        WaveSim sim({ .size = size });
+        sim.set_at({ size / 2, size / 2 }, 10.0);
+        print_result("wave + separate colorize", run_benchmark(size, steps, [&] {
+                         sim.update();
+                         for (int y = 0; y < size; ++y) {
+                             colormap.map_row(
+                                 sim.row_data(y), pixels.data() + static_cast<size_t>(y) * size, size, -0.5, 0.5, false);
+                         }
+                     }));
+    }
+    {
+        WaveSim sim({ .size = size });
+        sim.set_at({ size / 2, size / 2 }, 10.0);
+        const WaveSim::ColorTarget target {
+            .colormap = &colormap, .min = -0.5, .max = 0.5, .absolute = false, .pixels = pixels.data()
+        };
+        print_result(
+            "wave fused colorize",
+            run_benchmark(size, steps, [&] { sim.update(target); }, [&] { return sim.take_perf_counts(); }));
+    }
+}
+
+// A few hundred probes as a run would record them: a grid of single cells plus some lines and areas
+static std::vector<Recti> probe_areas(const int size)
+{
+    std::vector<Recti> areas;
+    for (int y = 0; y < 16; ++y) {
+        for (int x = 0; x < 16; ++x) {
+            areas.push_back({ x * size / 16 + size / 32, y * size / 16 + size / 32, 1, 1 });
+        }
+    }
+    for (int i = 0; i < 16; ++i) {
+        areas.push_back({ 0, i * size / 16, size, 1 });
+        areas.push_back({ i * size / 16, i * size / 16, size / 16, size / 16 });
+    }
+    return areas;
+}
+
+// Cost of sampling probes in the update sweeps and recording them, against the file size of full frames
+template <typename Sim>
+static void benchmark_probes(const std::string& name, Sim& sim, const int steps)
+{
+    const std::string path = (std::filesystem::temp_directory_path() / "benchmark_probes.bin").string();
+    for (const Recti& area : probe_areas(sim.size())) {
+        sim.add_probe(area);
+    }
+    uint64_t samples = 0;
+    {
+        ProbeRecorder recorder(path, sim.probe_areas(), {});
+        print_result(
+            name + " " + std::to_string(sim.probe_areas().size()) + " probes",
+            run_benchmark(
+                sim.size(),
+                steps,
+                [&] {
+                    sim.update();
+                    recorder.record(sim.step(), sim.probe_values());
+                },
+                [&] { return sim.take_perf_counts(); }));
+        recorder.finish();
+        samples = recorder.samples_written();
+    }
+    std::error_code error;
+    const double file_bytes = static_cast<double>(std::filesystem::file_size(path, error));
+    std::filesystem::remove(path, error);
+    const double frame_bytes = static_cast<double>(sim.size()) * sim.size() * sizeof(double) * samples;
+    std::printf(
+        "%-32s %10.1f KB probe file, %.0fx less than full frames\n", "", file_bytes / 1.0e3, frame_bytes / file_bytes);
+}
+
+// Compression ratio, throughput and largest error of the codecs on a wave field some way into a run
+static void benchmark_codecs(const int size)
+{
+    WaveSim sim({ .size = size });
+    sim.set_at({ size / 2, size / 2 }, 10.0);
+    sim.set_at({ size / 3, size / 2 }, -5.0);
+    for (int i = 0; i < size / 2; ++i) {
+        sim.update();
+    }
+    std::vector<double> previous;
+    for (int y = 0; y < size; ++y) {
+        previous.insert(previous.end(), sim.row_data(y), sim.row_data(y) + size);
+    }
+    sim.update();
+    std::vector<double> field;
+    for (int y = 0; y < size; ++y) {
+        field.insert(field.end(), sim.row_data(y), sim.row_data(y) + size);
+    }
+    const size_t field_bytes = field.size() * sizeof(double);
+    const auto seconds_of = [](const std::function<void()>& work) {
+        const auto start = std::chrono::steady_clock::now();
+        work();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    BS::thread_pool pool;
+    std::vector<uint8_t> compressed;
+    std::vector<double> decompressed;
+    for (const double error_bound : { 1.0e-2, 1.0e-4, 1.0e-6 }) {
+        const double compress_seconds = seconds_of([&] {
+            lossy::compress(field.data(), size, size, 1, error_bound, compressed, pool);
+        });
+        const double decompress_seconds = seconds_of([&] {
+            static_cast<void>(lossy::decompress(compressed.data(), compressed.size(), decompressed, pool));
+        });
+        double max_error = 0.0;
+        for (size_t i = 0; i < field.size(); ++i) {
+            max_error = std::max(max_error, std::abs(field[i] - decompressed[i]));
+        }
+        std::printf(
+            "lossy codec, bound %-12.0e %8.1fx %8.1f MB/s compress %8.1f MB/s decompress, max error %.3e\n",
+            error_bound,
+            field_bytes / static_cast<double>(compressed.size()),
+            field_bytes / compress_seconds / 1.0e6,
+            field_bytes / decompress_seconds / 1.0e6,
+            max_error);
+    }
+    for (const bool delta : { false, true }) {
+        const void* base = delta ? previous.data() : nullptr;
+        const double compress_seconds = seconds_of([&] {
+            lossless::compress(field.data(), field_bytes, sizeof(double), base, compressed, pool);
+        });
+        decompressed.resize(field.size());
+        bool exact = false;
+        const double decompress_seconds = seconds_of([&] {
+            exact = lossless::decompress(
+                compressed.data(), compressed.size(), decompressed.data(), field_bytes, base, pool);
+        });
+        exact = exact && decompressed == field;
+        std::printf(
+            "lossless codec%-19s %8.1fx %8.1f MB/s compress %8.1f MB/s decompress, %s\n",
+            delta ? ", XOR previous" : "",
+            field_bytes / static_cast<double>(compressed.size()),
+            field_bytes / compress_seconds / 1.0e6,
+            field_bytes / decompress_seconds / 1.0e6,
+            exact ? "exact" : "NOT EXACT");
+    }
+}
+
+// Cost and size of periodic checkpoints through a chain on a sparse wave scene, full against delta saves
+static void benchmark_checkpoint_chain(const int size, const int steps)
+{
+    const std::filesystem::path directory = std::filesystem::temp_directory_path();
+    const std::string index_path = (directory / "benchmark_chain.index").string();
+    WaveSim sim({ .size = size });
+    sim.set_at({ size / 2, size / 2 }, 10.0);
+    CheckpointChain chain(index_path, 4);
+    std::array<double, 2> seconds {};
+    std::array<double, 2> bytes {};
+    std::array<int, 2> saves {};
+    for (int save = 0; save < 10; ++save) {
+        for (int i = 0; i < steps; ++i) {
+            sim.update();
+        }
+        const auto start = std::chrono::steady_clock::now();
+        if (!chain.save(sim)) {
+            std::printf("checkpoint chain save failed\n");
+            return;
+        }
+        const CheckpointChain::Entry& entry = chain.entries().back();
+        const size_t kind = entry.full ? 0 : 1;
+        seconds[kind] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::error_code error;
+        bytes[kind] += static_cast<double>(std::filesystem::file_size(directory / entry.file, error));
+        ++saves[kind];
+    }
+    for (const size_t kind : { 0, 1 }) {
+        std::printf(
+            "%-32s %10.3f ms/save %10.1f KB/save\n",
+            kind == 0 ? "checkpoint chain full" : "checkpoint chain delta",
+            saves[kind] > 0 ? seconds[kind] * 1000.0 / saves[kind] : 0.0,
+            saves[kind] > 0 ? bytes[kind] / saves[kind] / 1.0e3 : 0.0);
+    }
+    for (const CheckpointChain::Entry& entry : chain.entries()) {
+        std::error_code error;
+        std::filesystem::remove(directory / entry.file, error);
+    }
+    std::error_code error;
+    std::filesystem::remove(index_path, error);
+}
+
+// Replays an input log from the wave app on the checkpoint it starts from, timing the whole session. The final
+// state can be saved as a checkpoint to inspect it.
+static int replay(const std::string& log_path, const std::optional<std::string>& checkpoint_out)
+{
+    const std::optional<InputLog> log = InputLog::read(log_path);
+    const std::string checkpoint_path = InputLog::checkpoint_path(log_path);
+    const std::optional<WaveSim::Properties> props = WaveSim::checkpoint_properties(checkpoint_path);
+    if (!log.has_value() || !props.has_value()) {
+        std::fprintf(stderr, "cannot read %s or %s\n", log_path.c_str(), checkpoint_path.c_str());
+        return EXIT_FAILURE;
+    }
+    WaveSim sim(*props);
+    if (!sim.load_checkpoint(checkpoint_path)) {
+        std::fprintf(stderr, "cannot load %s\n", checkpoint_path.c_str());
+        return EXIT_FAILURE;
+    }
+    std::printf(
+        "grid %dx%d, %zu events from step %llu\n",
+        props->size,
+        props->size,
+        log->events.size(),
+        static_cast<unsigned long long>(log->start_step));
+    const auto start = std::chrono::steady_clock::now();
+    if (!replay_inputs(sim, *log)) {
+        std::fprintf(stderr, "%s does not start at the checkpoint's step or is out of order\n", log_path.c_str());
+        return EXIT_FAILURE;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const uint64_t steps = sim.step() - log->start_step;
+    const double cells = static_cast<double>(props->size) * props->size * static_cast<double>(steps);
+    print_result(
+        "wave replay",
+        { .ms_per_step = steps > 0 ? seconds * 1000.0 / static_cast<double>(steps) : 0.0,
+          .cells_per_second = cells / seconds,
+          .cells = cells,
+          .counts = sim.take_perf_counts() });
+    if (checkpoint_out.has_value() && !sim.save_checkpoint(*checkpoint_out, CheckpointCodec::lossless)) {
+        std::fprintf(stderr, "cannot write %s\n", checkpoint_out->c_str());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(const int argc, char** argv)
+{
+    if (argc > 2 && std::string(argv[1]) == "--replay") {
+        return replay(argv[2], argc > 3 ? std::optional<std::string>(argv[3]) : std::nullopt);
+    }
+    const int size = argc > 1 ? std::atoi(argv[1]) : 512;
+    const int steps = argc > 2 ? std::atoi(argv[2]) : 50;
+    if (size <= 0 || steps <= 0) {
+        std::fprintf(
+            stderr, "usage: %s [size] [steps]\n       %s --replay <input log> [final checkpoint]\n", argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+    std::printf("grid %dx%d, %d steps\n", size, size, steps);
+
+    benchmark_wave("wave", size, steps);
+    benchmark_wave_colorize(size, steps);
+    {
+        WaveSim sim({ .size = size });
+        sim.set_at({ size / 2, size / 2 }, 10.0);
+        benchmark_probes("wave", sim, steps);
+    }
+    benchmark_schrodinger(
+        "schrodinger euler interleaved",
+        size,
+        steps,
+        SchrodingerSim::Integrator::euler,
+        SchrodingerSim::Layout::interleaved);
+    benchmark_schrodinger(
+        "schrodinger euler split", size, steps, SchrodingerSim::Integrator::euler, SchrodingerSim::Layout::split);
+    benchmark_schrodinger(
+        "schrodinger visscher", size, steps, SchrodingerSim::Integrator::visscher, SchrodingerSim::Layout::split);
+    {
+        SchrodingerSim sim({ .size = size,
+                             .grid_spacing = 1.0,
+                             .timestep = 0.002,
+                             .hbar = 1.0,
+                             .mass = 1.0,
+                             .integrator = SchrodingerSim::Integrator::visscher,
+                             .layout = SchrodingerSim::Layout::split });
+        init_packet(sim);
+        benchmark_probes("visscher", sim, steps);
+    }
+    benchmark_codecs(size);
+    benchmark_checkpoint_chain(size, steps);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,275 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <BS_thread_pool.hpp>
+
+#include "colormap.hpp"
+#include "schrodinger_sim.hpp"
+#include "wave_sim.hpp"
+
+// Places each kernel on a roofline of this host: the measured streaming bandwidth and peak floating point rate
+// bound what a kernel with a given arithmetic intensity (flops per byte of compulsory traffic) can reach.
+
+struct HostLimits {
+    double bytes_per_second;
+    double flops_per_second;
+};
+
+struct KernelCost {
+    std::string name;
+    double flops_per_cell;
+    double bytes_per_cell;
+};
+
+static double seconds_of(const std::function<void()>& work)
+{
+    const auto start = std::chrono::steady_clock::now();
+    work();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Best of several runs, since anything else running on the host only makes a run slower
+static double best_seconds_of(const int runs, const std::function<void()>& work)
+{
+    double best = seconds_of(work);
+    for (int i = 1; i < runs; ++i) {
+        best = std::min(best, seconds_of(work));
+    }
+    return best;
+}
+
+// STREAM triad a = b + s * c over arrays far larger than the caches, counting 3 doubles per element.
+// Write-allocate traffic for a is not counted, like STREAM.
+static double measure_bandwidth(BS::thread_pool& pool, const int elements)
+{
+    std::vector<double> a(elements);
+    std::vector<double> b(elements);
+    std::vector<double> c(elements);
+    // first touch from the same blocks that run the triad so pages land near the threads that use them
+    pool.detach_blocks<int>(0, elements, [&](const int start, const int end) {
+        for (int i = start; i < end; ++i) {
+            a[i] = 0.0;
+            b[i] = 1.0;
+            c[i] = 2.0;
+        }
+    });
+    pool.wait();
+    constexpr double scalar = 3.0;
+    const double seconds = best_seconds_of(5, [&] {
+        pool.detach_blocks<int>(0, elements, [&](const int start, const int end) {
+            for (int i = start; i < end; ++i) {
+                a[i] = b[i] + scalar * c[i];
+            }
+        });
+        pool.wait();
+    });
+    return 3.0 * sizeof(double) * elements / seconds;
+}
+
+// Independent multiply-add chains in registers on every thread, compiled with the same flags as the sims so the
+// peak is the one they can reach (no FMA unless the build enables it)
+static double measure_peak_flops(BS::thread_pool& pool)
+{
+    constexpr int chains = 32;
+    constexpr int iterations = 1 << 22;
+    const int tasks = static_cast<int>(pool.get_thread_count());
+    std::vector<double> sinks(tasks);
+    const double seconds = best_seconds_of(3, [&] {
+        pool.detach_blocks<int>(0, tasks, [&](const int start, const int end) {
+            for (int t = start; t < end; ++t) {
+                std::array<double, chains> acc {};
+                for (int j = 0; j < chains; ++j) {
+                    acc[j] = 1.0 + j * 1e-3;
+                }
+                for (int i = 0; i < iterations; ++i) {
+                    for (double& value : acc) {
+                        value = value * 0.999999 + 1e-7;
+                    }
+                }
+                double sum = 0.0;
+                for (const double value : acc) {
+                    sum += value;
+                }
+                sinks[t] = sum;
+            }
+        });
+        pool.wait();
+    });
+    double sink = 0.0;
+    for (const double value : sinks) {
+        sink += value;
+    }
+    // keeps the chains from being optimized away
+    if (sink == 0.0) {
+        std::printf("\n");
+    }
+    return 2.0 * chains * static_cast<double>(iterations) * tasks / seconds;
+}
+
+static double cells_per_second(const int size, const int steps, const std::function<void()>& step)
+{
+    // warmup so thread pool start-up and first-touch page faults are not measured
+    for (int i = 0; i < std::max(steps / 10, 1); ++i) {
+        step();
+    }
+    const double seconds = seconds_of([&] {
+        for (int i = 0; i < steps; ++i) {
+            step();
+        }
+    });
+    return static_cast<double>(size) * size * steps / seconds;
+}
+
+static void print_kernel(const HostLimits& limits, const KernelCost& cost, const double cells_per_second)
+{
+    const double intensity = cost.flops_per_cell / cost.bytes_per_cell;
+    const double flops = cost.flops_per_cell * cells_per_second;
+    const double bytes = cost.bytes_per_cell * cells_per_second;
+    const double bound = std::min(limits.flops_per_second, intensity * limits.bytes_per_second);
+    const bool memory_bound = intensity * limits.bytes_per_second < limits.flops_per_second;
+    std::printf(
+        "%-30s %6.1f %6.1f %7.3f %9.1f %8.2f %8.2f %8.2f %6.1f%%  %s\n",
+        cost.name.c_str(),
+        cost.flops_per_cell,
+        cost.bytes_per_cell,
+        intensity,
+        cells_per_second / 1.0e6,
+        flops / 1.0e9,
+        bytes / 1.0e9,
+        bound / 1.0e9,
+        100.0 * flops / bound,
+        memory_bound ? "memory" : "compute");
+}
+
+static void init_packet(SchrodingerSim& sim)
+{
+    constexpr auto i = std::complex(0.0, 1.0);
+    const int size = sim.size();
+    for (int j = 0; j < size * size; ++j) {
+        const auto [x, y] = sim.idx_to_pos(j);
+        const double sigma = size / 25.0;
+        const auto x_term = std::exp(-std::pow(x - size / 4.0, 2.0) / (2.0 * sigma * sigma));
+        const auto y_term = std::exp(-std::pow(y - size / 2.0, 2.0) / (2.0 * sigma * sigma));
+        sim.set_at({ x, y }, x_term * y_term * std::exp(i * 2.0 * static_cast<double>(x)));
+    }
+    sim.normalize();
+}
+
+static void roofline_schrodinger(
+    const HostLimits& limits,
+    const std::string& name,
+    const int size,
+    const int steps,
+    const SchrodingerSim::Integrator integrator,
+    const SchrodingerSim::Layout layout)
+{
+    SchrodingerSim sim({ .size = size,
+                         .grid_spacing = 1.0,
+                         .timestep = 0.002,
+                         .hbar = 1.0,
+                         .mass = 1.0,
+                         .integrator = integrator,
+                         .layout = layout });
+    init_packet(sim);
+    print_kernel(
+        limits,
+        { .name = name, .flops_per_cell = sim.flops_per_cell_update(), .bytes_per_cell = sim.bytes_per_cell_update() },
+        cells_per_second(size, steps, [&] { sim.update(); }));
+}
+
+int main(const int argc, char** argv)
+{
+    const int size = argc > 1 ? std::atoi(argv[1]) : 1024;
+    const int steps = argc > 2 ? std::atoi(argv[2]) : 50;
+    if (size <= 0 || steps <= 0) {
+        std::fprintf(stderr, "usage: %s [size] [steps]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    BS::thread_pool pool;
+    // 3 x 256 MiB, well past any last level cache
+    constexpr int stream_elements = 32 * 1024 * 1024;
+    const HostLimits limits { .bytes_per_second = measure_bandwidth(pool, stream_elements),
+                              .flops_per_second = measure_peak_flops(pool) };
+    std::printf("threads %u, grid %dx%d, %d steps\n", pool.get_thread_count(), size, size, steps);
+    std::printf("stream triad bandwidth %10.2f GB/s\n", limits.bytes_per_second / 1.0e9);
+    std::printf("peak double flops      %10.2f GFLOP/s\n", limits.flops_per_second / 1.0e9);
+    std::printf("ridge point            %10.3f flop/byte\n\n", limits.flops_per_second / limits.bytes_per_second);
+
+    std::printf(
+        "%-30s %6s %6s %7s %9s %8s %8s %8s %7s  %s\n",
+        "kernel",
+        "flop",
+        "byte",
+        "flop/B",
+        "Mcells/s",
+        "GFLOP/s",
+        "GB/s",
+        "bound",
+        "of bound",
+        "limited by");
+    {
+        WaveSim sim({ .size = size });
+        sim.set_at({ size / 2, size / 2 }, 10.0);
+        print_kernel(
+            limits,
+            { .name = "wave",
+              .flops_per_cell = WaveSim::flops_per_cell_update(),
+              .bytes_per_cell = WaveSim::bytes_per_cell_update() },
+            cells_per_second(size, steps, [&] { sim.update(); }));
+    }
+    roofline_schrodinger(
+        limits,
+        "schrodinger euler interleaved",
+        size,
+        steps,
+        SchrodingerSim::Integrator::euler,
+        SchrodingerSim::Layout::interleaved);
+    roofline_schrodinger(
+        limits,
+        "schrodinger euler split",
+        size,
+        steps,
+        SchrodingerSim::Integrator::euler,
+        SchrodingerSim::Layout::split);
+    roofline_schrodinger(
+        limits,
+        "schrodinger visscher",
+        size,
+        steps,
+        SchrodingerSim::Integrator::visscher,
+        SchrodingerSim::Layout::split);
+    {
+        // the renderers' per-pixel work: scale, clamp and look up one double into a packed pixel
+        const Colormap colormap(Colormap::Preset::viridis);
+        std::vector<double> values(static_cast<size_t>(size) * size, 0.25);
+        std::vector<uint32_t> pixels(values.size());
+        print_kernel(
+            limits,
+            { .name = "colorize (Colormap::map_row)",
+              .flops_per_cell = 4.0,
+              .bytes_per_cell = sizeof(double) + sizeof(uint32_t) },
+            cells_per_second(size, steps, [&] {
+                pool.detach_blocks<int>(0, size, [&](const int start, const int end) {
+                    for (int y = start; y < end; ++y) {
+                        colormap.map_row(
+                            values.data() + static_cast<size_t>(y) * size,
+                            pixels.data() + static_cast<size_t>(y) * size,
+                            size,
+                            -0.5,
+                            0.5,
+                            true);
+                    }
+                });
+                pool.wait();
+            }));
+    }
+    return EXIT_SUCCESS;
+}
@@ -6,15 +6,23 @@
 #define RAYGUI_IMPLEMENTATION
 #include <raygui.h>
 
+#include "frame_governor.hpp"
+#include "keyframe_ring.hpp"
+#include "perf_hud.hpp"
 #include "res/roboto-regular.h"
 #include "schrodinger_renderer.hpp"
 #include "schrodinger_sim.hpp"
+#include "trace.hpp"
 #include "ui.hpp"
+#include "viewport.hpp"
 
 namespace rl = raylib;
 
 constexpr int sim_size = 256;
 constexpr int base_font_size = 16;
+constexpr int target_fps = 60;
+// a compressed keyframe of the 256 x 256 field takes around a MB
+constexpr auto keyframe_props = KeyframeRing::Properties { .interval = 64, .memory_budget = size_t { 256 } << 20 };
 
 static rl::Rectangle sim_screen_rect(const int toolbar_height)
 {
@@ -25,11 +33,10 @@ static rl::Rectangle sim_screen_rect(const int toolbar_height)
              static_cast<float>(size) };
 }
 
-static std::optional<Vector2i> mouse_to_sim(const rl::Vector2 mouse_pos, const int toolbar_height)
+static std::optional<Vector2i> mouse_to_sim(
+    const rl::Vector2 mouse_pos, const SimViewport& viewport, const int toolbar_height)
 {
-    const rl::Vector2 sim_pos_f = (mouse_pos - sim_screen_rect(toolbar_height).GetPosition()) * sim_size
-        / sim_screen_rect(toolbar_height).GetWidth();
-    return Vector2i { static_cast<int>(sim_pos_f.x), static_cast<int>(sim_pos_f.y) };
+    return viewport.screen_to_sim(mouse_pos, sim_screen_rect(toolbar_height));
 }
 
 static void resize_font(rl::Font& font, const int size)
@@ -41,6 +48,24 @@ static void resize_font(rl::Font& font, const int size)
     GuiSetStyle(DEFAULT, TEXT_SIZE, size);
 }
 
+// F9 starts a trace capture and stops it again, writing it as Chrome trace JSON
+static void handle_trace_inputs()
+{
+    if (!IsKeyPressed(KEY_F9)) {
+        return;
+    }
+    if (!trace::capturing()) {
+        trace::start_capture();
+        TraceLog(LOG_INFO, "TRACE: Capture started");
+    }
+    else if (trace::stop_capture("schrodinger_simulation_trace.json")) {
+        TraceLog(LOG_INFO, "TRACE: Capture written to schrodinger_simulation_trace.json");
+    }
+    else {
+        TraceLog(LOG_WARNING, "TRACE: Failed to write schrodinger_simulation_trace.json");
+    }
+}
+
 static void handle_font_scale_inputs(rl::Font& font)
 {
     std::optional<int> new_size;
@@ -57,10 +82,13 @@ static void handle_font_scale_inputs(rl::Font& font)
 
 enum class Mode { none, interact, walls };
 
-static void handle_sim_inputs(const Mode mode, SchrodingerSim& sim, const int toolbar_height)
+// Returns whether the sim was edited
+static bool handle_sim_inputs(
+    const Mode mode, SchrodingerSim& sim, const SimViewport& viewport, const int toolbar_height)
 {
+    bool edited = false;
     const rl::Vector2 mouse_pos = GetMousePosition();
-    if (const std::optional<Vector2i> sim_pos = mouse_to_sim(mouse_pos, toolbar_height);
+    if (const std::optional<Vector2i> sim_pos = mouse_to_sim(mouse_pos, viewport, toolbar_height);
         sim_pos.has_value() && sim.in_bounds(sim_pos.value())) {
         if (mode == Mode::walls) {
             if (IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
@@ -72,6 +100,7 @@ static void handle_sim_inputs(const Mode mode, SchrodingerSim& sim, const int to
                             sim.in_bounds(pos) && std::sqrt(x * x + y * y) <= radius) {
                             sim.set_at(pos, std::complex(0.0, 0.0));
                             sim.set_fixed_at(pos, true);
+                            edited = true;
                         }
                     }
                 }
@@ -86,6 +115,7 @@ static void handle_sim_inputs(const Mode mode, SchrodingerSim& sim, const int to
                             sim.in_bounds(pos) && std::sqrt(x * x + y * y) <= radius && sim.fixed_at(pos)) {
                             sim.set_at(pos, std::complex(0.0, 0.0));
                             sim.set_fixed_at(pos, false);
+                            edited = true;
                         }
                     }
                 }
@@ -98,6 +128,7 @@ static void handle_sim_inputs(const Mode mode, SchrodingerSim& sim, const int to
         //     }
         // }
     }
+    return edited;
 }
 
 struct State {
@@ -106,6 +137,7 @@ struct State {
     float scale;
     SchrodingerSim sim;
     SchrodingerRenderer sim_renderer;
+    SimViewport viewport;
     Mode mode;
     LabelledDropdown theme_dropdown;
     LabelledDropdown mode_dropdown;
@@ -114,11 +146,30 @@ struct State {
     bool init;
     std::atomic<bool> should_exit;
     std::atomic<bool> sim_paused;
-    std::chrono::time_point<std::chrono::steady_clock> frame_count_start;
-    std::atomic<int> frame_count;
+    FrameGovernor governor;
+    PerfHud perf_hud;
+    // steps the sim thread may still run this frame, and the steps and time it spent since the last frame
+    std::atomic<int> pending_steps;
+    std::atomic<int> completed_steps;
+    std::atomic<int64_t> sim_nanoseconds;
+    std::atomic<int64_t> normalize_nanoseconds;
+    // recorded and sought on the sim thread; seek_step is the step the scrubber asked for, or -1
+    KeyframeRing keyframes;
+    std::atomic<int64_t> seek_step;
     std::thread sim_thread;
 };
 
+// Changes whenever the sim state or anything else that affects the rendered image changes
+static uint64_t render_key(
+    const SchrodingerSim& sim, const SchrodingerRenderer::Theme theme, const Recti view, const int resolution)
+{
+    uint64_t key = sim.revision();
+    for (const int value : { static_cast<int>(theme), view.x, view.y, view.width, view.height, resolution }) {
+        key = key * 1000003 ^ static_cast<uint64_t>(value);
+    }
+    return key;
+}
+
 void init_packet(SchrodingerSim& sim)
 {
     sim.lock_write();
@@ -139,20 +190,27 @@ void init_packet(SchrodingerSim& sim)
         sim.set_at({ x, y }, a * pos * mom);
     }
     sim.unlock_write();
+    sim.normalize();
+    sim.stagger_imaginary();
 }
 
 void loop(State* s)
 {
+    TRACE_ZONE("frame");
     if (!s->init) {
         init_packet(s->sim);
         s->init = true;
     }
 
+    using Phase = FrameGovernor::Phase;
+    const auto input_start = std::chrono::steady_clock::now();
     const int toolbar_height = static_cast<int>(std::round(100.0f * s->scale));
     handle_font_scale_inputs(s->font);
+    handle_trace_inputs();
 
     if (IsKeyPressed(KEY_C)) {
         s->sim_paused = true;
+        s->keyframes.mark_edit(s->sim.step());
         s->sim.clear();
         init_packet(s->sim);
     }
@@ -170,39 +228,55 @@ void loop(State* s)
         s->mode_dropdown.set_active(static_cast<int>(s->mode));
     }
 
-    handle_sim_inputs(s->mode, s->sim, toolbar_height);
-    s->sim_renderer.update(s->sim, s->renderer_theme);
+    s->viewport.handle_inputs(sim_screen_rect(toolbar_height));
+    // read first since the sim thread may step while the edit is made
+    if (const uint64_t step = s->sim.step(); handle_sim_inputs(s->mode, s->sim, s->viewport, toolbar_height)) {
+        s->keyframes.mark_edit(step);
+    }
+    s->governor.record(Phase::input, FrameGovernor::seconds_since(input_start));
 
+    // nothing is shown while minimized, and recolorizing an unchanged (e.g. paused) state is wasted work
+    const bool visible = !IsWindowMinimized() && !IsWindowHidden();
+    const int render_resolution = static_cast<int>(
+        sim_screen_rect(toolbar_height).width * s->scale * s->governor.render_scale());
+    if (visible
+        && s->governor.needs_render(
+            render_key(s->sim, s->renderer_theme, s->viewport.visible(), render_resolution))) {
+        const auto timer = s->governor.time(Phase::colorize);
+        s->sim_renderer.update(s->sim, s->renderer_theme, render_resolution, s->viewport.visible());
+    }
+
+    const auto draw_start = std::chrono::steady_clock::now();
     BeginDrawing();
     ClearBackground(LIGHTGRAY);
-    DrawTexturePro(
-        s->sim_renderer.texture(),
-        { 0.0f, 0.0f, sim_size, sim_size },
-        sim_screen_rect(toolbar_height),
-        { 0.0f, 0.0f },
-        0.0f,
-        WHITE);
+    if (visible) {
+        DrawTexturePro(
+            s->sim_renderer.texture(),
+            { 0.0f,
+              0.0f,
+              static_cast<float>(s->sim_renderer.texture().width),
+              static_cast<float>(s->sim_renderer.texture().height) },
+            sim_screen_rect(toolbar_height),
+            { 0.0f, 0.0f },
+            0.0f,
+            WHITE);
+        DrawTexturePro(
+            s->sim_renderer.wall_texture(),
+            { 0.0f,
+              0.0f,
+              static_cast<float>(s->sim_renderer.wall_texture().width),
+              static_cast<float>(s->sim_renderer.wall_texture().height) },
+            sim_screen_rect(toolbar_height),
+            { 0.0f, 0.0f },
+            0.0f,
+            WHITE);
+    }
     if (s->show_fps) {
-        const float font_size = std::round(s->scale * static_cast<float>(base_font_size));
-        rl::DrawTextEx(
+        s->perf_hud.draw(
             s->font,
-            "FPS: " + std::to_string(GetFPS()),
             { 10.0f, static_cast<float>(toolbar_height) + 10.0f },
-            font_size,
-            1.0f,
-            DARKGREEN);
-        const auto now = std::chrono::steady_clock::now();
-        const int tick_rate = static_cast<int>(std::round(
-            static_cast<float>(s->frame_count) / std::chrono::duration<float>(now - s->frame_count_start).count()));
-        rl::DrawTextEx(
-            s->font,
-            "Tick Rate: " + std::to_string(tick_rate),
-            { 10.0f, static_cast<float>(toolbar_height) + 30.0f },
-            font_size,
-            1.0f,
-            BLUE);
-        s->frame_count = 0;
-        s->frame_count_start = now;
+            std::round(s->scale * static_cast<float>(base_font_size)),
+            s->governor.target_frame_seconds());
     }
 
     if (const float scale = GetWindowScaleDPI().x; scale != s->scale) {
@@ -217,6 +291,7 @@ void loop(State* s)
         float offset_x = ui_padding;
         if (GuiButton({ ui_padding, ui_padding, 70.0f * s->scale, ui_height }, "Clear [C]")) {
             s->sim_paused = true;
+            s->keyframes.mark_edit(s->sim.step());
             s->sim.clear();
             init_packet(s->sim);
         }
@@ -226,6 +301,19 @@ void loop(State* s)
         if (GuiButton({ offset_x, ui_padding, 40.0f * s->scale, ui_height }, s->sim_paused ? "#131#" : "#132#")) {
             s->sim_paused = !s->sim_paused;
         }
+        offset_x += 40.0f * s->scale + ui_padding;
+        if (const std::optional<uint64_t> first = s->keyframes.first_step(); first.has_value()) {
+            // scrubbing pauses the sim at the chosen step
+            if (const std::optional<uint64_t> step = timeline_scrubber(
+                    { offset_x, ui_padding, 200.0f * s->scale, ui_height },
+                    *first,
+                    s->keyframes.last_step(),
+                    s->sim.step());
+                step.has_value()) {
+                s->sim_paused = true;
+                s->seek_step = static_cast<int64_t>(*step);
+            }
+        }
 
         offset_x = ui_padding;
         s->theme_dropdown.draw_and_update(
@@ -237,20 +325,46 @@ void loop(State* s)
         s->mode = static_cast<Mode>(s->mode_dropdown.active());
     }
 
+    s->governor.record(Phase::draw, FrameGovernor::seconds_since(draw_start));
     EndDrawing();
+
+    s->governor.record(Phase::sim_overlapped, static_cast<double>(s->sim_nanoseconds.exchange(0)) / 1.0e9);
+    s->governor.record(Phase::normalize, static_cast<double>(s->normalize_nanoseconds.exchange(0)) / 1.0e9);
+    s->governor.end_frame();
+    s->perf_hud.push(
+        s->governor,
+        s->completed_steps.exchange(0),
+        0,
+        s->sim.size(),
+        s->sim.bytes_per_cell_update(),
+        s->sim.take_perf_counts());
+    s->pending_steps = s->sim_paused ? 0 : s->governor.sim_steps();
 }
 
 void sim_thread(void* state)
 {
     auto* s = static_cast<State*>(state);
     while (!s->should_exit) {
-        if (!s->sim_paused) {
+        if (const int64_t step = s->seek_step.exchange(-1); step >= 0) {
+            s->keyframes.seek(s->sim, static_cast<uint64_t>(step));
+            continue;
+        }
+        // the main thread hands out a batch of steps each frame so the sim is paced to the frame budget
+        if (!s->sim_paused && s->pending_steps > 0) {
+            const auto start = std::chrono::steady_clock::now();
             s->sim.update();
-            s->frame_count += 1;
+            s->keyframes.record(s->sim);
+            // normalize() runs inside update() and is reported as a phase of its own
+            const int64_t nanoseconds
+                = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            const int64_t normalize_nanoseconds = std::min(s->sim.take_normalize_nanoseconds(), nanoseconds);
+            s->sim_nanoseconds += nanoseconds - normalize_nanoseconds;
+            s->normalize_nanoseconds += normalize_nanoseconds;
+            s->pending_steps -= 1;
+            s->completed_steps += 1;
         }
         else {
-            std::this_thread::yield();
-            s->frame_count = 0;
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
         }
     }
 }
@@ -260,6 +374,7 @@ int main()
     SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_MSAA_4X_HINT | FLAG_VSYNC_HINT);
     rl::Window window { 600, 700, "Schrodinger Simulation" };
     window.SetMinSize(600, 700);
+    SetTargetFPS(target_fps);
     const int font_size = static_cast<int>(std::round(static_cast<float>(base_font_size) * GetWindowScaleDPI().x));
     rl::Font font = LoadFontFromMemory(
         ".ttf", font_robot_regular_ttf_bin, static_cast<int>(font_robot_regular_ttf_bin_size), font_size, nullptr, 0);
@@ -267,13 +382,18 @@ int main()
     GuiSetStyle(DEFAULT, TEXT_SIZE, font_size);
 
     constexpr auto sim_props = SchrodingerSim::Properties {
-        .size = sim_size, .grid_spacing = 1.0, .timestep = 0.002, .hbar = 1.0, .mass = 1.0
+        .size = sim_size,
+        .grid_spacing = 1.0,
+        .timestep = 0.01,
+        .hbar = 1.0,
+        .mass = 1.0,
+        .integrator = SchrodingerSim::Integrator::visscher
     };
 
     auto mode = Mode::interact;
 
     LabelledDropdown theme_dropdown("Theme");
-    theme_dropdown.set_items({ "Probability", "Waves" });
+    theme_dropdown.set_items({ "Probability", "Waves", "Phase" });
 
     LabelledDropdown mode_dropdown("Mode");
     mode_dropdown.set_items({ "None [N]", "Interact [I]", "Walls [W]" });
@@ -285,6 +405,7 @@ int main()
         .scale = 1.0f,
         .sim = SchrodingerSim(sim_props),
         .sim_renderer = SchrodingerRenderer(sim_props.size),
+        .viewport = SimViewport(sim_props.size),
         .mode = mode,
         .theme_dropdown = std::move(theme_dropdown),
         .mode_dropdown = std::move(mode_dropdown),
@@ -293,8 +414,14 @@ int main()
         .init = false,
         .should_exit = false,
         .sim_paused = true,
-        .frame_count_start = std::chrono::steady_clock::now(),
-        .frame_count = 0,
+        .governor = FrameGovernor(target_fps),
+        .perf_hud = PerfHud(),
+        .pending_steps = 0,
+        .completed_steps = 0,
+        .sim_nanoseconds = 0,
+        .normalize_nanoseconds = 0,
+        .keyframes = KeyframeRing(keyframe_props),
+        .seek_step = -1,
         .sim_thread = std::thread(sim_thread, &state),
     };
     while (!window.ShouldClose()) {
@@ -0,0 +1,198 @@
+#pragma once
+
+// Hardware performance counters around sim kernels. Every worker thread opens its own perf_event_open counters
+// and adds what each block it runs costs to the kernel's CounterTotals.
+// Compiled in only on Linux with ENABLE_PERF_COUNTERS; elsewhere the totals stay empty.
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+#if defined(ENABLE_PERF_COUNTERS) && defined(__linux__)
+#define PERF_COUNTERS_ENABLED
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace perf {
+
+enum class Counter {
+    cycles,
+    instructions,
+    llc_misses,
+    dtlb_misses,
+    branch_misses,
+    count,
+};
+
+using Counts = std::array<uint64_t, static_cast<size_t>(Counter::count)>;
+
+[[nodiscard]] inline uint64_t get(const Counts& counts, const Counter counter)
+{
+    return counts[static_cast<size_t>(counter)];
+}
+
+[[nodiscard]] inline double instructions_per_cycle(const Counts& counts)
+{
+    const uint64_t cycles = get(counts, Counter::cycles);
+    return cycles == 0 ? 0.0 : static_cast<double>(get(counts, Counter::instructions)) / static_cast<double>(cycles);
+}
+
+// Counts accumulated by any number of threads until taken
+class CounterTotals {
+public:
+    CounterTotals()
+        : m_counts()
+    {
+    }
+
+    void add(const Counts& counts)
+    {
+        for (size_t i = 0; i < counts.size(); ++i) {
+            m_counts[i].fetch_add(counts[i], std::memory_order_relaxed);
+        }
+    }
+
+    // Returns the counts since the last take() and starts over
+    Counts take()
+    {
+        Counts counts {};
+        for (size_t i = 0; i < counts.size(); ++i) {
+            counts[i] = m_counts[i].exchange(0, std::memory_order_relaxed);
+        }
+        return counts;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(Counter::count)> m_counts;
+};
+
+#ifdef PERF_COUNTERS_ENABLED
+
+// Counters of the calling thread, opened as one group so they are scheduled and read together.
+// User space only, which is what perf_event_paranoid <= 2 allows.
+class ThreadCounters {
+public:
+    static ThreadCounters& this_thread()
+    {
+        thread_local ThreadCounters counters;
+        return counters;
+    }
+
+    ThreadCounters(const ThreadCounters&) = delete;
+    ThreadCounters& operator=(const ThreadCounters&) = delete;
+
+    ~ThreadCounters()
+    {
+        for (const int fd : m_fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    [[nodiscard]] bool available() const
+    {
+        return m_fds[0] >= 0;
+    }
+
+    // Running totals, scaled up if the group was multiplexed with other events.
+    // Counters the CPU does not support stay zero.
+    [[nodiscard]] Counts read() const
+    {
+        Counts counts {};
+        // nr, time_enabled, time_running, then one value per opened counter
+        std::array<uint64_t, 3 + counts.size()> data {};
+        if (!available() || ::read(m_fds[0], data.data(), sizeof(data)) <= 0) {
+            return counts;
+        }
+        const double scale
+            = data[2] == 0 ? 0.0 : static_cast<double>(data[1]) / static_cast<double>(data[2]);
+        size_t value = 3;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            if (m_fds[i] >= 0) {
+                counts[i] = static_cast<uint64_t>(static_cast<double>(data[value++]) * scale);
+            }
+        }
+        return counts;
+    }
+
+private:
+    ThreadCounters()
+        : m_fds()
+    {
+        m_fds.fill(-1);
+        constexpr auto cache_event = [](const uint64_t cache, const uint64_t op, const uint64_t result) {
+            return cache | (op << 8) | (result << 16);
+        };
+        const std::array<std::pair<uint32_t, uint64_t>, static_cast<size_t>(Counter::count)> events { {
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+            { PERF_TYPE_HW_CACHE,
+              cache_event(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+            { PERF_TYPE_HW_CACHE,
+              cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        } };
+        for (size_t i = 0; i < events.size(); ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = events[i].first;
+            attr.config = events[i].second;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            const int leader = i == 0 ? -1 : m_fds[0];
+            m_fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+            if (i == 0 && m_fds[0] < 0) {
+                return;
+            }
+        }
+    }
+
+    std::array<int, static_cast<size_t>(Counter::count)> m_fds;
+};
+
+// Adds the calling thread's counts over its lifetime to totals
+class Scope {
+public:
+    explicit Scope(CounterTotals& totals)
+        : m_totals(totals)
+        , m_start(ThreadCounters::this_thread().read())
+    {
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    ~Scope()
+    {
+        const Counts end = ThreadCounters::this_thread().read();
+        Counts delta {};
+        for (size_t i = 0; i < delta.size(); ++i) {
+            delta[i] = end[i] > m_start[i] ? end[i] - m_start[i] : 0;
+        }
+        m_totals.add(delta);
+    }
+
+private:
+    CounterTotals& m_totals;
+    Counts m_start;
+};
+
+#define PERF_CONCAT_IMPL(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT_IMPL(a, b)
+#define PERF_SCOPE(totals) const perf::Scope PERF_CONCAT(perf_scope_, __LINE__)(totals)
+
+#else
+
+#define PERF_SCOPE(totals) static_cast<void>(0)
+
+#endif
+
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+#include "raylib-cpp.hpp"
+
+#include "frame_governor.hpp"
+#include "perf_counters.hpp"
+#include "sample_ring.hpp"
+
+// Overlay with rolling per-phase timings, a frame time histogram and sim throughput. Throughput counts only the steps
+// the sim advanced; steps taken back are shown on their own line.
+class PerfHud {
+public:
+    struct FrameSample {
+        std::array<float, static_cast<size_t>(FrameGovernor::Phase::count)> phase_seconds;
+        float frame_seconds;
+        // cells updated advancing the sim and the minimum bytes moved doing so
+        double cells;
+        double bytes;
+        int steps_back;
+        perf::Counts counts;
+    };
+
+    PerfHud()
+        : m_samples()
+        , m_snapshot()
+        , m_values()
+        , m_rows()
+    {
+    }
+
+    // Records the frame the governor just ended, in which the sim advanced steps_forward steps and went back
+    // steps_back. counts should only cover the steps forward.
+    void push(
+        const FrameGovernor& governor,
+        const int steps_forward,
+        const int steps_back,
+        const int sim_size,
+        const double bytes_per_cell,
+        const perf::Counts& counts)
+    {
+        FrameSample sample {};
+        for (size_t i = 0; i < sample.phase_seconds.size(); ++i) {
+            sample.phase_seconds[i] = static_cast<float>(governor.phase_seconds(static_cast<FrameGovernor::Phase>(i)));
+        }
+        sample.frame_seconds = static_cast<float>(governor.frame_seconds());
+        sample.cells = static_cast<double>(steps_forward) * sim_size * sim_size;
+        sample.bytes = sample.cells * bytes_per_cell;
+        sample.steps_back = steps_back;
+        sample.counts = counts;
+        m_samples.push(sample);
+    }
+
+    void draw(const raylib::Font& font, const Vector2 position, const float font_size, const double target_frame_seconds)
+    {
+        m_samples.snapshot(m_snapshot);
+        if (m_snapshot.empty()) {
+            return;
+        }
+
+        const float line_height = font_size * 1.1f;
+        const float histogram_height = font_size * 3.0f;
+        const float label_x = position.x + font_size * 0.5f;
+        const std::array<float, 2> value_x { label_x + font_size * 7.0f, label_x + font_size * 11.0f };
+
+        m_rows.clear();
+        const auto [frame_p50, frame_p99] = percentiles([](const FrameSample& s) { return s.frame_seconds; });
+        m_rows.push_back({ "frame", frame_p50, frame_p99 });
+        for (size_t i = 0; i < static_cast<size_t>(FrameGovernor::Phase::count); ++i) {
+            const auto [p50, p99] = percentiles([i](const FrameSample& s) { return s.phase_seconds[i]; });
+            // phases an app does not have (or that never ran) would only add noise
+            if (p99 > 0.0f) {
+                m_rows.push_back({ FrameGovernor::phase_name(static_cast<FrameGovernor::Phase>(i)), p50, p99 });
+            }
+        }
+
+        double seconds = 0.0;
+        double cells = 0.0;
+        double bytes = 0.0;
+        double steps_back = 0.0;
+        perf::Counts counts {};
+        for (const FrameSample& sample : m_snapshot) {
+            seconds += sample.frame_seconds;
+            cells += sample.cells;
+            bytes += sample.bytes;
+            steps_back += sample.steps_back;
+            for (size_t i = 0; i < counts.size(); ++i) {
+                counts[i] += sample.counts[i];
+            }
+        }
+        const bool has_counts = perf::get(counts, perf::Counter::cycles) > 0 && cells > 0.0;
+        const float width = font_size * (has_counts ? 20.0f : 16.0f);
+
+        const bool has_steps_back = steps_back > 0.0 && seconds > 0.0;
+        const size_t text_lines = m_rows.size() + 2 + (has_counts ? 2 : 0) + (has_steps_back ? 1 : 0);
+        const float height = line_height * static_cast<float>(text_lines) + histogram_height + font_size;
+        DrawRectangleRec({ position.x, position.y, width, height }, Fade(BLACK, 0.6f));
+        float y = position.y + font_size * 0.5f;
+        ::DrawTextEx(font, "ms", { label_x, y }, font_size, 1.0f, LIGHTGRAY);
+        ::DrawTextEx(font, "p50", { value_x[0], y }, font_size, 1.0f, LIGHTGRAY);
+        ::DrawTextEx(font, "p99", { value_x[1], y }, font_size, 1.0f, LIGHTGRAY);
+        y += line_height;
+        char buffer[64];
+        for (const Row& row : m_rows) {
+            ::DrawTextEx(font, row.label, { label_x, y }, font_size, 1.0f, RAYWHITE);
+            std::snprintf(buffer, sizeof(buffer), "%.2f", row.p50 * 1e3);
+            ::DrawTextEx(font, buffer, { value_x[0], y }, font_size, 1.0f, RAYWHITE);
+            std::snprintf(buffer, sizeof(buffer), "%.2f", row.p99 * 1e3);
+            ::DrawTextEx(font, buffer, { value_x[1], y }, font_size, 1.0f, RAYWHITE);
+            y += line_height;
+        }
+        if (seconds > 0.0) {
+            std::snprintf(
+                buffer, sizeof(buffer), "%.1f Mcells/s  %.2f GB/s", cells / seconds / 1e6, bytes / seconds / 1e9);
+            ::DrawTextEx(font, buffer, { label_x, y }, font_size, 1.0f, SKYBLUE);
+        }
+        y += line_height;
+        if (has_steps_back) {
+            std::snprintf(buffer, sizeof(buffer), "%.0f steps/s back", steps_back / seconds);
+            ::DrawTextEx(font, buffer, { label_x, y }, font_size, 1.0f, SKYBLUE);
+            y += line_height;
+        }
+        if (has_counts) {
+            const auto per_cell = [&](const perf::Counter counter) {
+                return static_cast<double>(perf::get(counts, counter)) / cells;
+            };
+            std::snprintf(
+                buffer,
+                sizeof(buffer),
+                "IPC %.2f  %.1f cycles/cell",
+                perf::instructions_per_cycle(counts),
+                per_cell(perf::Counter::cycles));
+            ::DrawTextEx(font, buffer, { label_x, y }, font_size, 1.0f, SKYBLUE);
+            y += line_height;
+            std::snprintf(
+                buffer,
+                sizeof(buffer),
+                "miss/cell LLC %.3f TLB %.4f br %.4f",
+                per_cell(perf::Counter::llc_misses),
+                per_cell(perf::Counter::dtlb_misses),
+                per_cell(perf::Counter::branch_misses));
+            ::DrawTextEx(font, buffer, { label_x, y }, font_size, 1.0f, SKYBLUE);
+            y += line_height;
+        }
+        draw_histogram({ label_x, y, width - font_size, histogram_height }, target_frame_seconds);
+    }
+
+private:
+    struct Row {
+        const char* label;
+        float p50;
+        float p99;
+    };
+
+    static constexpr size_t sc_capacity = 256;
+    static constexpr int sc_histogram_bins = 40;
+
+    template <typename Get>
+    std::pair<float, float> percentiles(Get get)
+    {
+        m_values.clear();
+        for (const FrameSample& sample : m_snapshot) {
+            m_values.push_back(get(sample));
+        }
+        const auto at = [&](const double fraction) {
+            const auto nth = m_values.begin()
+                + static_cast<std::ptrdiff_t>(fraction * static_cast<double>(m_values.size() - 1));
+            std::ranges::nth_element(m_values, nth);
+            return *nth;
+        };
+        const float p50 = at(0.5);
+        const float p99 = at(0.99);
+        return { p50, p99 };
+    }
+
+    // Frame times from 0 to twice the target, with the last bin collecting everything slower.
+    // The line marks the target frame time.
+    void draw_histogram(const Rectangle rect, const double target_frame_seconds) const
+    {
+        std::array<int, sc_histogram_bins> bins {};
+        const double bin_seconds = target_frame_seconds * 2.0 / sc_histogram_bins;
+        for (const FrameSample& sample : m_snapshot) {
+            const int bin = static_cast<int>(sample.frame_seconds / bin_seconds);
+            bins[std::clamp(bin, 0, sc_histogram_bins - 1)] += 1;
+        }
+        const int max_count = std::max(*std::ranges::max_element(bins), 1);
+        const float bin_width = rect.width / sc_histogram_bins;
+        for (int i = 0; i < sc_histogram_bins; ++i) {
+            const float bar_height = rect.height * static_cast<float>(bins[i]) / static_cast<float>(max_count);
+            DrawRectangleRec(
+                { rect.x + bin_width * static_cast<float>(i),
+                  rect.y + rect.height - bar_height,
+                  std::max(bin_width - 1.0f, 1.0f),
+                  bar_height },
+                i < sc_histogram_bins / 2 ? GREEN : ORANGE);
+        }
+        const float target_x = rect.x + rect.width * 0.5f;
+        DrawLineEx({ target_x, rect.y }, { target_x, rect.y + rect.height }, 1.0f, RAYWHITE);
+    }
+
+    SampleRing<FrameSample, sc_capacity> m_samples;
+    std::vector<FrameSample> m_snapshot;
+    std::vector<float> m_values;
+    std::vector<Row> m_rows;
+};
@@ -0,0 +1,203 @@
+#pragma once
+
+// Records the time series of a sim's probes to a file without stalling the solver. record() appends one sample of
+// every probe to columns of a chunk buffer; full chunks are written by a background thread.
+//
+// File layout: ProbeFileHeader, the probe areas (one Recti each), then chunks: ProbeChunkHeader, the steps of its
+// samples (uint64) and one column of samples doubles per probe. A file cut short by a crash keeps its whole chunks.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "background_writer.hpp"
+#include "common.hpp"
+
+struct ProbeFileHeader {
+    static constexpr std::array<char, 8> sc_magic { 'S', 'I', 'M', 'P', 'R', 'O', 'B', 'E' };
+    static constexpr uint32_t sc_version = 1;
+
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t probe_count;
+};
+
+struct ProbeChunkHeader {
+    uint64_t samples;
+};
+
+class ProbeRecorder {
+public:
+    struct Properties {
+        // samples per probe in a chunk
+        size_t chunk_samples = 4096;
+        // full chunks that may wait for the writer at once; record() blocks beyond that
+        int queue_chunks = 4;
+    };
+
+    // Opens path for writing; check ok() before recording
+    ProbeRecorder(const std::string& path, const std::vector<Recti>& areas, const Properties& props)
+        : c_probe_count(areas.size())
+        , c_chunk_samples(std::max<size_t>(props.chunk_samples, 1))
+        , m_file(path, std::ios::binary | std::ios::trunc)
+        , m_filling()
+        , m_written(0)
+        , m_failed(false)
+        , m_writer(std::vector<Chunk>(std::max(props.queue_chunks, 1) + 1,
+                                      Chunk { .steps = std::vector<uint64_t>(c_chunk_samples),
+                                              .columns = std::vector<double>(c_probe_count * c_chunk_samples),
+                                              .samples = 0 }),
+                   [this](Chunk& chunk) { return write_chunk(chunk); })
+    {
+        const ProbeFileHeader header { .magic = ProbeFileHeader::sc_magic,
+                                       .version = ProbeFileHeader::sc_version,
+                                       .probe_count = static_cast<uint32_t>(c_probe_count) };
+        m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        m_file.write(
+            reinterpret_cast<const char*>(areas.data()), static_cast<std::streamsize>(areas.size() * sizeof(Recti)));
+        m_failed = !m_file;
+    }
+
+    ProbeRecorder(const ProbeRecorder&) = delete;
+    ProbeRecorder& operator=(const ProbeRecorder&) = delete;
+
+    ~ProbeRecorder()
+    {
+        finish();
+    }
+
+    [[nodiscard]] bool ok() const
+    {
+        return !m_failed && m_writer.ok();
+    }
+
+    // Call after every step with the sim's step and probe values, one per probe the recorder was opened with
+    void record(const uint64_t step, const std::vector<double>& values)
+    {
+        if (!m_filling.has_value()) {
+            m_filling = m_writer.acquire(true);
+            if (!m_filling.has_value()) {
+                return;
+            }
+        }
+        Chunk& chunk = m_writer.slot(*m_filling);
+        chunk.steps[chunk.samples] = step;
+        for (size_t probe = 0; probe < c_probe_count && probe < values.size(); ++probe) {
+            chunk.columns[probe * c_chunk_samples + chunk.samples] = values[probe];
+        }
+        if (++chunk.samples == c_chunk_samples) {
+            m_writer.queue(*m_filling);
+            m_filling.reset();
+        }
+    }
+
+    // Writes the buffered samples and closes the file. Returns false if any write failed.
+    bool finish()
+    {
+        if (m_writer.finished()) {
+            return ok();
+        }
+        if (m_filling.has_value()) {
+            m_writer.queue(*m_filling);
+            m_filling.reset();
+        }
+        m_writer.finish();
+        m_file.close();
+        m_failed |= !m_file;
+        return ok();
+    }
+
+    // Samples per probe written so far
+    [[nodiscard]] uint64_t samples_written() const
+    {
+        return m_written;
+    }
+
+private:
+    struct Chunk {
+        std::vector<uint64_t> steps;
+        // probe-major: the samples of probe p start at p * chunk_samples
+        std::vector<double> columns;
+        size_t samples;
+    };
+
+    bool write_chunk(Chunk& chunk)
+    {
+        const ProbeChunkHeader header { .samples = chunk.samples };
+        m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        m_file.write(
+            reinterpret_cast<const char*>(chunk.steps.data()),
+            static_cast<std::streamsize>(chunk.samples * sizeof(uint64_t)));
+        for (size_t probe = 0; probe < c_probe_count; ++probe) {
+            m_file.write(
+                reinterpret_cast<const char*>(chunk.columns.data() + probe * c_chunk_samples),
+                static_cast<std::streamsize>(chunk.samples * sizeof(double)));
+        }
+        m_written += chunk.samples;
+        chunk.samples = 0;
+        return static_cast<bool>(m_file);
+    }
+
+    const size_t c_probe_count;
+    const size_t c_chunk_samples;
+    // the file belongs to the writer thread until it is finished
+    std::ofstream m_file;
+    // the chunk record() appends to, touched by the recording thread only
+    std::optional<size_t> m_filling;
+    std::atomic<uint64_t> m_written;
+    bool m_failed;
+    BackgroundWriter<Chunk> m_writer;
+};
+
+// The whole time series of a probe recording, one column per probe
+struct ProbeSeries {
+    std::vector<Recti> areas;
+    std::vector<uint64_t> steps;
+    std::vector<std::vector<double>> values;
+
+    // Returns nullopt if the file is missing or not a probe recording. A partly written last chunk is left out.
+    static std::optional<ProbeSeries> read(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        ProbeFileHeader header {};
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!file || header.magic != ProbeFileHeader::sc_magic || header.version != ProbeFileHeader::sc_version) {
+            return std::nullopt;
+        }
+        ProbeSeries series { .areas = std::vector<Recti>(header.probe_count),
+                             .steps = {},
+                             .values = std::vector<std::vector<double>>(header.probe_count) };
+        file.read(
+            reinterpret_cast<char*>(series.areas.data()),
+            static_cast<std::streamsize>(series.areas.size() * sizeof(Recti)));
+        if (!file) {
+            return std::nullopt;
+        }
+        ProbeChunkHeader chunk {};
+        std::vector<uint64_t> steps;
+        while (file.read(reinterpret_cast<char*>(&chunk), sizeof(chunk))) {
+            steps.resize(chunk.samples);
+            file.read(
+                reinterpret_cast<char*>(steps.data()), static_cast<std::streamsize>(chunk.samples * sizeof(uint64_t)));
+            std::vector<std::vector<double>> columns(header.probe_count, std::vector<double>(chunk.samples));
+            for (std::vector<double>& column : columns) {
+                file.read(
+                    reinterpret_cast<char*>(column.data()),
+                    static_cast<std::streamsize>(chunk.samples * sizeof(double)));
+            }
+            if (!file) {
+                break;
+            }
+            series.steps.insert(series.steps.end(), steps.begin(), steps.end());
+            for (size_t probe = 0; probe < columns.size(); ++probe) {
+                series.values[probe].insert(series.values[probe].end(), columns[probe].begin(), columns[probe].end());
+            }
+        }
+        return series;
+    }
+};
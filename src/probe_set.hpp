@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "common.hpp"
+
+// Virtual sensors on a square grid: each probe sums a value over its cells, a single cell, a line or an area.
+// A sim's update sweep samples them block by block while the cells it just wrote are still in cache, each block
+// into its own sums, and publish() adds the blocks up in order.
+class ProbeSet {
+public:
+    explicit ProbeSet(const int size)
+        : c_size(size)
+        , m_areas()
+        , m_values()
+    {
+    }
+
+    // The area is clipped to the grid. Returns the probe's index in values().
+    size_t add(const Recti area)
+    {
+        const int x = std::clamp(area.x, 0, c_size);
+        const int y = std::clamp(area.y, 0, c_size);
+        const int x_end = std::clamp(area.x + area.width, x, c_size);
+        const int y_end = std::clamp(area.y + area.height, y, c_size);
+        m_areas.push_back({ x, y, x_end - x, y_end - y });
+        m_values.push_back(0.0);
+        return m_areas.size() - 1;
+    }
+
+    void clear()
+    {
+        m_areas.clear();
+        m_values.clear();
+    }
+
+    [[nodiscard]] bool empty() const
+    {
+        return m_areas.empty();
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        return m_areas.size();
+    }
+
+    [[nodiscard]] const std::vector<Recti>& areas() const
+    {
+        return m_areas;
+    }
+
+    // Sums of the last published sweep, one per probe
+    [[nodiscard]] const std::vector<double>& values() const
+    {
+        return m_values;
+    }
+
+    // Zeroed sums for one block
+    [[nodiscard]] std::vector<double> block_sums() const
+    {
+        return std::vector<double>(m_areas.size(), 0.0);
+    }
+
+    // Adds value(i) of the probe cells with row-major index in [start, end) to sums
+    template <typename Value>
+    void sample_range(std::vector<double>& sums, const size_t start, const size_t end, const Value& value) const
+    {
+        if (start >= end) {
+            return;
+        }
+        const int first_row = static_cast<int>(start / c_size);
+        const int last_row = static_cast<int>((end - 1) / c_size);
+        for (size_t probe = 0; probe < m_areas.size(); ++probe) {
+            const Recti& area = m_areas[probe];
+            double sum = 0.0;
+            for (int y = std::max(area.y, first_row); y <= std::min(area.y + area.height - 1, last_row); ++y) {
+                const size_t row = static_cast<size_t>(y) * c_size;
+                const size_t cell_end = std::min(row + area.x + area.width, end);
+                for (size_t i = std::max(row + area.x, start); i < cell_end; ++i) {
+                    sum += value(i);
+                }
+            }
+            sums[probe] += sum;
+        }
+    }
+
+    // Makes the blocks' sums, added up in block order, the new values
+    void publish(const std::vector<std::vector<double>>& blocks)
+    {
+        std::ranges::fill(m_values, 0.0);
+        for (const std::vector<double>& sums : blocks) {
+            for (size_t probe = 0; probe < m_values.size() && probe < sums.size(); ++probe) {
+                m_values[probe] += sums[probe];
+            }
+        }
+    }
+
+private:
+    const int c_size;
+    std::vector<Recti> m_areas;
+    std::vector<double> m_values;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// Fixed-size ring of the most recent samples. One thread pushes, any thread may take snapshots without locking.
+template <typename Sample, size_t Capacity>
+class SampleRing {
+    static_assert(std::is_trivially_copyable_v<Sample>);
+
+public:
+    SampleRing()
+        : m_samples()
+        , m_pushed(0)
+    {
+    }
+
+    void push(const Sample& sample)
+    {
+        const uint64_t pushed = m_pushed.load(std::memory_order_relaxed);
+        m_samples[pushed % Capacity] = sample;
+        m_pushed.store(pushed + 1, std::memory_order_release);
+    }
+
+    // Copies the samples in push order, oldest first. Samples the writer may have overwritten while copying are
+    // dropped, so a snapshot never mixes two generations of a slot.
+    void snapshot(std::vector<Sample>& out) const
+    {
+        out.clear();
+        const uint64_t pushed = m_pushed.load(std::memory_order_acquire);
+        const uint64_t first = pushed > Capacity ? pushed - Capacity : 0;
+        for (uint64_t i = first; i < pushed; ++i) {
+            out.push_back(m_samples[i % Capacity]);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t pushed_after = m_pushed.load(std::memory_order_relaxed);
+        if (const uint64_t overwritten = pushed_after > Capacity ? pushed_after - Capacity : 0; overwritten > first) {
+            out.erase(out.begin(), out.begin() + static_cast<std::ptrdiff_t>(std::min(overwritten - first, pushed - first)));
+        }
+    }
+
+private:
+    std::array<Sample, Capacity> m_samples;
+    std::atomic<uint64_t> m_pushed;
+};
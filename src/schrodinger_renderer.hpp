@@ -1,92 +1,129 @@
 #pragma once
 
 #include <complex>
+#include <vector>
 
 #include "BS_thread_pool.hpp"
 #include "raylib-cpp.hpp"
 
+#include "colormap.hpp"
 #include "common.hpp"
 #include "schrodinger_sim.hpp"
+#include "tile_activity.hpp"
+#include "trace.hpp"
 
 class SchrodingerRenderer {
 public:
     enum class Theme {
         probability,
         waves,
+        phase,
     };
 
     explicit SchrodingerRenderer(const int size)
         : c_size(size)
         , m_image(c_size, c_size, BLACK)
         , m_texture(m_image)
+        , m_wall_image(c_size, c_size, BLANK)
+        , m_wall_texture(m_wall_image)
+        , m_probability_colormap(Colormap::Preset::grayscale)
+        , m_wave_colormap()
+        , m_phase_colormap()
+        , m_last_view { 0, 0, 0, 0 }
+        , m_columns()
     {
     }
 
-    void update(SchrodingerSim& sim, const Theme theme)
+    // Colorizes the cells in view into an image of up to resolution x resolution pixels, sampling the nearest cell for
+    // each pixel. The texture is reallocated whenever the image size changes.
+    // Walls are kept in a separate transparent layer that is only redrawn where fixed cells changed.
+    void update(SchrodingerSim& sim, const Theme theme, const int resolution, const Recti view)
     {
+        TRACE_ZONE("SchrodingerRenderer::update");
+        const int image_width = std::clamp(resolution, 1, view.width);
+        const int image_height = std::clamp(resolution, 1, view.height);
+        bool full_wall_redraw = view != m_last_view;
+        if (image_width != m_image.width || image_height != m_image.height) {
+            m_image = raylib::Image(image_width, image_height, BLACK);
+            m_texture = raylib::Texture(m_image);
+            m_wall_image = raylib::Image(image_width, image_height, BLANK);
+            m_wall_texture = raylib::Texture(m_wall_image);
+            full_wall_redraw = true;
+        }
+        m_last_view = view;
+
         double prob_min = std::numeric_limits<double>::max();
         double prob_max = std::numeric_limits<double>::min();
         constexpr double wave_min = 0.0;
         constexpr double wave_max = 0.05;
         sim.lock_read();
-        for (int i = 0; i < c_size * c_size; ++i) {
-            const auto sim_value = sim.value_at_idx(i);
-            const auto abs = std::norm(sim_value);
-            // if (std::min(sim_value.real(), sim_value.imag()) < wave_min) {
-            //     wave_min = std::max(sim_value.real(), sim_value.imag());
-            // }
-            // if (std::max(sim_value.real(), sim_value.imag()) > wave_max) {
-            //     wave_max = std::max(sim_value.real(), sim_value.imag());
-            // }
-            if (abs > prob_max) {
-                prob_max = abs;
-            }
-            if (abs < prob_min) {
-                prob_min = abs;
-            }
+        for (BS::multi_future<std::pair<double, double>> block_ranges = m_thread_pool.submit_blocks<int>(
+                 view.y,
+                 view.y + view.height,
+                 [&](const int start, const int end) {
+                     TRACE_ZONE("range block");
+                     double block_min = std::numeric_limits<double>::max();
+                     double block_max = std::numeric_limits<double>::min();
+                     for (int y = start; y < end; ++y) {
+                         for (int x = view.x; x < view.x + view.width; ++x) {
+                             const double abs = std::norm(sim.value_at({ x, y }));
+                             block_min = std::min(block_min, abs);
+                             block_max = std::max(block_max, abs);
+                         }
+                     }
+                     return std::pair { block_min, block_max };
+                 });
+             std::future<std::pair<double, double>> & future : block_ranges) {
+            const auto [block_min, block_max] = future.get();
+            prob_min = std::min(prob_min, block_min);
+            prob_max = std::max(prob_max, block_max);
+        }
+        const double max_magnitude = std::sqrt(prob_max);
+        // the cell column each image column samples
+        m_columns.resize(image_width);
+        for (int x = 0; x < image_width; ++x) {
+            m_columns[x] = view.x + x * view.width / image_width;
         }
-        // wave_min = 0.0;
-        // wave_max = 0.05;
-        auto update_at = [&](const int i) {
-            const auto [x, y] = sim.idx_to_pos(i);
-            auto color = BLACK;
-            if (theme == Theme::probability) {
-                if (sim.fixed_at_idx(i)) {
-                    color = BLUE;
-                }
-                else {
-                    const double sim_value = std::norm(sim.value_at_idx(i));
-                    const auto intensity
-                        = static_cast<unsigned char>(std::clamp((sim_value - prob_min) / prob_max, 0.0, 1.0) * 255);
-                    color = { intensity, intensity, intensity, 255 };
-                }
-            }
-            else if (theme == Theme::waves) {
-                if (sim.fixed_at_idx(i)) {
-                    color = BLUE;
-                }
-                else {
-                    const std::complex<double> sim_value = sim.value_at_idx(i);
-                    const auto intensity_real = static_cast<unsigned char>(
-                        std::clamp((sim_value.real() - wave_min) / wave_max, 0.0, 1.0) * 255);
-                    const auto intensity_imag = static_cast<unsigned char>(
-                        std::clamp((sim_value.imag() - wave_min) / wave_max, 0.0, 1.0) * 255);
-                    color = { intensity_real, intensity_imag, 0, 255 };
-                }
-            }
-            static_cast<unsigned char*>(m_image.data)[(y * m_image.width + x) * 4] = color.r;
-            static_cast<unsigned char*>(m_image.data)[(y * m_image.width + x) * 4 + 1] = color.g;
-            static_cast<unsigned char*>(m_image.data)[(y * m_image.width + x) * 4 + 2] = color.b;
-            static_cast<unsigned char*>(m_image.data)[(y * m_image.width + x) * 4 + 3] = color.a;
-        };
 
-        m_thread_pool.detach_blocks<int>(0, c_size * c_size, [&](const int start, const int end) {
-            for (int i = start; i < end; ++i) {
-                update_at(i);
+        // each sampled row is reduced to the theme's values first, then mapped in one pass per colormap
+        m_thread_pool.detach_blocks<int>(0, image_height, [&](const int start, const int end) {
+            TRACE_ZONE("colorize block");
+            std::vector<double> first(image_width);
+            std::vector<double> second(theme == Theme::probability ? 0 : image_width);
+            for (int y = start; y < end; ++y) {
+                const int cell_y = view.y + y * view.height / image_height;
+                uint32_t* pixels = static_cast<uint32_t*>(m_image.data) + static_cast<size_t>(y) * image_width;
+                switch (theme) {
+                case Theme::probability:
+                    for (int x = 0; x < image_width; ++x) {
+                        first[x] = std::norm(sim.value_at_idx(sim.pos_to_idx({ m_columns[x], cell_y })));
+                    }
+                    m_probability_colormap.map_row(
+                        first.data(), pixels, image_width, prob_min, prob_min + prob_max, false);
+                    break;
+                case Theme::waves:
+                    for (int x = 0; x < image_width; ++x) {
+                        const std::complex<double> value = sim.value_at_idx(sim.pos_to_idx({ m_columns[x], cell_y }));
+                        first[x] = value.real();
+                        second[x] = value.imag();
+                    }
+                    m_wave_colormap.map_row(first.data(), second.data(), pixels, image_width, wave_min, wave_max);
+                    break;
+                case Theme::phase:
+                    for (int x = 0; x < image_width; ++x) {
+                        const std::complex<double> value = sim.value_at_idx(sim.pos_to_idx({ m_columns[x], cell_y }));
+                        first[x] = std::sqrt(std::norm(value));
+                        second[x] = std::atan2(value.imag(), value.real());
+                    }
+                    m_phase_colormap.map_row(first.data(), second.data(), pixels, image_width, max_magnitude);
+                    break;
+                }
             }
         });
         m_thread_pool.wait();
+        update_walls(sim, view, full_wall_redraw);
         sim.unlock_read();
+        TRACE_ZONE("SchrodingerRenderer upload");
         m_texture.Update(m_image.GetData());
     }
 
@@ -95,9 +132,88 @@ public:
         return m_texture;
     }
 
+    // Transparent except for wall pixels; same size as texture()
+    [[nodiscard]] const raylib::Texture& wall_texture() const
+    {
+        return m_wall_texture;
+    }
+
 private:
+    // First image column whose sampled cell is at or after cell x
+    [[nodiscard]] static int first_pixel_at(const int x, const int view_start, const int view_size, const int image_size)
+    {
+        const int offset = std::clamp(x - view_start, 0, view_size);
+        return (offset * image_size + view_size - 1) / view_size;
+    }
+
+    void update_walls(const SchrodingerSim& sim, const Recti view, const bool full_redraw)
+    {
+        const TileActivity& activity = sim.tile_activity();
+        if (m_tile_fixed_revision.size() != activity.tile_count()) {
+            m_tile_fixed_revision = std::vector<uint64_t>(activity.tile_count(), 0);
+        }
+        const int image_width = m_wall_image.width;
+        const int image_height = m_wall_image.height;
+        const uint32_t wall_color = pack_color(BLUE.r, BLUE.g, BLUE.b);
+        for (size_t t = 0; t < activity.tile_count(); ++t) {
+            if (!full_redraw && activity.fixed_revision(t) == m_tile_fixed_revision[t]) {
+                continue;
+            }
+            m_tile_fixed_revision[t] = activity.fixed_revision(t);
+            if (full_redraw) {
+                continue;
+            }
+            // pixels sampling a cell of this tile form a disjoint rectangle
+            const Recti tile = activity.tile_rect(t);
+            const int x0 = first_pixel_at(tile.x, view.x, view.width, image_width);
+            const int x1 = first_pixel_at(tile.x + tile.width, view.x, view.width, image_width);
+            const int y0 = first_pixel_at(tile.y, view.y, view.height, image_height);
+            const int y1 = first_pixel_at(tile.y + tile.height, view.y, view.height, image_height);
+            if (x0 < x1 && y0 < y1) {
+                draw_walls(sim, view, { x0, y0, x1 - x0, y1 - y0 }, wall_color);
+                m_upload_scratch.resize(static_cast<size_t>(x1 - x0) * (y1 - y0));
+                for (int y = y0; y < y1; ++y) {
+                    const uint32_t* src = static_cast<const uint32_t*>(m_wall_image.data) + y * image_width + x0;
+                    std::copy(src, src + (x1 - x0), m_upload_scratch.begin() + (y - y0) * (x1 - x0));
+                }
+                m_wall_texture.Update(
+                    Rectangle { static_cast<float>(x0),
+                                static_cast<float>(y0),
+                                static_cast<float>(x1 - x0),
+                                static_cast<float>(y1 - y0) },
+                    m_upload_scratch.data());
+            }
+        }
+        if (full_redraw) {
+            draw_walls(sim, view, { 0, 0, image_width, image_height }, wall_color);
+            m_wall_texture.Update(m_wall_image.data);
+        }
+    }
+
+    void draw_walls(const SchrodingerSim& sim, const Recti view, const Recti rect, const uint32_t wall_color)
+    {
+        const int image_width = m_wall_image.width;
+        const int image_height = m_wall_image.height;
+        for (int y = rect.y; y < rect.y + rect.height; ++y) {
+            for (int x = rect.x; x < rect.x + rect.width; ++x) {
+                const size_t i = sim.pos_to_idx(
+                    { view.x + x * view.width / image_width, view.y + y * view.height / image_height });
+                static_cast<uint32_t*>(m_wall_image.data)[y * image_width + x] = sim.fixed_at_idx(i) ? wall_color : 0;
+            }
+        }
+    }
+
     const int c_size;
     raylib::Image m_image;
     raylib::Texture m_texture;
+    raylib::Image m_wall_image;
+    raylib::Texture m_wall_texture;
+    Colormap m_probability_colormap;
+    TwoChannelColormap m_wave_colormap;
+    PhaseColormap m_phase_colormap;
+    Recti m_last_view;
+    std::vector<int> m_columns;
+    std::vector<uint64_t> m_tile_fixed_revision;
+    std::vector<uint32_t> m_upload_scratch;
     BS::thread_pool m_thread_pool;
 };
\ No newline at end of file
@@ -1,21 +1,44 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <complex>
+#include <cstdint>
+#include <cstring>
+#include <optional>
 #include <shared_mutex>
+#include <string>
 #include <vector>
 
 #include <BS_thread_pool.hpp>
 
+#include "checkpoint.hpp"
 #include "common.hpp"
+#include "perf_counters.hpp"
+#include "probe_set.hpp"
+#include "tile_activity.hpp"
+#include "trace.hpp"
 
 class SchrodingerSim {
 public:
+    enum class Integrator {
+        euler,
+        visscher,
+    };
+
+    enum class Layout {
+        interleaved,
+        split,
+    };
+
     struct Properties {
         int size = 512;
         double grid_spacing = 1.0;
         double timestep = 1.0;
         double hbar = 1.0;
         double mass = 1.0;
+        Integrator integrator = Integrator::euler;
+        Layout layout = Layout::interleaved;
     };
 
     explicit SchrodingerSim(const Properties& props)
@@ -24,10 +47,22 @@ public:
         , c_timestep(props.timestep)
         , c_hbar(props.hbar)
         , c_mass(props.mass)
-        , m_buffer_present(c_size * c_size, std::complex(0.0, 0.0))
-        , m_buffer_future(c_size * c_size, std::complex(0.0, 0.0))
+        , c_integrator(props.integrator)
+        , c_layout(props.integrator == Integrator::visscher ? Layout::split : props.layout)
+        , m_buffer_present(interleaved_buffer_size(), std::complex(0.0, 0.0))
+        , m_buffer_future(interleaved_buffer_size(), std::complex(0.0, 0.0))
+        , m_buffer_real_present(split_buffer_size(), 0.0)
+        , m_buffer_real_future(split_buffer_size(), 0.0)
+        , m_buffer_imag_present(split_buffer_size(), 0.0)
+        , m_buffer_imag_future(split_buffer_size(), 0.0)
         , m_buffer_potential(c_size * c_size, 0.0)
         , m_buffer_fixed(c_size * c_size, false)
+        , m_tile_activity(c_size)
+        , m_probes(c_size)
+        , m_revision(0)
+        , m_step(0)
+        , m_perf_counters()
+        , m_normalize_nanoseconds(0)
     {
     }
 
@@ -50,10 +85,27 @@ public:
 
     void update()
     {
+        TRACE_ZONE("SchrodingerSim::update");
+        if (c_integrator == Integrator::visscher) {
+            update_visscher();
+            m_revision.fetch_add(1, std::memory_order_relaxed);
+            m_step.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (c_layout == Layout::split) {
+            update_euler_split();
+            normalize();
+            m_revision.fetch_add(1, std::memory_order_relaxed);
+            m_step.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
         auto update_at = [&](const int i) { m_buffer_future[i] = future_at_idx(i); };
 
-        m_buffer_mutex.lock_shared();
+        lock_buffers_shared();
         m_thread_pool.detach_blocks<int>(0, c_size * c_size, [&](const int start, const int end) {
+            TRACE_ZONE("euler block");
+            PERF_SCOPE(m_perf_counters);
             for (int i = start; i < end; ++i) {
                 if (!m_buffer_fixed[i]) {
                     update_at(i);
@@ -62,15 +114,51 @@ public:
         });
         m_thread_pool.wait();
         m_buffer_mutex.unlock_shared();
-        m_buffer_mutex.lock();
+        lock_buffers();
         std::swap(m_buffer_present, m_buffer_future);
         m_buffer_mutex.unlock();
 
         normalize();
+        m_revision.fetch_add(1, std::memory_order_relaxed);
+        m_step.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Visscher keeps the imaginary part half a step ahead of the real part, so a state set at a single time t (as
+    // set_at and the initial packets do) starts with its phase off by dt / 2. This advances the imaginary part to
+    // t + dt / 2 with a half-size step of the same scheme; call it once after seeding. No-op for Euler.
+    void stagger_imaginary()
+    {
+        if (c_integrator != Integrator::visscher) {
+            return;
+        }
+        const double factor = c_timestep / (2.0 * c_hbar);
+        lock_buffers_shared();
+        m_thread_pool.detach_blocks<int>(0, c_size * c_size, [&](const int start, const int end) {
+            for (int i = start; i < end; ++i) {
+                m_buffer_imag_future[i] = m_buffer_fixed[i]
+                    ? m_buffer_imag_present[i]
+                    : m_buffer_imag_present[i] - factor * hamiltonian_at_idx(m_buffer_real_present, i);
+            }
+        });
+        m_thread_pool.wait();
+        m_buffer_mutex.unlock_shared();
+        lock_buffers();
+        std::swap(m_buffer_imag_present, m_buffer_imag_future);
+        m_buffer_mutex.unlock();
+        m_revision.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Changes whenever the state or fixed cells change, so readers can tell whether anything moved
+    [[nodiscard]] uint64_t revision() const
+    {
+        return m_revision.load(std::memory_order_relaxed);
     }
 
     [[nodiscard]] std::complex<double> value_at_idx(const size_t idx) const
     {
+        if (c_layout == Layout::split) {
+            return { m_buffer_real_present[idx], m_buffer_imag_present[idx] };
+        }
         return m_buffer_present[idx];
     }
 
@@ -81,6 +169,12 @@ public:
 
     void set_at(const Vector2i pos, const std::complex<double> value)
     {
+        m_revision.fetch_add(1, std::memory_order_relaxed);
+        if (c_layout == Layout::split) {
+            m_buffer_real_present[pos_to_idx(pos)] = value.real();
+            m_buffer_imag_present[pos_to_idx(pos)] = value.imag();
+            return;
+        }
         m_buffer_present[pos_to_idx(pos)] = value;
     }
 
@@ -94,8 +188,134 @@ public:
         return c_hbar;
     }
 
+    [[nodiscard]] Properties properties() const
+    {
+        return { .size = c_size,
+                 .grid_spacing = c_grid_spacing,
+                 .timestep = c_timestep,
+                 .hbar = c_hbar,
+                 .mass = c_mass,
+                 .integrator = c_integrator,
+                 .layout = c_layout };
+    }
+
+    // Number of updates since construction or the loaded checkpoint
+    [[nodiscard]] uint64_t step() const
+    {
+        return m_step.load(std::memory_order_relaxed);
+    }
+
+    // Writes the properties, step count, present state in the sim's layout, potential and fixed mask.
+    // Returns false on failure.
+    bool save_checkpoint(const std::string& path, const CheckpointCodec codec = CheckpointCodec::raw)
+    {
+        lock_buffers_shared();
+        const std::vector<uint8_t> fixed(m_buffer_fixed.begin(), m_buffer_fixed.end());
+        CheckpointWriter writer = checkpoint_writer(fixed);
+#ifndef PLATFORM_WEB
+        const bool written
+            = codec == CheckpointCodec::lossless ? writer.write_lossless(path, m_thread_pool) : writer.write(path);
+#else
+        static_cast<void>(codec);
+        const bool written = writer.write(path);
+#endif
+        m_buffer_mutex.unlock_shared();
+        return written;
+    }
+
+    // A raw checkpoint in memory for KeyframeRing, replacing the contents of out
+    bool save_keyframe(std::vector<char>& out)
+    {
+        TRACE_ZONE("SchrodingerSim::save_keyframe");
+        lock_buffers_shared();
+        const std::vector<uint8_t> fixed(m_buffer_fixed.begin(), m_buffer_fixed.end());
+        const bool written = checkpoint_writer(fixed).write(out);
+        m_buffer_mutex.unlock_shared();
+        return written;
+    }
+
+    // Properties of a Schrodinger checkpoint, to construct a sim that can load it
+    [[nodiscard]] static std::optional<Properties> checkpoint_properties(const std::string& path)
+    {
+        const std::optional<MappedCheckpoint> checkpoint = MappedCheckpoint::open(path);
+        if (!checkpoint.has_value()) {
+            return std::nullopt;
+        }
+        return checkpoint_properties(checkpoint->header());
+    }
+
+    // Restores a checkpoint saved by a sim with the same properties. Returns false, leaving the state unchanged,
+    // if the file is missing, damaged or from a sim with other properties.
+    bool load_checkpoint(const std::string& path)
+    {
+        TRACE_ZONE("SchrodingerSim::load_checkpoint");
+        const std::optional<MappedCheckpoint> checkpoint = MappedCheckpoint::open(path);
+        return checkpoint.has_value() && restore_checkpoint(*checkpoint);
+    }
+
+    // The state save_keyframe() writes, copied into storage so KeyframeRing can compress it on another thread
+    CheckpointWriter copy_keyframe(std::vector<char>& storage)
+    {
+        TRACE_ZONE("SchrodingerSim::copy_keyframe");
+        lock_buffers_shared();
+        const std::vector<uint8_t> fixed(m_buffer_fixed.begin(), m_buffer_fixed.end());
+        CheckpointWriter writer = checkpoint_writer(fixed);
+        writer.copy_sections(storage);
+        m_buffer_mutex.unlock_shared();
+        return writer;
+    }
+
+    // Restores what save_keyframe() or a copy_keyframe() writer wrote. Returns false, leaving the state unchanged, if
+    // it does not fit this sim.
+    bool load_keyframe(const std::vector<char>& keyframe)
+    {
+        TRACE_ZONE("SchrodingerSim::load_keyframe");
+        const std::optional<MappedCheckpoint> checkpoint = MappedCheckpoint::view(keyframe.data(), keyframe.size());
+        return checkpoint.has_value() && restore_checkpoint(*checkpoint);
+    }
+
+    // Time spent in normalize() since the last call, which update() includes for Euler
+    int64_t take_normalize_nanoseconds()
+    {
+        return m_normalize_nanoseconds.exchange(0, std::memory_order_relaxed);
+    }
+
+    // Hardware counter totals of the update kernels since the last call; all zero unless built with
+    // ENABLE_PERF_COUNTERS on Linux
+    perf::Counts take_perf_counts()
+    {
+        return m_perf_counters.take();
+    }
+
+    // Minimum memory traffic of one update per cell: the present state and potential are read and the future
+    // state written, once per pass for Visscher which updates the real and imaginary parts separately.
+    // Euler also normalizes, reading the state once for the sum and once more to scale it in place.
+    [[nodiscard]] double bytes_per_cell_update() const
+    {
+        if (c_integrator == Integrator::visscher) {
+            return 2.0 * 4.0 * sizeof(double);
+        }
+        return 2.0 * sizeof(std::complex<double>) + sizeof(double) + 3.0 * sizeof(std::complex<double>);
+    }
+
+    // Nominal floating point operations of one update per interior cell, counting each add, multiply and
+    // divide as one: 13 per fourth-order laplacian plus the integrator's own terms
+    [[nodiscard]] double flops_per_cell_update() const
+    {
+        if (c_integrator == Integrator::visscher) {
+            // per pass: laplacian, hamiltonian scale and potential term (4), leapfrog update (2)
+            return 2.0 * (13.0 + 4.0 + 2.0);
+        }
+        // two laplacians, the kinetic and potential terms (8), normalize sum (4) and scale (2)
+        return 2.0 * 13.0 + 8.0 + 4.0 + 2.0;
+    }
+
     void set_fixed_at(const Vector2i pos, const bool value)
     {
+        if (m_buffer_fixed[pos_to_idx(pos)] != value) {
+            m_tile_activity.touch_fixed(m_tile_activity.tile_idx(pos));
+            m_revision.fetch_add(1, std::memory_order_relaxed);
+        }
         m_buffer_fixed[pos_to_idx(pos)] = value;
     }
 
@@ -109,9 +329,39 @@ public:
         return m_buffer_fixed[idx];
     }
 
+    // Only fixed cell revisions are tracked; the normalized field changes everywhere every step
+    [[nodiscard]] const TileActivity& tile_activity() const
+    {
+        return m_tile_activity;
+    }
+
+    // Adds a probe summing |psi|^2 over a cell, line or area every step. Returns its index in probe_values().
+    // Probes are added and read by the thread that updates and normalizes the sim.
+    size_t add_probe(const Recti area)
+    {
+        return m_probes.add(area);
+    }
+
+    void clear_probes()
+    {
+        m_probes.clear();
+    }
+
+    [[nodiscard]] const std::vector<Recti>& probe_areas() const
+    {
+        return m_probes.areas();
+    }
+
+    // Probe sums of the state after the last step or normalize(). Visscher sums pair the real part with the
+    // imaginary part half a step later, as value_at() does.
+    [[nodiscard]] const std::vector<double>& probe_values() const
+    {
+        return m_probes.values();
+    }
+
     void lock_read()
     {
-        m_buffer_mutex.lock_shared();
+        lock_buffers_shared();
     }
 
     void unlock_read()
@@ -121,7 +371,7 @@ public:
 
     void lock_write()
     {
-        m_buffer_mutex.lock();
+        lock_buffers();
     }
 
     void unlock_write()
@@ -129,17 +379,325 @@ public:
         m_buffer_mutex.unlock();
     }
 
+    void normalize()
+    {
+        TRACE_ZONE("SchrodingerSim::normalize");
+        const auto start = std::chrono::steady_clock::now();
+        double sum = 0.0;
+        lock_buffers_shared();
+        for (BS::multi_future<double> block_sums = m_thread_pool.submit_blocks<int>(
+                 0,
+                 c_size * c_size,
+                 [&](const int start, const int end) {
+                     TRACE_ZONE("normalize sum block");
+                     PERF_SCOPE(m_perf_counters);
+                     double block_sum = 0.0;
+                     for (int i = start; i < end; ++i) {
+                         block_sum += std::norm(value_at_idx(i));
+                     }
+                     return block_sum;
+                 });
+             std::future<double> & future : block_sums) {
+            sum += future.get();
+        }
+        m_buffer_mutex.unlock_shared();
+        const double factor = std::sqrt(sum);
+        lock_buffers();
+        // the last pass over the state in a step, so it also samples the probes
+        BS::multi_future<std::vector<double>> probe_blocks = m_thread_pool.submit_blocks<int>(
+            0, c_size * c_size, [&](const int start, const int end) {
+                TRACE_ZONE("normalize scale block");
+                PERF_SCOPE(m_perf_counters);
+                for (int i = start; i < end; ++i) {
+                    if (c_layout == Layout::split) {
+                        m_buffer_real_present[i] /= factor;
+                        m_buffer_imag_present[i] /= factor;
+                    }
+                    else {
+                        m_buffer_present[i] /= factor;
+                    }
+                }
+                std::vector<double> probe_sums = m_probes.block_sums();
+                m_probes.sample_range(
+                    probe_sums, start, end, [&](const size_t i) { return std::norm(value_at_idx(i)); });
+                return probe_sums;
+            });
+        m_probes.publish(probe_blocks.get());
+        m_buffer_mutex.unlock();
+        m_normalize_nanoseconds.fetch_add(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(),
+            std::memory_order_relaxed);
+    }
+
     void clear()
     {
-        m_buffer_mutex.lock();
-        m_buffer_present = std::vector(c_size * c_size, std::complex(0.0, 0.0));
-        m_buffer_future = std::vector(c_size * c_size, std::complex(0.0, 0.0));
+        lock_buffers();
+        m_buffer_present = std::vector(interleaved_buffer_size(), std::complex(0.0, 0.0));
+        m_buffer_future = std::vector(interleaved_buffer_size(), std::complex(0.0, 0.0));
+        m_buffer_real_present = std::vector(split_buffer_size(), 0.0);
+        m_buffer_real_future = std::vector(split_buffer_size(), 0.0);
+        m_buffer_imag_present = std::vector(split_buffer_size(), 0.0);
+        m_buffer_imag_future = std::vector(split_buffer_size(), 0.0);
         m_buffer_potential = std::vector(c_size * c_size, 0.0);
         m_buffer_fixed = std::vector(c_size * c_size, false);
+        m_tile_activity.touch_all_fixed();
+        m_revision.fetch_add(1, std::memory_order_relaxed);
         m_buffer_mutex.unlock();
     }
 
 private:
+    // fixed holds the fixed mask as bytes and must outlive the writer. Buffers must be locked, shared at least.
+    [[nodiscard]] CheckpointWriter checkpoint_writer(const std::vector<uint8_t>& fixed) const
+    {
+        CheckpointHeader header {};
+        header.kind = CheckpointKind::schrodinger;
+        header.value_bytes = sizeof(double);
+        header.size = c_size;
+        header.step = m_step.load(std::memory_order_relaxed);
+        header.parameters = { c_grid_spacing, c_timestep, c_hbar, c_mass, 0.0, 0.0, 0.0, 0.0 };
+        header.options = { static_cast<uint32_t>(c_integrator), static_cast<uint32_t>(c_layout), 0, 0 };
+        CheckpointWriter writer(header);
+        if (c_layout == Layout::split) {
+            writer.add_section(
+                m_buffer_real_present.data(), m_buffer_real_present.size() * sizeof(double), sizeof(double));
+            writer.add_section(
+                m_buffer_imag_present.data(), m_buffer_imag_present.size() * sizeof(double), sizeof(double));
+        }
+        else {
+            writer.add_section(
+                m_buffer_present.data(), m_buffer_present.size() * sizeof(std::complex<double>), sizeof(double));
+        }
+        writer.add_section(m_buffer_potential.data(), m_buffer_potential.size() * sizeof(double), sizeof(double));
+        writer.add_section(fixed.data(), fixed.size());
+        return writer;
+    }
+
+    bool read_checkpoint_section(
+        const MappedCheckpoint& checkpoint, const size_t i, void* destination, const size_t bytes)
+    {
+#ifndef PLATFORM_WEB
+        return checkpoint.read_section(i, destination, bytes, nullptr, m_thread_pool);
+#else
+        return checkpoint.read_section(i, destination, bytes);
+#endif
+    }
+
+    bool restore_checkpoint(const MappedCheckpoint& checkpoint)
+    {
+        if (const std::optional<Properties> props = checkpoint_properties(checkpoint.header());
+            !props.has_value() || !same_properties(*props)) {
+            return false;
+        }
+        const size_t cells = static_cast<size_t>(c_size) * c_size;
+        const bool split = c_layout == Layout::split;
+        std::vector<double> real(split ? cells : 0);
+        std::vector<double> imag(split ? cells : 0);
+        std::vector<std::complex<double>> state(split ? 0 : cells);
+        std::vector<double> potential(cells);
+        std::vector<uint8_t> fixed(cells);
+        // the state is one section per part in the split layout and one interleaved section otherwise
+        const size_t state_sections = split ? 2 : 1;
+        const bool read
+            = (split ? read_checkpoint_section(checkpoint, 0, real.data(), cells * sizeof(double))
+                       && read_checkpoint_section(checkpoint, 1, imag.data(), cells * sizeof(double))
+                     : read_checkpoint_section(checkpoint, 0, state.data(), cells * sizeof(std::complex<double>)))
+            && read_checkpoint_section(checkpoint, state_sections, potential.data(), cells * sizeof(double))
+            && read_checkpoint_section(checkpoint, state_sections + 1, fixed.data(), cells);
+        if (!read) {
+            return false;
+        }
+        lock_buffers();
+        std::swap(m_buffer_real_present, real);
+        std::swap(m_buffer_imag_present, imag);
+        std::swap(m_buffer_present, state);
+        std::swap(m_buffer_potential, potential);
+        for (size_t i = 0; i < cells; ++i) {
+            m_buffer_fixed[i] = fixed[i] != 0;
+        }
+        m_tile_activity.touch_all_fixed();
+        m_step.store(checkpoint.header().step, std::memory_order_relaxed);
+        m_revision.fetch_add(1, std::memory_order_relaxed);
+        m_buffer_mutex.unlock();
+        return true;
+    }
+
+    [[nodiscard]] static std::optional<Properties> checkpoint_properties(const CheckpointHeader& header)
+    {
+        if (header.kind != CheckpointKind::schrodinger) {
+            return std::nullopt;
+        }
+        return Properties { .size = header.size,
+                            .grid_spacing = header.parameters[0],
+                            .timestep = header.parameters[1],
+                            .hbar = header.parameters[2],
+                            .mass = header.parameters[3],
+                            .integrator = static_cast<Integrator>(header.options[0]),
+                            .layout = static_cast<Layout>(header.options[1]) };
+    }
+
+    [[nodiscard]] bool same_properties(const Properties& props) const
+    {
+        return props.size == c_size && props.grid_spacing == c_grid_spacing && props.timestep == c_timestep
+            && props.hbar == c_hbar && props.mass == c_mass && props.integrator == c_integrator
+            && props.layout == c_layout;
+    }
+
+    // Lock acquisition goes through these so waits on the buffer mutex show up in traces
+    void lock_buffers_shared()
+    {
+        TRACE_ZONE("SchrodingerSim lock wait (shared)");
+        m_buffer_mutex.lock_shared();
+    }
+
+    void lock_buffers()
+    {
+        TRACE_ZONE("SchrodingerSim lock wait");
+        m_buffer_mutex.lock();
+    }
+
+    [[nodiscard]] size_t interleaved_buffer_size() const
+    {
+        return c_layout == Layout::interleaved ? c_size * c_size : 0;
+    }
+
+    [[nodiscard]] size_t split_buffer_size() const
+    {
+        return c_layout == Layout::split ? c_size * c_size : 0;
+    }
+
+    // Same fourth-order stencil as spatial_derivative_precise_at_idx but on a single real plane
+    [[nodiscard]] double laplacian_precise_at_idx(const std::vector<double>& buffer, const size_t idx) const
+    {
+        constexpr std::array<std::pair<int, double>, 4> stencil { {
+            { 2, -1.0 },
+            { 1, 16.0 },
+            { -1, 16.0 },
+            { -2, -1.0 },
+        } };
+        double neighbor_sum = 0.0;
+        const auto [x, y] = idx_to_pos(idx);
+        if (x >= 2 && x < c_size - 2 && y >= 2 && y < c_size - 2) {
+            // interior cells skip the bounds checks so the loop over a row stays branch-free
+            const size_t row = c_size;
+            neighbor_sum = 16.0 * (buffer[idx - 1] + buffer[idx + 1] + buffer[idx - row] + buffer[idx + row])
+                - (buffer[idx - 2] + buffer[idx + 2] + buffer[idx - 2 * row] + buffer[idx + 2 * row]);
+        }
+        else {
+            for (const auto& [offset, coeff] : stencil) {
+                if (const Vector2i neighbor { x + offset, y }; in_bounds(neighbor)) {
+                    neighbor_sum += coeff * buffer[pos_to_idx(neighbor)];
+                }
+            }
+            for (const auto& [offset, coeff] : stencil) {
+                if (const Vector2i neighbor { x, y + offset }; in_bounds(neighbor)) {
+                    neighbor_sum += coeff * buffer[pos_to_idx(neighbor)];
+                }
+            }
+        }
+        const double numerator = neighbor_sum - 60.0 * buffer[idx];
+        const double denominator = 12.0 * c_grid_spacing * c_grid_spacing;
+        return numerator / denominator;
+    }
+
+    // Same scheme as future_at_idx with the multiplication by i expanded into real arithmetic
+    void update_euler_split()
+    {
+        const double kinetic_factor = c_timestep / c_hbar * kinetic_coefficient();
+        const double potential_factor = c_timestep / c_hbar;
+
+        lock_buffers_shared();
+        m_thread_pool.detach_blocks<int>(0, c_size * c_size, [&](const int start, const int end) {
+            TRACE_ZONE("euler split block");
+            PERF_SCOPE(m_perf_counters);
+            for (int i = start; i < end; ++i) {
+                if (!m_buffer_fixed[i]) {
+                    const double real = m_buffer_real_present[i];
+                    const double imag = m_buffer_imag_present[i];
+                    const double potential = potential_factor * m_buffer_potential[i];
+                    m_buffer_real_future[i]
+                        = real - kinetic_factor * laplacian_precise_at_idx(m_buffer_imag_present, i) + potential * imag;
+                    m_buffer_imag_future[i]
+                        = imag + kinetic_factor * laplacian_precise_at_idx(m_buffer_real_present, i) - potential * real;
+                }
+            }
+        });
+        m_thread_pool.wait();
+        m_buffer_mutex.unlock_shared();
+        lock_buffers();
+        std::swap(m_buffer_real_present, m_buffer_real_future);
+        std::swap(m_buffer_imag_present, m_buffer_imag_future);
+        m_buffer_mutex.unlock();
+    }
+
+    // hbar^2 / 2m, the factor on the laplacian in the hamiltonian; shared by every integrator
+    [[nodiscard]] double kinetic_coefficient() const
+    {
+        return c_hbar * c_hbar / (2.0 * c_mass);
+    }
+
+    [[nodiscard]] double hamiltonian_at_idx(const std::vector<double>& buffer, const size_t idx) const
+    {
+        return -kinetic_coefficient() * laplacian_precise_at_idx(buffer, idx)
+            + m_buffer_potential[idx] * buffer[idx];
+    }
+
+    // Visscher leapfrog: the real part lives at whole steps and the imaginary part at half steps.
+    // R(t + dt) = R(t) + dt / hbar * H I(t + dt / 2)
+    // I(t + 3dt / 2) = I(t + dt / 2) - dt / hbar * H R(t + dt)
+    // The scheme is stable for dt < 2 hbar / E_max and conserves the norm, so no normalize pass is needed.
+    void update_visscher()
+    {
+        const double factor = c_timestep / c_hbar;
+
+        lock_buffers_shared();
+        m_thread_pool.detach_blocks<int>(0, c_size * c_size, [&](const int start, const int end) {
+            TRACE_ZONE("visscher real block");
+            PERF_SCOPE(m_perf_counters);
+            for (int i = start; i < end; ++i) {
+                if (!m_buffer_fixed[i]) {
+                    m_buffer_real_future[i]
+                        = m_buffer_real_present[i] + factor * hamiltonian_at_idx(m_buffer_imag_present, i);
+                }
+                else {
+                    m_buffer_real_future[i] = m_buffer_real_present[i];
+                }
+            }
+        });
+        m_thread_pool.wait();
+        m_buffer_mutex.unlock_shared();
+        lock_buffers();
+        std::swap(m_buffer_real_present, m_buffer_real_future);
+        m_buffer_mutex.unlock();
+
+        lock_buffers_shared();
+        // the last pass over the state in a step, so it also samples the probes
+        BS::multi_future<std::vector<double>> probe_blocks = m_thread_pool.submit_blocks<int>(
+            0, c_size * c_size, [&](const int start, const int end) {
+                TRACE_ZONE("visscher imag block");
+                PERF_SCOPE(m_perf_counters);
+                for (int i = start; i < end; ++i) {
+                    if (!m_buffer_fixed[i]) {
+                        m_buffer_imag_future[i]
+                            = m_buffer_imag_present[i] - factor * hamiltonian_at_idx(m_buffer_real_present, i);
+                    }
+                    else {
+                        m_buffer_imag_future[i] = m_buffer_imag_present[i];
+                    }
+                }
+                std::vector<double> probe_sums = m_probes.block_sums();
+                m_probes.sample_range(probe_sums, start, end, [&](const size_t i) {
+                    return m_buffer_real_present[i] * m_buffer_real_present[i]
+                        + m_buffer_imag_future[i] * m_buffer_imag_future[i];
+                });
+                return probe_sums;
+            });
+        m_probes.publish(probe_blocks.get());
+        m_buffer_mutex.unlock_shared();
+        lock_buffers();
+        std::swap(m_buffer_imag_present, m_buffer_imag_future);
+        m_buffer_mutex.unlock();
+    }
+
     [[nodiscard]] std::complex<double> spatial_derivative_precise_at_idx(const size_t idx) const
     {
         constexpr std::array<std::pair<int, double>, 4> stencil { {
@@ -183,50 +741,34 @@ private:
     [[nodiscard]] std::complex<double> future_at_idx(const size_t idx) const
     {
         constexpr auto i = std::complex(0.0, 1.0);
-        const auto first_term = i * c_timestep * (c_hbar / 2 * c_mass) * spatial_derivative_precise_at_idx(idx);
+        const double kinetic_factor = c_timestep / c_hbar * kinetic_coefficient();
+        const auto first_term = i * kinetic_factor * spatial_derivative_precise_at_idx(idx);
         const auto second_term = -(i / c_hbar) * c_timestep * m_buffer_potential[idx] * m_buffer_present[idx];
         const auto third_term = m_buffer_present[idx];
         return first_term + second_term + third_term;
     }
 
-    void normalize()
-    {
-        double sum = 0.0;
-        m_buffer_mutex.lock_shared();
-        for (BS::multi_future<double> block_sums = m_thread_pool.submit_blocks<int>(
-                 0,
-                 c_size * c_size,
-                 [&](const int start, const int end) {
-                     double block_sum = 0.0;
-                     for (int i = start; i < end; ++i) {
-                         block_sum += std::norm(m_buffer_present[i]);
-                     }
-                     return block_sum;
-                 });
-             std::future<double> & future : block_sums) {
-            sum += future.get();
-        }
-        m_buffer_mutex.unlock_shared();
-        const double factor = std::sqrt(sum);
-        m_buffer_mutex.lock();
-        m_thread_pool.detach_blocks(0, c_size * c_size, [&](const int start, const int end) {
-            for (int i = start; i < end; ++i) {
-                m_buffer_present[i] /= factor;
-            }
-        });
-        m_thread_pool.wait();
-        m_buffer_mutex.unlock();
-    }
-
     const int c_size;
     const double c_grid_spacing;
     const double c_timestep;
     const double c_hbar;
     const double c_mass;
+    const Integrator c_integrator;
+    const Layout c_layout;
     std::vector<std::complex<double>> m_buffer_present;
     std::vector<std::complex<double>> m_buffer_future;
+    std::vector<double> m_buffer_real_present;
+    std::vector<double> m_buffer_real_future;
+    std::vector<double> m_buffer_imag_present;
+    std::vector<double> m_buffer_imag_future;
     std::vector<double> m_buffer_potential;
     std::vector<bool> m_buffer_fixed;
+    TileActivity m_tile_activity;
+    ProbeSet m_probes;
+    std::atomic<uint64_t> m_revision;
+    std::atomic<uint64_t> m_step;
+    perf::CounterTotals m_perf_counters;
+    std::atomic<int64_t> m_normalize_nanoseconds;
     BS::thread_pool m_thread_pool;
     std::shared_mutex m_buffer_mutex;
 };
\ No newline at end of file
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "common.hpp"
+
+// Per-tile change bookkeeping for a square grid so consumers can skip tiles that did not change.
+// All counters only ever grow: a consumer remembers the values it last saw for a tile and compares.
+// Each tile is written by at most one thread at a time (sims split their sweeps along tile rows).
+class TileActivity {
+public:
+    static constexpr int sc_tile_size = 32;
+
+    explicit TileActivity(const int size)
+        : c_size(size)
+        , c_tiles_per_side((size + sc_tile_size - 1) / sc_tile_size)
+        , m_change(c_tiles_per_side * c_tiles_per_side, 0.0)
+        , m_revision(c_tiles_per_side * c_tiles_per_side, 0)
+        , m_fixed_revision(c_tiles_per_side * c_tiles_per_side, 0)
+    {
+    }
+
+    [[nodiscard]] int tiles_per_side() const
+    {
+        return c_tiles_per_side;
+    }
+
+    [[nodiscard]] size_t tile_count() const
+    {
+        return m_change.size();
+    }
+
+    [[nodiscard]] size_t tile_idx(const Vector2i pos) const
+    {
+        return pos.y / sc_tile_size * c_tiles_per_side + pos.x / sc_tile_size;
+    }
+
+    // Cells covered by the tile, clipped to the grid
+    [[nodiscard]] Recti tile_rect(const size_t tile) const
+    {
+        const int x = static_cast<int>(tile % c_tiles_per_side) * sc_tile_size;
+        const int y = static_cast<int>(tile / c_tiles_per_side) * sc_tile_size;
+        return { x, y, std::min(sc_tile_size, c_size - x), std::min(sc_tile_size, c_size - y) };
+    }
+
+    // Sum of the largest absolute value change in the tile over every step and edit so far
+    [[nodiscard]] double change(const size_t tile) const
+    {
+        return m_change[tile];
+    }
+
+    void add_change(const size_t tile, const double magnitude)
+    {
+        m_change[tile] += magnitude;
+        if (magnitude != 0.0) {
+            ++m_revision[tile];
+        }
+    }
+
+    // Incremented by every non-zero change, however small next to the change sum, so an unchanged revision means
+    // the tile's values are unchanged (up to the sign of zeros)
+    [[nodiscard]] uint64_t revision(const size_t tile) const
+    {
+        return m_revision[tile];
+    }
+
+    // Incremented whenever a fixed cell in the tile is added or removed
+    [[nodiscard]] uint64_t fixed_revision(const size_t tile) const
+    {
+        return m_fixed_revision[tile];
+    }
+
+    void touch_fixed(const size_t tile)
+    {
+        ++m_fixed_revision[tile];
+    }
+
+    void touch_all_fixed()
+    {
+        for (uint64_t& revision : m_fixed_revision) {
+            ++revision;
+        }
+    }
+
+private:
+    const int c_size;
+    const int c_tiles_per_side;
+    std::vector<double> m_change;
+    std::vector<uint64_t> m_revision;
+    std::vector<uint64_t> m_fixed_revision;
+};
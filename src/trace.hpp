@@ -0,0 +1,232 @@
+#pragma once
+
+// Scoped trace zones that can be dumped as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+// Zones compile to nothing unless ENABLE_TRACING is defined, and only record while a capture is running.
+
+#include <string>
+
+#ifdef ENABLE_TRACING
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#endif
+
+namespace trace {
+
+#ifdef ENABLE_TRACING
+
+class Tracer {
+public:
+    struct Event {
+        const char* name;
+        int64_t start_ns;
+        int64_t duration_ns;
+    };
+
+    // Events of one thread. The mutex is only contended while a capture is written out.
+    struct ThreadEvents {
+        int thread_id;
+        bool in_use;
+        std::mutex mutex;
+        std::vector<Event> events;
+    };
+
+    static Tracer& instance()
+    {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    [[nodiscard]] bool capturing() const
+    {
+        return m_capturing.load(std::memory_order_relaxed);
+    }
+
+    void start_capture()
+    {
+        const std::lock_guard lock(m_threads_mutex);
+        for (const std::unique_ptr<ThreadEvents>& thread : m_threads) {
+            const std::lock_guard thread_lock(thread->mutex);
+            thread->events.clear();
+        }
+        m_capturing.store(true, std::memory_order_relaxed);
+    }
+
+    // Stops capturing and writes everything recorded since start_capture(). Returns false if the file
+    // could not be written.
+    bool stop_capture(const std::string& path)
+    {
+        m_capturing.store(false, std::memory_order_relaxed);
+        std::ofstream file(path);
+        if (!file) {
+            return false;
+        }
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool first = true;
+        const std::lock_guard lock(m_threads_mutex);
+        for (const std::unique_ptr<ThreadEvents>& thread : m_threads) {
+            const std::lock_guard thread_lock(thread->mutex);
+            for (const Event& event : thread->events) {
+                file << (first ? "" : ",\n") << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                     << thread->thread_id << ",\"ts\":" << Microseconds { event.start_ns }
+                     << ",\"dur\":" << Microseconds { event.duration_ns } << "}";
+                first = false;
+            }
+            thread->events.clear();
+        }
+        file << "\n]}\n";
+        return static_cast<bool>(file);
+    }
+
+    [[nodiscard]] int64_t now_ns() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_epoch)
+            .count();
+    }
+
+    void record(const Event& event)
+    {
+        thread_local const ThreadSlot slot(*this);
+        ThreadEvents* thread = slot.events;
+        const std::lock_guard lock(thread->mutex);
+        if (thread->events.size() < sc_max_events_per_thread) {
+            thread->events.push_back(event);
+        }
+    }
+
+private:
+    static constexpr size_t sc_max_events_per_thread = 1 << 20;
+
+    // Nanoseconds written as microseconds with three decimals, exact however long the process has run
+    struct Microseconds {
+        int64_t ns;
+
+        friend std::ostream& operator<<(std::ostream& out, const Microseconds value)
+        {
+            const int64_t ns = std::max<int64_t>(value.ns, 0);
+            return out << ns / 1000 << '.' << std::setfill('0') << std::setw(3) << ns % 1000;
+        }
+    };
+
+    Tracer()
+        : m_capturing(false)
+        , m_epoch(std::chrono::steady_clock::now())
+    {
+    }
+
+    // Short-lived threads (e.g. std::async) hand their events back on exit so the next new thread reuses them
+    // under the same id instead of adding a trace row per thread ever started.
+    struct ThreadSlot {
+        explicit ThreadSlot(Tracer& tracer)
+            : tracer(tracer)
+            , events(tracer.acquire_thread_events())
+        {
+        }
+
+        ThreadSlot(const ThreadSlot&) = delete;
+        ThreadSlot& operator=(const ThreadSlot&) = delete;
+
+        ~ThreadSlot()
+        {
+            const std::lock_guard lock(tracer.m_threads_mutex);
+            events->in_use = false;
+        }
+
+        Tracer& tracer;
+        ThreadEvents* events;
+    };
+
+    ThreadEvents* acquire_thread_events()
+    {
+        const std::lock_guard lock(m_threads_mutex);
+        for (const std::unique_ptr<ThreadEvents>& thread : m_threads) {
+            if (!thread->in_use) {
+                thread->in_use = true;
+                return thread.get();
+            }
+        }
+        auto thread = std::make_unique<ThreadEvents>();
+        thread->thread_id = static_cast<int>(m_threads.size());
+        thread->in_use = true;
+        m_threads.push_back(std::move(thread));
+        return m_threads.back().get();
+    }
+
+    std::atomic<bool> m_capturing;
+    const std::chrono::steady_clock::time_point m_epoch;
+    std::mutex m_threads_mutex;
+    std::vector<std::unique_ptr<ThreadEvents>> m_threads;
+};
+
+// Records the time from construction to destruction under a name with static storage duration
+class Zone {
+public:
+    explicit Zone(const char* name)
+        : m_name(name)
+        , m_start_ns(Tracer::instance().capturing() ? Tracer::instance().now_ns() : -1)
+    {
+    }
+
+    Zone(const Zone&) = delete;
+    Zone& operator=(const Zone&) = delete;
+
+    ~Zone()
+    {
+        if (m_start_ns >= 0) {
+            Tracer& tracer = Tracer::instance();
+            tracer.record({ .name = m_name, .start_ns = m_start_ns, .duration_ns = tracer.now_ns() - m_start_ns });
+        }
+    }
+
+private:
+    const char* m_name;
+    int64_t m_start_ns;
+};
+
+inline bool capturing()
+{
+    return Tracer::instance().capturing();
+}
+
+inline void start_capture()
+{
+    Tracer::instance().start_capture();
+}
+
+inline bool stop_capture(const std::string& path)
+{
+    return Tracer::instance().stop_capture(path);
+}
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_ZONE(name) const trace::Zone TRACE_CONCAT(trace_zone_, __LINE__)(name)
+
+#else
+
+inline bool capturing()
+{
+    return false;
+}
+
+inline void start_capture()
+{
+}
+
+inline bool stop_capture(const std::string&)
+{
+    return false;
+}
+
+#define TRACE_ZONE(name) static_cast<void>(0)
+
+#endif
+
+}
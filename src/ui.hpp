@@ -1,5 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <string>
+
 class LabelledDropdown {
 public:
     explicit LabelledDropdown(std::string label)
@@ -45,4 +51,22 @@ private:
     std::string m_items_str;
     int m_active;
     bool m_edit_mode;
-};
\ No newline at end of file
+};
+
+// A slider over the steps from first to last, labelled with the present step. Returns the step it was dragged to.
+inline std::optional<uint64_t> timeline_scrubber(
+    const Rectangle rect, const uint64_t first, const uint64_t last, const uint64_t present)
+{
+    if (last <= first) {
+        return std::nullopt;
+    }
+    const auto range = static_cast<float>(last - first);
+    float value = static_cast<float>(std::clamp(present, first, last) - first);
+    const float before = value;
+    const std::string label = "Step " + std::to_string(present);
+    GuiSliderBar(rect, nullptr, label.c_str(), &value, 0.0f, range);
+    if (value == before) {
+        return std::nullopt;
+    }
+    return first + static_cast<uint64_t>(std::llround(std::clamp(value, 0.0f, range)));
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+
+#include "raylib-cpp.hpp"
+
+#include "common.hpp"
+
+// Zoomable and pannable square region of the sim grid shown in the sim's screen rectangle.
+// Zoom with the mouse wheel around the cursor and pan by dragging with the middle mouse button.
+class SimViewport {
+public:
+    explicit SimViewport(const int sim_size)
+        : c_sim_size(sim_size)
+        , m_zoom(1.0)
+        , m_center_x(sim_size / 2.0)
+        , m_center_y(sim_size / 2.0)
+    {
+    }
+
+    void handle_inputs(const raylib::Rectangle& screen_rect)
+    {
+        const raylib::Vector2 mouse_pos = GetMousePosition();
+        if (!screen_rect.CheckCollision(mouse_pos)) {
+            return;
+        }
+        if (const float wheel = GetMouseWheelMove(); wheel != 0.0f) {
+            const auto [before_x, before_y] = screen_to_sim_exact(mouse_pos, screen_rect);
+            m_zoom = std::clamp(m_zoom * std::pow(sc_zoom_step, wheel), 1.0, max_zoom());
+            const auto [after_x, after_y] = screen_to_sim_exact(mouse_pos, screen_rect);
+            // keep the cell under the cursor in place
+            m_center_x += before_x - after_x;
+            m_center_y += before_y - after_y;
+        }
+        if (IsMouseButtonDown(MOUSE_BUTTON_MIDDLE)) {
+            const raylib::Vector2 delta = GetMouseDelta();
+            const double cells_per_pixel = visible_size() / screen_rect.width;
+            m_center_x -= delta.x * cells_per_pixel;
+            m_center_y -= delta.y * cells_per_pixel;
+        }
+        clamp_center();
+    }
+
+    // Integer cell rectangle that is rendered; always fully inside the grid
+    [[nodiscard]] Recti visible() const
+    {
+        const int size = static_cast<int>(std::round(visible_size()));
+        const int x = std::clamp(static_cast<int>(std::round(m_center_x - size / 2.0)), 0, c_sim_size - size);
+        const int y = std::clamp(static_cast<int>(std::round(m_center_y - size / 2.0)), 0, c_sim_size - size);
+        return { x, y, size, size };
+    }
+
+    [[nodiscard]] std::optional<Vector2i> screen_to_sim(
+        const raylib::Vector2 screen_pos, const raylib::Rectangle& screen_rect) const
+    {
+        if (screen_rect.width <= 0.0f) {
+            return std::nullopt;
+        }
+        const Recti view = visible();
+        const raylib::Vector2 sim_pos_f
+            = (screen_pos - screen_rect.GetPosition()) * static_cast<float>(view.width) / screen_rect.width;
+        return Vector2i { view.x + static_cast<int>(std::floor(sim_pos_f.x)),
+                          view.y + static_cast<int>(std::floor(sim_pos_f.y)) };
+    }
+
+private:
+    static constexpr double sc_zoom_step = 1.25;
+    static constexpr int sc_min_visible_cells = 16;
+
+    [[nodiscard]] double max_zoom() const
+    {
+        return std::max(static_cast<double>(c_sim_size) / sc_min_visible_cells, 1.0);
+    }
+
+    [[nodiscard]] double visible_size() const
+    {
+        return c_sim_size / m_zoom;
+    }
+
+    [[nodiscard]] std::pair<double, double> screen_to_sim_exact(
+        const raylib::Vector2 screen_pos, const raylib::Rectangle& screen_rect) const
+    {
+        const double cells_per_pixel = visible_size() / screen_rect.width;
+        return { m_center_x + (screen_pos.x - screen_rect.x - screen_rect.width / 2.0) * cells_per_pixel,
+                 m_center_y + (screen_pos.y - screen_rect.y - screen_rect.height / 2.0) * cells_per_pixel };
+    }
+
+    void clamp_center()
+    {
+        const double half = visible_size() / 2.0;
+        m_center_x = std::clamp(m_center_x, half, c_sim_size - half);
+        m_center_y = std::clamp(m_center_y, half, c_sim_size - half);
+    }
+
+    const int c_sim_size;
+    double m_zoom;
+    double m_center_x;
+    double m_center_y;
+};
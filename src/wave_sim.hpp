@@ -1,12 +1,27 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
 
 #ifndef PLATFORM_WEB
 #include <BS_thread_pool.hpp>
 #endif
 
+#include "checkpoint.hpp"
+#include "colormap.hpp"
 #include "common.hpp"
+#include "perf_counters.hpp"
+#include "probe_set.hpp"
+#include "tile_activity.hpp"
+#include "trace.hpp"
 
 class WaveSim {
 public:
@@ -20,6 +35,16 @@ public:
         double damping_width = 50;
     };
 
+    // Where update() should colorize the new state, row by row while each row is still in cache
+    struct ColorTarget {
+        const Colormap* colormap;
+        double min;
+        double max;
+        bool absolute;
+        // size x size packed RGBA pixels
+        uint32_t* pixels;
+    };
+
     explicit WaveSim(const Properties& props)
         : c_size(props.size)
         , c_wave_speed(props.wave_speed)
@@ -32,16 +57,34 @@ public:
         , m_buffer_present(c_size * c_size, 0.0)
         , m_buffer_future(c_size * c_size, 0.0)
         , m_buffed_fixed(c_size * c_size, false)
+        , m_tile_activity(c_size)
+        , m_probes(c_size)
+        , m_probe_blocks()
+        , m_perf_counters()
+        , m_step(0)
+        , m_delta_base()
     {
     }
 
     void set_at(const Vector2i pos, const double value)
     {
+        m_tile_activity.add_change(m_tile_activity.tile_idx(pos), std::abs(value - m_buffer_present[pos_to_idx(pos)]));
         m_buffer_present[pos_to_idx(pos)] = value;
     }
 
+    // Sets the value one step before the present, which together with set_at() sets a cell's initial velocity.
+    // set_at() alone leaves the past value as it was, so a cell set from rest also gets a velocity.
+    void set_past_at(const Vector2i pos, const double value)
+    {
+        m_tile_activity.add_change(m_tile_activity.tile_idx(pos), std::abs(value - m_buffer_past[pos_to_idx(pos)]));
+        m_buffer_past[pos_to_idx(pos)] = value;
+    }
+
     void set_fixed_at(const Vector2i pos, const bool fixed)
     {
+        if (m_buffed_fixed[pos_to_idx(pos)] != fixed) {
+            m_tile_activity.touch_fixed(m_tile_activity.tile_idx(pos));
+        }
         m_buffed_fixed[pos_to_idx(pos)] = fixed;
     }
 
@@ -57,6 +100,7 @@ public:
 
     void add_at(const Vector2i pos, const double value)
     {
+        m_tile_activity.add_change(m_tile_activity.tile_idx(pos), std::abs(value));
         m_buffer_present[pos_to_idx(pos)] += value;
     }
 
@@ -70,9 +114,304 @@ public:
         return m_buffer_present[idx];
     }
 
-    void update()
+    // Contiguous present values of row y, for consumers that process a row at a time
+    [[nodiscard]] const double* row_data(const int y) const
+    {
+        return m_buffer_present.data() + static_cast<size_t>(y) * c_size;
+    }
+
+    [[nodiscard]] const TileActivity& tile_activity() const
+    {
+        return m_tile_activity;
+    }
+
+    // Adds a probe summing the values of a cell, line or area every step. Returns its index in probe_values().
+    size_t add_probe(const Recti area)
+    {
+        return m_probes.add(area);
+    }
+
+    void clear_probes()
+    {
+        m_probes.clear();
+    }
+
+    [[nodiscard]] const std::vector<Recti>& probe_areas() const
+    {
+        return m_probes.areas();
+    }
+
+    // Probe sums of the state reached by the last forward step; edits, loads and steps backward leave them as they are
+    [[nodiscard]] const std::vector<double>& probe_values() const
+    {
+        return m_probes.values();
+    }
+
+    [[nodiscard]] int size() const
+    {
+        return c_size;
+    }
+
+    [[nodiscard]] Properties properties() const
+    {
+        return { .size = c_size,
+                 .wave_speed = c_wave_speed,
+                 .grid_spacing = c_grid_spacing,
+                 .timestep = c_timestep,
+                 .loss = c_loss,
+                 .damping_strength = c_damping_strength,
+                 .damping_width = c_damping_width };
+    }
+
+    // Number of updates since construction or the loaded checkpoint, less the steps taken back
+    [[nodiscard]] uint64_t step() const
+    {
+        return m_step;
+    }
+
+    // Whether the leapfrog can run backwards, which needs a sim without loss or damping
+    [[nodiscard]] bool reversible() const
+    {
+        return c_loss == 1.0 && (c_damping_strength == 0.0 || c_damping_width <= 0.0);
+    }
+
+    // Returns to the state one step earlier by swapping past and present and stepping again, which retraces the
+    // steps up to rounding. Edits are not undone, so stepping back past one leads elsewhere than the run came from;
+    // KeyframeRing::step_backward() stops at them and rewinds sims that are not reversible. Returns false, leaving
+    // the state unchanged, at step 0 or if the sim is not reversible.
+    bool step_backward()
+    {
+        TRACE_ZONE("WaveSim::step_backward");
+        if (m_step == 0 || !reversible()) {
+            return false;
+        }
+        std::swap(m_buffer_past, m_buffer_present);
+        // computes the state two steps back into the future buffer, tracking the change of the past values
+        compute_next();
+        std::swap(m_buffer_past, m_buffer_future);
+        // the future buffer now holds the present values from before
+        track_changes(m_buffer_future, m_buffer_present);
+        --m_step;
+        return true;
+    }
+
+    // Writes the properties, step count, past and present values and the fixed mask. Returns false on failure.
+    // With the lossless codec the present values are stored as their difference from the past ones; web builds
+    // always write raw checkpoints.
+    bool save_checkpoint(const std::string& path, const CheckpointCodec codec = CheckpointCodec::raw)
+    {
+        TRACE_ZONE("WaveSim::save_checkpoint");
+        const std::vector<uint8_t> fixed(m_buffed_fixed.begin(), m_buffed_fixed.end());
+        CheckpointWriter writer = full_checkpoint_writer(fixed);
+        return write_checkpoint(writer, path, codec);
+    }
+
+    // A raw checkpoint in memory for KeyframeRing, replacing the contents of out
+    bool save_keyframe(std::vector<char>& out)
+    {
+        TRACE_ZONE("WaveSim::save_keyframe");
+        const std::vector<uint8_t> fixed(m_buffed_fixed.begin(), m_buffed_fixed.end());
+        return full_checkpoint_writer(fixed).write(out);
+    }
+
+    // The state save_keyframe() writes, copied into storage so KeyframeRing can compress it on another thread
+    CheckpointWriter copy_keyframe(std::vector<char>& storage)
+    {
+        TRACE_ZONE("WaveSim::copy_keyframe");
+        const std::vector<uint8_t> fixed(m_buffed_fixed.begin(), m_buffed_fixed.end());
+        CheckpointWriter writer = full_checkpoint_writer(fixed);
+        writer.copy_sections(storage);
+        return writer;
+    }
+
+    // Restores what save_keyframe() or a copy_keyframe() writer wrote. Returns false, leaving the state unchanged, if
+    // it does not fit this sim.
+    bool load_keyframe(const std::vector<char>& keyframe)
     {
+        TRACE_ZONE("WaveSim::load_keyframe");
+        const std::optional<MappedCheckpoint> checkpoint = MappedCheckpoint::view(keyframe.data(), keyframe.size());
+        return checkpoint.has_value() && load_full_checkpoint(*checkpoint);
+    }
+
+    // Makes the present state the base of delta checkpoints, replacing the previous base, and returns a token naming
+    // it. Call right after saving or loading the full checkpoint the deltas will be applied to; whoever owns that
+    // checkpoint passes the token to the delta functions, so other full saves and loads do not move the base.
+    uint64_t mark_delta_base()
+    {
+        DeltaBase base {
+            .token = next_delta_base_token(), .step = m_step, .revisions = {}, .fixed_revisions = {}, .unsettled = {}
+        };
+        for (size_t tile = 0; tile < m_tile_activity.tile_count(); ++tile) {
+            base.revisions.push_back(m_tile_activity.revision(tile));
+            base.fixed_revisions.push_back(m_tile_activity.fixed_revision(tile));
+            const auto [x, y, width, height] = m_tile_activity.tile_rect(tile);
+            bool unsettled = false;
+            for (int row = y; row < y + height && !unsettled; ++row) {
+                const size_t start = pos_to_idx({ x, row });
+                unsettled = std::memcmp(
+                                m_buffer_past.data() + start, m_buffer_present.data() + start, width * sizeof(double))
+                    != 0;
+            }
+            base.unsettled.push_back(unsettled ? 1 : 0);
+        }
+        m_delta_base = std::move(base);
+        return m_delta_base->token;
+    }
 
+    // Whether the base named by token is still the sim's delta base
+    [[nodiscard]] bool has_delta_base(const uint64_t token) const
+    {
+        return m_delta_base.has_value() && m_delta_base->token == token;
+    }
+
+    // Writes only the tiles that changed since the base named by base_token, which load_delta_checkpoint() applies on
+    // top of the base's full checkpoint. Returns false on failure or if that base was replaced.
+    bool save_delta_checkpoint(
+        const std::string& path, const uint64_t base_token, const CheckpointCodec codec = CheckpointCodec::raw)
+    {
+        TRACE_ZONE("WaveSim::save_delta_checkpoint");
+        if (!has_delta_base(base_token)) {
+            return false;
+        }
+        std::vector<uint32_t> tiles;
+        for (size_t tile = 0; tile < m_tile_activity.tile_count(); ++tile) {
+            // the past values of a tile that was still moving at the base changed one step later
+            if (m_tile_activity.revision(tile) != m_delta_base->revisions[tile]
+                || m_tile_activity.fixed_revision(tile) != m_delta_base->fixed_revisions[tile]
+                || (m_delta_base->unsettled[tile] != 0 && m_step != m_delta_base->step)) {
+                tiles.push_back(static_cast<uint32_t>(tile));
+            }
+        }
+        std::vector<double> past;
+        std::vector<double> present;
+        std::vector<uint8_t> fixed;
+        for (const uint32_t tile : tiles) {
+            const auto [x, y, width, height] = m_tile_activity.tile_rect(tile);
+            for (int row = y; row < y + height; ++row) {
+                const size_t start = pos_to_idx({ x, row });
+                past.insert(past.end(), m_buffer_past.begin() + start, m_buffer_past.begin() + start + width);
+                present.insert(present.end(), m_buffer_present.begin() + start, m_buffer_present.begin() + start + width);
+                fixed.insert(fixed.end(), m_buffed_fixed.begin() + start, m_buffed_fixed.begin() + start + width);
+            }
+        }
+        CheckpointHeader header = checkpoint_header(CheckpointKind::wave_delta);
+        header.base_step = m_delta_base->step;
+        CheckpointWriter writer(header);
+        writer.add_section(tiles.data(), tiles.size() * sizeof(uint32_t), sizeof(uint32_t));
+        writer.add_section(past.data(), past.size() * sizeof(double), sizeof(double));
+        writer.add_section(present.data(), present.size() * sizeof(double), sizeof(double), 1);
+        writer.add_section(fixed.data(), fixed.size());
+        return write_checkpoint(writer, path, codec);
+    }
+
+    // Properties of a wave checkpoint, to construct a sim that can load it
+    [[nodiscard]] static std::optional<Properties> checkpoint_properties(const std::string& path)
+    {
+        const std::optional<MappedCheckpoint> checkpoint = MappedCheckpoint::open(path);
+        if (!checkpoint.has_value()) {
+            return std::nullopt;
+        }
+        return checkpoint_properties(checkpoint->header());
+    }
+
+    // Restores a checkpoint saved by a sim with the same properties. Returns false, leaving the state unchanged,
+    // if the file is missing, damaged or from a sim with other properties.
+    bool load_checkpoint(const std::string& path)
+    {
+        TRACE_ZONE("WaveSim::load_checkpoint");
+        const std::optional<MappedCheckpoint> checkpoint = MappedCheckpoint::open(path);
+        return checkpoint.has_value() && load_full_checkpoint(*checkpoint);
+    }
+
+    // Applies a delta checkpoint to the full checkpoint it was taken against, which must be what the sim holds, with
+    // base_token naming it as the delta base. Returns false, leaving the state unchanged, if the file is missing,
+    // damaged or belongs to another base.
+    bool load_delta_checkpoint(const std::string& path, const uint64_t base_token)
+    {
+        TRACE_ZONE("WaveSim::load_delta_checkpoint");
+        const std::optional<MappedCheckpoint> checkpoint = MappedCheckpoint::open(path);
+        if (!checkpoint.has_value() || checkpoint->header().kind != CheckpointKind::wave_delta
+            || !has_delta_base(base_token) || m_delta_base->step != checkpoint->header().base_step
+            || m_step != m_delta_base->step) {
+            return false;
+        }
+        if (const std::optional<Properties> props = checkpoint_properties(checkpoint->header());
+            !props.has_value() || !same_properties(*props)) {
+            return false;
+        }
+        const CheckpointSection& tile_section = checkpoint->header().sections[0];
+        std::vector<uint32_t> tiles(tile_section.raw_bytes / sizeof(uint32_t));
+        if (!read_checkpoint_section(*checkpoint, 0, tiles.data(), tiles.size() * sizeof(uint32_t), nullptr)) {
+            return false;
+        }
+        size_t cells = 0;
+        for (const uint32_t tile : tiles) {
+            if (tile >= m_tile_activity.tile_count()) {
+                return false;
+            }
+            const Recti rect = m_tile_activity.tile_rect(tile);
+            cells += static_cast<size_t>(rect.width) * rect.height;
+        }
+        std::vector<double> past(cells);
+        std::vector<double> present(cells);
+        std::vector<uint8_t> fixed(cells);
+        if (!read_checkpoint_section(*checkpoint, 1, past.data(), cells * sizeof(double), nullptr)
+            || !read_checkpoint_section(*checkpoint, 2, present.data(), cells * sizeof(double), past.data())
+            || !read_checkpoint_section(*checkpoint, 3, fixed.data(), cells, nullptr)) {
+            return false;
+        }
+        size_t next = 0;
+        for (const uint32_t tile : tiles) {
+            const auto [x, y, width, height] = m_tile_activity.tile_rect(tile);
+            double change = 0.0;
+            for (int row = y; row < y + height; ++row) {
+                for (size_t i = pos_to_idx({ x, row }); i < pos_to_idx({ x + width, row }); ++i, ++next) {
+                    change = std::max(change, std::abs(present[next] - m_buffer_present[i]));
+                    m_buffer_past[i] = past[next];
+                    m_buffer_present[i] = present[next];
+                    m_buffed_fixed[i] = fixed[next] != 0;
+                }
+            }
+            // the tile differs from the base whatever the values, so later deltas must include it
+            m_tile_activity.add_change(tile, std::max(change, std::numeric_limits<double>::min()));
+            m_tile_activity.touch_fixed(tile);
+        }
+        m_step = checkpoint->header().step;
+        return true;
+    }
+
+    // Hardware counter totals of the update kernels since the last call; all zero unless built with
+    // ENABLE_PERF_COUNTERS on Linux
+    perf::Counts take_perf_counts()
+    {
+        return m_perf_counters.take();
+    }
+
+    // Minimum memory traffic of one update per cell: past and present are read, future is written
+    [[nodiscard]] static constexpr double bytes_per_cell_update()
+    {
+        return 3.0 * sizeof(double);
+    }
+
+    // Nominal floating point operations of one update per interior cell, counting each add, multiply and
+    // divide as one: laplacian (8), leapfrog step (7), damping (6), loss (1) and tile change tracking (3)
+    [[nodiscard]] static constexpr double flops_per_cell_update()
+    {
+        return 25.0;
+    }
+
+    void update(const std::optional<ColorTarget>& color_target = std::nullopt)
+    {
+        compute_next(color_target);
+        advance();
+    }
+
+    // First half of update(): computes the next state from the present and past without changing either, so other
+    // threads may keep reading the present state (row_data, value_at) until advance() is called.
+    // Edits and tile activity reads must not overlap it.
+    void compute_next(const std::optional<ColorTarget>& color_target = std::nullopt)
+    {
+        TRACE_ZONE("WaveSim::compute_next");
         auto update_at = [&](const int i) {
             if (!m_buffed_fixed[i]) {
                 m_buffer_future[i] = future_at_idx(i);
@@ -82,21 +421,66 @@ public:
                 m_buffer_future[i] = m_buffer_present[i];
             }
         };
-#ifndef PLATFORM_WEB
-        m_thread_pool.detach_blocks<int>(0, c_size * c_size, [&](const int start, const int end) {
-            for (int i = start; i < end; ++i) {
-                update_at(i);
+
+        if (!m_probes.empty()) {
+            m_probe_blocks.assign(m_tile_activity.tiles_per_side(), m_probes.block_sums());
+        }
+
+        // Blocks are whole tile rows so every tile's activity is written by a single task
+        auto update_tile_rows = [&](const int start, const int end) {
+            TRACE_ZONE("wave tile rows block");
+            PERF_SCOPE(m_perf_counters);
+            std::vector<double> tile_change(m_tile_activity.tiles_per_side());
+            for (int tile_y = start; tile_y < end; ++tile_y) {
+                std::ranges::fill(tile_change, 0.0);
+                const int y_end = std::min((tile_y + 1) * TileActivity::sc_tile_size, c_size);
+                for (int y = tile_y * TileActivity::sc_tile_size; y < y_end; ++y) {
+                    for (int x = 0; x < c_size; ++x) {
+                        const int i = y * c_size + x;
+                        update_at(i);
+                        double& change = tile_change[x / TileActivity::sc_tile_size];
+                        change = std::max(change, std::abs(m_buffer_future[i] - m_buffer_present[i]));
+                    }
+                    if (color_target.has_value()) {
+                        color_target->colormap->map_row(
+                            m_buffer_future.data() + static_cast<size_t>(y) * c_size,
+                            color_target->pixels + static_cast<size_t>(y) * c_size,
+                            c_size,
+                            color_target->min,
+                            color_target->max,
+                            color_target->absolute);
+                    }
+                }
+                // probes read the tile row while it is still in cache, into sums of their own per tile row
+                if (!m_probes.empty()) {
+                    m_probes.sample_range(
+                        m_probe_blocks[tile_y],
+                        static_cast<size_t>(tile_y) * TileActivity::sc_tile_size * c_size,
+                        static_cast<size_t>(y_end) * c_size,
+                        [&](const size_t i) { return m_buffer_future[i]; });
+                }
+                for (int tile_x = 0; tile_x < m_tile_activity.tiles_per_side(); ++tile_x) {
+                    m_tile_activity.add_change(tile_y * m_tile_activity.tiles_per_side() + tile_x, tile_change[tile_x]);
+                }
             }
-        });
+        };
+#ifndef PLATFORM_WEB
+        m_thread_pool.detach_blocks<int>(0, m_tile_activity.tiles_per_side(), update_tile_rows);
         m_thread_pool.wait();
 #else
-        for (int i = 0; i < c_size * c_size; ++i) {
-            update_at(i);
-        }
+        update_tile_rows(0, m_tile_activity.tiles_per_side());
 #endif
+    }
 
+    // Second half of update(): makes the state computed by compute_next() the present one
+    void advance()
+    {
         std::swap(m_buffer_past, m_buffer_present);
         std::swap(m_buffer_present, m_buffer_future);
+        ++m_step;
+        if (!m_probes.empty()) {
+            m_probes.publish(m_probe_blocks);
+        }
     }
 
     [[nodiscard]] size_t pos_to_idx(const Vector2i pos) const
@@ -118,6 +502,12 @@ public:
 
     void clear()
     {
+        for (int i = 0; i < c_size * c_size; ++i) {
+            m_tile_activity.add_change(
+                m_tile_activity.tile_idx(idx_to_pos(i)),
+                std::max(std::abs(m_buffer_present[i]), std::abs(m_buffer_past[i])));
+        }
+        m_tile_activity.touch_all_fixed();
         m_buffer_past = std::vector(c_size * c_size, 0.0);
         m_buffer_present = std::vector(c_size * c_size, 0.0);
         m_buffer_future = std::vector(c_size * c_size, 0.0);
@@ -125,6 +515,134 @@ public:
     }
 
 private:
+    // Adds the largest change from before to after in each tile to the tile activity
+    void track_changes(const std::vector<double>& before, const std::vector<double>& after)
+    {
+        for (size_t tile = 0; tile < m_tile_activity.tile_count(); ++tile) {
+            const auto [x, y, width, height] = m_tile_activity.tile_rect(tile);
+            double change = 0.0;
+            for (int row = y; row < y + height; ++row) {
+                for (size_t i = pos_to_idx({ x, row }); i < pos_to_idx({ x + width, row }); ++i) {
+                    change = std::max(change, std::abs(after[i] - before[i]));
+                }
+            }
+            m_tile_activity.add_change(tile, change);
+        }
+    }
+
+    // Revisions of every tile when the full checkpoint that delta checkpoints refer to was saved or loaded
+    struct DeltaBase {
+        uint64_t token;
+        uint64_t step;
+        std::vector<uint64_t> revisions;
+        std::vector<uint64_t> fixed_revisions;
+        // 1 where past and present differed, so the past values change on the next step even if nothing else does
+        std::vector<uint8_t> unsettled;
+    };
+
+    // Unique across sims, so a token never names another sim's base
+    static uint64_t next_delta_base_token()
+    {
+        static std::atomic<uint64_t> next { 1 };
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // fixed holds the fixed mask as bytes and must outlive the writer
+    [[nodiscard]] CheckpointWriter full_checkpoint_writer(const std::vector<uint8_t>& fixed) const
+    {
+        CheckpointWriter writer(checkpoint_header(CheckpointKind::wave));
+        writer.add_section(m_buffer_past.data(), m_buffer_past.size() * sizeof(double), sizeof(double));
+        writer.add_section(m_buffer_present.data(), m_buffer_present.size() * sizeof(double), sizeof(double), 0);
+        writer.add_section(fixed.data(), fixed.size());
+        return writer;
+    }
+
+    bool load_full_checkpoint(const MappedCheckpoint& checkpoint)
+    {
+        if (const std::optional<Properties> props = checkpoint_properties(checkpoint.header());
+            checkpoint.header().kind != CheckpointKind::wave || !props.has_value() || !same_properties(*props)) {
+            return false;
+        }
+        const size_t cells = static_cast<size_t>(c_size) * c_size;
+        std::vector<double> past(cells);
+        std::vector<double> present(cells);
+        std::vector<uint8_t> fixed(cells);
+        if (!read_checkpoint_section(checkpoint, 0, past.data(), cells * sizeof(double), nullptr)
+            || !read_checkpoint_section(checkpoint, 1, present.data(), cells * sizeof(double), past.data())
+            || !read_checkpoint_section(checkpoint, 2, fixed.data(), cells, nullptr)) {
+            return false;
+        }
+        std::swap(m_buffer_past, past);
+        std::swap(m_buffer_present, present);
+        // past and present now hold the values from before
+        track_changes(past, m_buffer_past);
+        track_changes(present, m_buffer_present);
+        for (size_t i = 0; i < cells; ++i) {
+            if (m_buffed_fixed[i] != (fixed[i] != 0)) {
+                m_tile_activity.touch_fixed(m_tile_activity.tile_idx(idx_to_pos(i)));
+            }
+            m_buffed_fixed[i] = fixed[i] != 0;
+        }
+        m_step = checkpoint.header().step;
+        return true;
+    }
+
+    [[nodiscard]] CheckpointHeader checkpoint_header(const CheckpointKind kind) const
+    {
+        CheckpointHeader header {};
+        header.kind = kind;
+        header.value_bytes = sizeof(double);
+        header.size = c_size;
+        header.step = m_step;
+        header.parameters
+            = { c_wave_speed, c_grid_spacing, c_timestep, c_loss, c_damping_strength, c_damping_width, 0.0, 0.0 };
+        return header;
+    }
+
+    bool write_checkpoint(CheckpointWriter& writer, const std::string& path, const CheckpointCodec codec)
+    {
+#ifndef PLATFORM_WEB
+        if (codec == CheckpointCodec::lossless) {
+            return writer.write_lossless(path, m_thread_pool);
+        }
+#else
+        static_cast<void>(codec);
+#endif
+        return writer.write(path);
+    }
+
+    bool read_checkpoint_section(
+        const MappedCheckpoint& checkpoint, const size_t i, void* destination, const size_t bytes, const void* base)
+    {
+#ifndef PLATFORM_WEB
+        return checkpoint.read_section(i, destination, bytes, base, m_thread_pool);
+#else
+        static_cast<void>(base);
+        return checkpoint.read_section(i, destination, bytes);
+#endif
+    }
+
+    [[nodiscard]] static std::optional<Properties> checkpoint_properties(const CheckpointHeader& header)
+    {
+        if (header.kind != CheckpointKind::wave && header.kind != CheckpointKind::wave_delta) {
+            return std::nullopt;
+        }
+        return Properties { .size = header.size,
+                            .wave_speed = header.parameters[0],
+                            .grid_spacing = header.parameters[1],
+                            .timestep = header.parameters[2],
+                            .loss = header.parameters[3],
+                            .damping_strength = header.parameters[4],
+                            .damping_width = header.parameters[5] };
+    }
+
+    [[nodiscard]] bool same_properties(const Properties& props) const
+    {
+        return props.size == c_size && props.wave_speed == c_wave_speed && props.grid_spacing == c_grid_spacing
+            && props.timestep == c_timestep && props.loss == c_loss && props.damping_strength == c_damping_strength
+            && props.damping_width == c_damping_width;
+    }
+
     static Vector2i opposite_neighbor(const Vector2i n)
     {
         Vector2i opp { 0, 0 };
@@ -190,6 +708,13 @@ private:
     std::vector<double> m_buffer_present;
     std::vector<double> m_buffer_future;
     std::vector<bool> m_buffed_fixed;
+    TileActivity m_tile_activity;
+    ProbeSet m_probes;
+    // sums of the probes per tile row of the state compute_next() computed
+    std::vector<std::vector<double>> m_probe_blocks;
+    perf::CounterTotals m_perf_counters;
+    uint64_t m_step;
+    std::optional<DeltaBase> m_delta_base;
 #ifndef PLATFORM_WEB
     BS::thread_pool m_thread_pool;
 #endif
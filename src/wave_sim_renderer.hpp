@@ -1,11 +1,18 @@
 #pragma once
 
+#include <optional>
+#include <utility>
+#include <vector>
+
 #ifndef PLATFORM_WEB
 #include "BS_thread_pool.hpp"
 #endif
 #include "raylib-cpp.hpp"
 
+#include "colormap.hpp"
 #include "common.hpp"
+#include "tile_activity.hpp"
+#include "trace.hpp"
 #include "wave_sim.hpp"
 
 class WaveSimRenderer {
@@ -13,50 +20,153 @@ public:
     enum class Theme {
         grayscale,
         grayscale_abs,
+        diverging,
+        viridis_abs,
+    };
+
+    // How grid cells are reduced when the image is smaller than the grid
+    enum class Filter {
+        box,
+        max_abs,
     };
 
     explicit WaveSimRenderer(const int size)
         : c_size(size)
         , m_image(c_size, c_size, BLACK)
         , m_texture(m_image)
+        , m_wall_image(c_size, c_size, BLANK)
+        , m_wall_texture(m_wall_image)
+        , m_grayscale(Colormap::Preset::grayscale)
+        , m_diverging(Colormap::Preset::diverging)
+        , m_viridis(Colormap::Preset::viridis)
+        , m_filter(Filter::box)
+        , m_last_theme(Theme::grayscale)
+        , m_last_filter(Filter::box)
+        , m_last_view { 0, 0, 0, 0 }
+        , m_fused_pending(false)
+        , m_fused(false)
+    {
+    }
+
+    void set_filter(const Filter filter)
+    {
+        m_filter = filter;
+    }
+
+    // When the whole grid is shown at one pixel per cell, returns a target for WaveSim::update to colorize the new
+    // state into during its sweep. The next update() call then skips its own read pass over the field.
+    // Not usable when drawing overlaps compute_next(): the sweep would write the image draw() and upload() are reading,
+    // and the pixels of the next state would need a second image kept until the next frame and dropped whenever an
+    // edit, batched step or rewind changes the sim first. The desktop app overlaps instead, which hides most of the
+    // separate read pass behind the step; only the web build, which has no threads, fuses.
+    [[nodiscard]] std::optional<WaveSim::ColorTarget> fused_target(
+        const Theme theme, const int resolution, const Recti view)
+    {
+        if (view != Recti { 0, 0, c_size, c_size } || resolution < c_size || m_image.width != c_size
+            || m_image.height != c_size) {
+            return std::nullopt;
+        }
+        m_fused_pending = true;
+        const ColorSettings settings = color_settings(theme);
+        return WaveSim::ColorTarget { .colormap = settings.colormap,
+                                      .min = settings.min,
+                                      .max = settings.max,
+                                      .absolute = settings.absolute,
+                                      .pixels = static_cast<uint32_t*>(m_image.data) };
+    }
+
+    // Colorizes the cells in view into an image of up to resolution x resolution pixels, capped at one pixel per
+    // cell. The texture is reallocated whenever the image size changes.
+    // Walls are kept in a separate transparent layer drawn on top of the field. After the first frame only image
+    // tiles whose source cells changed since they were last drawn are recolorized and uploaded.
+    void update(const WaveSim& sim, const Theme theme, const int resolution, const Recti view)
     {
+        prepare(sim, theme, resolution, view);
+        draw(sim);
+        upload();
     }
 
-    void update(const WaveSim& sim, Theme theme)
+    // The three phases of update(), for callers that overlap drawing with WaveSim::compute_next().
+    // prepare() reads the sim's tile activity and (re)allocates textures so it must run on the main thread while the
+    // sim is idle. draw() only reads the present state and fixed cells. upload() must run on the main thread.
+    void prepare(const WaveSim& sim, const Theme theme, const int resolution, const Recti view)
     {
-        auto update_at = [&](const int i) {
-            const auto [x, y] = sim.idx_to_pos(i);
-            Color color;
-            if (sim.fixed_at_idx(i)) {
-                color = { 0, 0, 0, 255 };
+        TRACE_ZONE("WaveSimRenderer::prepare");
+        m_fused = std::exchange(m_fused_pending, false);
+        const int image_width = std::clamp(resolution, 1, view.width);
+        const int image_height = std::clamp(resolution, 1, view.height);
+        bool full_redraw = theme != m_last_theme || m_filter != m_last_filter || view != m_last_view;
+        if (image_width != m_image.width || image_height != m_image.height) {
+            m_image = raylib::Image(image_width, image_height, BLACK);
+            m_texture = raylib::Texture(m_image);
+            m_wall_image = raylib::Image(image_width, image_height, BLANK);
+            m_wall_texture = raylib::Texture(m_wall_image);
+            full_redraw = true;
+        }
+        const TileActivity& activity = sim.tile_activity();
+        if (m_tile_change.size() != activity.tile_count()) {
+            m_tile_change = std::vector(activity.tile_count(), 0.0);
+            m_tile_fixed_revision = std::vector<uint64_t>(activity.tile_count(), 0);
+            full_redraw = true;
+        }
+        m_last_theme = theme;
+        m_last_filter = m_filter;
+        m_last_view = view;
+
+        const ColorSettings settings = color_settings(theme);
+        // a change below half a color step since the last draw cannot move any pixel by more than one step
+        const double change_threshold = (settings.max - settings.min) / 255.0 / 2.0;
+        std::vector<char> field_dirty(activity.tile_count(), full_redraw);
+        std::vector<char> walls_dirty(activity.tile_count(), full_redraw);
+        for (size_t t = 0; t < activity.tile_count(); ++t) {
+            if (full_redraw || activity.change(t) - m_tile_change[t] > change_threshold) {
+                field_dirty[t] = true;
+                m_tile_change[t] = activity.change(t);
             }
-            else {
-                const double sim_value
-                    = theme == Theme::grayscale_abs ? std::abs(sim.value_at_idx(i)) : sim.value_at_idx(i);
-                color = { static_cast<unsigned char>(std::clamp((sim_value + 0.5) / (0.5 * 2), 0.0, 1.0) * 255),
-                          static_cast<unsigned char>(std::clamp((sim_value + 0.5) / (0.5 * 2), 0.0, 1.0) * 255),
-                          static_cast<unsigned char>(std::clamp((sim_value + 0.5) / (0.5 * 2), 0.0, 1.0) * 255),
-                          255 };
+            if (full_redraw || activity.fixed_revision(t) != m_tile_fixed_revision[t]) {
+                walls_dirty[t] = true;
+                m_tile_fixed_revision[t] = activity.fixed_revision(t);
             }
-            static_cast<unsigned char*>(m_image.data)[(y * m_image.width + x) * 4] = color.r;
-            static_cast<unsigned char*>(m_image.data)[(y * m_image.width + x) * 4 + 1] = color.g;
-            static_cast<unsigned char*>(m_image.data)[(y * m_image.width + x) * 4 + 2] = color.b;
-            static_cast<unsigned char*>(m_image.data)[(y * m_image.width + x) * 4 + 3] = color.a;
-        };
+        }
 
-#ifndef PLATFORM_WEB
-        m_thread_pool.detach_blocks<int>(0, c_size * c_size, [&](const int start, const int end) {
-            for (int i = start; i < end; ++i) {
-                update_at(i);
+        m_field_rects = dirty_image_tiles(activity, field_dirty, view);
+        m_wall_rects = dirty_image_tiles(activity, walls_dirty, view);
+    }
+
+    void draw(const WaveSim& sim)
+    {
+        TRACE_ZONE("WaveSimRenderer::draw");
+        const ColorSettings settings = color_settings(m_last_theme);
+        const Recti view = m_last_view;
+        auto draw_rects = [&](const int start, const int end) {
+            TRACE_ZONE("draw tiles block");
+            std::vector<double> reduced(m_image.width);
+            for (int r = start; r < end; ++r) {
+                if (r < static_cast<int>(m_field_rects.size())) {
+                    if (m_fused) {
+                        continue;
+                    }
+                    draw_field(sim, settings, view, m_field_rects[r], reduced);
+                }
+                else {
+                    draw_walls(sim, view, m_wall_rects[r - m_field_rects.size()]);
+                }
             }
-        });
+        };
+        const int rect_count = static_cast<int>(m_field_rects.size() + m_wall_rects.size());
+#ifndef PLATFORM_WEB
+        m_thread_pool.detach_blocks<int>(0, rect_count, draw_rects);
         m_thread_pool.wait();
 #else
-        for (int i = 0; i < c_size * c_size; ++i) {
-            update_at(i);
-        }
+        draw_rects(0, rect_count);
 #endif
-        m_texture.Update(m_image.GetData());
+    }
+
+    void upload()
+    {
+        TRACE_ZONE("WaveSimRenderer::upload");
+        upload(m_image, m_texture, m_field_rects);
+        upload(m_wall_image, m_wall_texture, m_wall_rects);
     }
 
     [[nodiscard]] const raylib::Texture& texture() const
@@ -64,11 +174,189 @@ public:
         return m_texture;
     }
 
+    // Transparent except for wall pixels; same size as texture()
+    [[nodiscard]] const raylib::Texture& wall_texture() const
+    {
+        return m_wall_texture;
+    }
+
 private:
+    static constexpr int sc_image_tile_size = 32;
+
+    struct ColorSettings {
+        const Colormap* colormap;
+        double min;
+        double max;
+        bool absolute;
+    };
+
+    [[nodiscard]] ColorSettings color_settings(const Theme theme) const
+    {
+        switch (theme) {
+        case Theme::grayscale:
+            return { &m_grayscale, -0.5, 0.5, false };
+        case Theme::grayscale_abs:
+            return { &m_grayscale, -0.5, 0.5, true };
+        case Theme::diverging:
+            return { &m_diverging, -0.5, 0.5, false };
+        case Theme::viridis_abs:
+            return { &m_viridis, 0.0, 0.5, true };
+        }
+        return { &m_grayscale, -0.5, 0.5, false };
+    }
+
+    // Cells [x0, x1) covered by image column x
+    [[nodiscard]] static std::pair<int, int> source_cells(const int x, const int image_width, const Recti view)
+    {
+        return { view.x + x * view.width / image_width, view.x + (x + 1) * view.width / image_width };
+    }
+
+    // Image tiles that read from at least one dirty sim tile
+    [[nodiscard]] std::vector<Recti> dirty_image_tiles(
+        const TileActivity& activity, const std::vector<char>& dirty, const Recti view) const
+    {
+        std::vector<Recti> rects;
+        const int image_width = m_image.width;
+        const int image_height = m_image.height;
+        for (int y = 0; y < image_height; y += sc_image_tile_size) {
+            const int height = std::min(sc_image_tile_size, image_height - y);
+            const int cell_y0 = view.y + y * view.height / image_height;
+            const int cell_y1 = view.y + (y + height) * view.height / image_height;
+            for (int x = 0; x < image_width; x += sc_image_tile_size) {
+                const int width = std::min(sc_image_tile_size, image_width - x);
+                const int cell_x0 = source_cells(x, image_width, view).first;
+                const int cell_x1 = source_cells(x + width - 1, image_width, view).second;
+                bool is_dirty = false;
+                for (int tile_y = cell_y0 / TileActivity::sc_tile_size;
+                     !is_dirty && tile_y <= (cell_y1 - 1) / TileActivity::sc_tile_size;
+                     ++tile_y) {
+                    for (int tile_x = cell_x0 / TileActivity::sc_tile_size;
+                         tile_x <= (cell_x1 - 1) / TileActivity::sc_tile_size;
+                         ++tile_x) {
+                        if (dirty[tile_y * activity.tiles_per_side() + tile_x]) {
+                            is_dirty = true;
+                            break;
+                        }
+                    }
+                }
+                if (is_dirty) {
+                    rects.push_back({ x, y, width, height });
+                }
+            }
+        }
+        return rects;
+    }
+
+    void draw_field(
+        const WaveSim& sim,
+        const ColorSettings& settings,
+        const Recti view,
+        const Recti rect,
+        std::vector<double>& reduced) const
+    {
+        const int image_width = m_image.width;
+        const int image_height = m_image.height;
+        for (int y = rect.y; y < rect.y + rect.height; ++y) {
+            uint32_t* pixels = static_cast<uint32_t*>(m_image.data) + static_cast<size_t>(y) * image_width + rect.x;
+            if (image_width == view.width && image_height == view.height) {
+                settings.colormap->map_row(
+                    sim.row_data(view.y + y) + view.x + rect.x,
+                    pixels,
+                    rect.width,
+                    settings.min,
+                    settings.max,
+                    settings.absolute);
+                continue;
+            }
+            // Each image pixel covers the block of cells [x0, x1) x [y0, y1)
+            const int y0 = view.y + y * view.height / image_height;
+            const int y1 = view.y + (y + 1) * view.height / image_height;
+            for (int x = 0; x < rect.width; ++x) {
+                const auto [x0, x1] = source_cells(rect.x + x, image_width, view);
+                double sum = 0.0;
+                double peak = 0.0;
+                for (int sim_y = y0; sim_y < y1; ++sim_y) {
+                    const double* row = sim.row_data(sim_y);
+                    for (int sim_x = x0; sim_x < x1; ++sim_x) {
+                        sum += row[sim_x];
+                        if (std::abs(row[sim_x]) > std::abs(peak)) {
+                            peak = row[sim_x];
+                        }
+                    }
+                }
+                reduced[x] = m_filter == Filter::box ? sum / ((x1 - x0) * (y1 - y0)) : peak;
+            }
+            settings.colormap->map_row(
+                reduced.data(), pixels, rect.width, settings.min, settings.max, settings.absolute);
+        }
+    }
+
+    // A pixel is a wall when most of the cells it covers are fixed
+    void draw_walls(const WaveSim& sim, const Recti view, const Recti rect) const
+    {
+        const int image_width = m_wall_image.width;
+        const int image_height = m_wall_image.height;
+        const uint32_t wall_color = pack_color(0, 0, 0);
+        for (int y = rect.y; y < rect.y + rect.height; ++y) {
+            uint32_t* pixels = static_cast<uint32_t*>(m_wall_image.data) + static_cast<size_t>(y) * image_width;
+            const int y0 = view.y + y * view.height / image_height;
+            const int y1 = view.y + (y + 1) * view.height / image_height;
+            for (int x = rect.x; x < rect.x + rect.width; ++x) {
+                const auto [x0, x1] = source_cells(x, image_width, view);
+                int fixed_count = 0;
+                for (int sim_y = y0; sim_y < y1; ++sim_y) {
+                    for (int sim_x = x0; sim_x < x1; ++sim_x) {
+                        fixed_count += sim.fixed_at_idx(sim.pos_to_idx({ sim_x, sim_y })) ? 1 : 0;
+                    }
+                }
+                pixels[x] = fixed_count * 2 > (x1 - x0) * (y1 - y0) ? wall_color : 0;
+            }
+        }
+    }
+
+    // Uploads only the given rectangles unless they cover most of the image, in which case one full upload is cheaper
+    void upload(const raylib::Image& image, raylib::Texture& texture, const std::vector<Recti>& rects)
+    {
+        const int image_tiles = ((image.width + sc_image_tile_size - 1) / sc_image_tile_size)
+            * ((image.height + sc_image_tile_size - 1) / sc_image_tile_size);
+        if (rects.size() * 2 > static_cast<size_t>(image_tiles)) {
+            texture.Update(image.data);
+            return;
+        }
+        for (const auto& [x, y, width, height] : rects) {
+            m_upload_scratch.resize(static_cast<size_t>(width) * height);
+            for (int row = 0; row < height; ++row) {
+                const uint32_t* src
+                    = static_cast<const uint32_t*>(image.data) + static_cast<size_t>(y + row) * image.width + x;
+                std::copy(src, src + width, m_upload_scratch.begin() + static_cast<ptrdiff_t>(row) * width);
+            }
+            texture.Update(
+                Rectangle {
+                    static_cast<float>(x), static_cast<float>(y), static_cast<float>(width), static_cast<float>(height) },
+                m_upload_scratch.data());
+        }
+    }
+
     const int c_size;
     raylib::Image m_image;
     raylib::Texture m_texture;
+    raylib::Image m_wall_image;
+    raylib::Texture m_wall_texture;
+    Colormap m_grayscale;
+    Colormap m_diverging;
+    Colormap m_viridis;
+    Filter m_filter;
+    Theme m_last_theme;
+    Filter m_last_filter;
+    Recti m_last_view;
+    bool m_fused_pending;
+    bool m_fused;
+    std::vector<Recti> m_field_rects;
+    std::vector<Recti> m_wall_rects;
+    std::vector<double> m_tile_change;
+    std::vector<uint64_t> m_tile_fixed_revision;
+    std::vector<uint32_t> m_upload_scratch;
 #ifndef PLATFORM_WEB
     BS::thread_pool m_thread_pool;
 #endif
-};
\ No newline at end of file
+};
@@ -0,0 +1,94 @@
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "checkpoint_chain.hpp"
+#include "test_common.hpp"
+#include "wave_sim.hpp"
+
+// What CheckpointChain writes to its index and which kind of checkpoint each save makes
+
+constexpr int sc_size = 48;
+
+static bool file_exists(const std::string& index_path, const std::string& file)
+{
+    return std::filesystem::exists(std::filesystem::path(index_path).parent_path() / file);
+}
+
+static void remove_chain(const std::string& index_path)
+{
+    const CheckpointChain chain(index_path, 2);
+    for (const CheckpointChain::Entry& entry : chain.entries()) {
+        std::filesystem::remove(std::filesystem::path(index_path).parent_path() / entry.file);
+    }
+    std::filesystem::remove(index_path);
+}
+
+int main()
+{
+    TestReport report;
+    const std::string index_path = temp_path("chain.index");
+    const std::string aside_path = temp_path("chain_aside.ckpt");
+    remove_chain(index_path);
+
+    for (const CheckpointCodec codec : { CheckpointCodec::raw, CheckpointCodec::lossless }) {
+        const std::string codec_name = codec == CheckpointCodec::raw ? "raw" : "lossless";
+        WaveSim sim({ .size = sc_size, .damping_width = 8 });
+        add_impulses(sim);
+        CheckpointChain chain(index_path, 2);
+        std::vector<bool> kinds;
+        std::string first_full;
+        bool saved = true;
+        for (int i = 0; i < 4; ++i) {
+            for (int step = 0; step < 10; ++step) {
+                sim.update();
+            }
+            if (i == 2) {
+                // a full checkpoint outside the chain must not move the base of its deltas
+                saved &= sim.save_checkpoint(aside_path, codec);
+            }
+            saved &= chain.save(sim, codec);
+            kinds.push_back(chain.entries().back().full);
+            if (i == 0) {
+                first_full = chain.entries().back().file;
+            }
+        }
+        std::filesystem::remove(aside_path);
+        report.expect(codec_name + ": a full checkpoint, two deltas, then a full one",
+                      saved && kinds == std::vector<bool> { true, false, false, true });
+        report.expect(codec_name + ": the new full checkpoint drops the previous chain",
+                      chain.entries().size() == 1 && !file_exists(index_path, first_full));
+
+        for (int step = 0; step < 10; ++step) {
+            sim.update();
+        }
+        chain.save(sim, codec);
+        WaveSim restored({ .size = sc_size, .damping_width = 8 });
+        CheckpointChain reopened(index_path, 2);
+        report.expect(codec_name + ": restore loads the last delta",
+                      !reopened.entries().back().full && reopened.restore(restored) && restored.step() == sim.step()
+                          && same_bits(wave_values(restored), wave_values(sim)));
+        report.expect(codec_name + ": a restored chain keeps saving deltas",
+                      reopened.save(restored, codec) && !reopened.entries().back().full);
+
+        WaveSim fresh({ .size = sc_size, .damping_width = 8 });
+        CheckpointChain fresh_chain(index_path, 2);
+        report.expect(codec_name + ": a sim the chain has not marked gets a full checkpoint",
+                      fresh_chain.save(fresh, codec) && fresh_chain.entries().back().full);
+        remove_chain(index_path);
+    }
+
+    {
+        std::ofstream(index_path) << "checkpoint-chain 1\n10 full a.full\n20 partial b.delta\n";
+        CheckpointChain chain(index_path, 2);
+        WaveSim sim({ .size = sc_size, .damping_width = 8 });
+        report.expect("damaged index reads as empty", chain.entries().empty() && !chain.restore(sim));
+        std::ofstream(index_path) << "checkpoint-chain 1\n10 full missing.full\n";
+        CheckpointChain missing(index_path, 2);
+        report.expect("index naming a missing file does not restore",
+                      missing.entries().size() == 1 && !missing.restore(sim) && sim.step() == 0);
+        std::filesystem::remove(index_path);
+    }
+    return report.exit_code();
+}
@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "frame_recorder.hpp"
+#include "test_common.hpp"
+#include "wave_sim.hpp"
+
+// Recordings read back through FrameReader, and the damaged files it must refuse
+
+constexpr int sc_size = 48;
+constexpr int sc_steps = 150;
+
+struct Recording {
+    // the sim's state after each step, from step 1
+    std::vector<std::vector<double>> states;
+    uint64_t dropped;
+};
+
+static Recording record(const std::string& path, const FrameRecorder::Properties& props)
+{
+    WaveSim sim({ .size = sc_size, .damping_width = 8 });
+    add_impulses(sim);
+    Recording recording { .states = {}, .dropped = 0 };
+    FrameRecorder recorder(path, props);
+    for (int i = 0; i < sc_steps; ++i) {
+        sim.update();
+        recording.states.push_back(wave_values(sim));
+        recorder.record(sim.step(), [&](double* values) { std::ranges::copy(recording.states.back(), values); });
+    }
+    recorder.finish();
+    recording.dropped = recorder.frames_dropped();
+    return recording;
+}
+
+// Whether every frame in path is the state at its step, within bound of it, as stored at the recording's precision.
+// Steps must rise, be multiples of interval and account for every due step but the dropped ones.
+static bool frames_match(
+    const std::string& path, const Recording& recording, const int interval, const double bound, const bool as_float)
+{
+    std::optional<FrameReader> reader = FrameReader::open(path);
+    if (!reader.has_value() || reader->frame_count() == 0
+        || reader->frame_count() + recording.dropped > recording.states.size() / interval) {
+        return false;
+    }
+    std::vector<double> values;
+    for (size_t frame = 0; frame < reader->frame_count(); ++frame) {
+        const uint64_t step = reader->step(frame).value_or(0);
+        if (step < 1 || step > recording.states.size() || step % interval != 0
+            || (frame > 0 && step <= reader->step(frame - 1)) || !reader->read(frame, values)) {
+            return false;
+        }
+        const std::vector<double>& state = recording.states[step - 1];
+        for (size_t i = 0; i < state.size(); ++i) {
+            const double expected = as_float ? static_cast<float>(state[i]) : state[i];
+            if (!(std::abs(values[i] - expected) <= bound)) {
+                return false;
+            }
+        }
+    }
+    return !reader->step(reader->frame_count()).has_value() && !reader->read(reader->frame_count(), values);
+}
+
+static std::vector<char> file_bytes(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+}
+
+static void write_bytes(const std::string& path, const std::vector<char>& bytes)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+int main()
+{
+    TestReport report;
+    const std::string path = temp_path("frames.rec");
+    using Backpressure = FrameRecorder::Backpressure;
+    // a single buffer makes the writer fall behind, so drop and decimate skip frames
+    for (const auto& [name, backpressure] : { std::pair { "drop", Backpressure::drop },
+                                              std::pair { "block", Backpressure::block },
+                                              std::pair { "decimate", Backpressure::decimate } }) {
+        const Recording recording = record(path,
+                                           { .size = sc_size,
+                                             .precision = FrameRecorder::Precision::float64,
+                                             .backpressure = backpressure,
+                                             .queue_frames = 1 });
+        // block keeps every frame
+        const std::optional<FrameReader> reader = FrameReader::open(path);
+        const bool kept = backpressure != Backpressure::block
+            || (reader.has_value() && reader->frame_count() == static_cast<size_t>(sc_steps));
+        report.expect(std::string("frames recorded (") + name + ")",
+                      kept && frames_match(path, recording, 1, 0.0, false));
+    }
+    {
+        const Recording recording = record(path,
+                                           { .size = sc_size,
+                                             .interval = 3,
+                                             .precision = FrameRecorder::Precision::float32,
+                                             .backpressure = Backpressure::block });
+        report.expect("float frames every third step",
+                      recording.dropped == 0 && frames_match(path, recording, 3, 0.0, true));
+    }
+    {
+        const Recording recording
+            = record(path, { .size = sc_size, .error_bound = 1.0e-4, .backpressure = Backpressure::block });
+        report.expect("compressed frames within their bound", frames_match(path, recording, 1, 1.0e-4, false));
+    }
+
+    const Recording recording = record(
+        path,
+        { .size = sc_size, .precision = FrameRecorder::Precision::float64, .backpressure = Backpressure::block });
+    const std::vector<char> intact = file_bytes(path);
+    const std::string damaged_path = temp_path("frames_damaged.rec");
+    const auto opens = [&](const std::vector<char>& bytes) {
+        write_bytes(damaged_path, bytes);
+        return FrameReader::open(damaged_path).has_value();
+    };
+    report.expect("intact recording opens", opens(intact));
+    {
+        std::vector<char> bytes = intact;
+        FrameFileFooter footer {};
+        std::memcpy(&footer, bytes.data() + bytes.size() - sizeof(footer), sizeof(footer));
+        ++footer.frame_count;
+        std::memcpy(bytes.data() + bytes.size() - sizeof(footer), &footer, sizeof(footer));
+        report.expect("frame count beyond the index rejected", !opens(bytes));
+    }
+    report.expect("recording without its footer rejected", !opens({ intact.begin(), intact.end() - 1 }));
+    report.expect("recording cut inside its header rejected",
+                  !opens({ intact.begin(), intact.begin() + sizeof(FrameFileHeader) - 1 }));
+    {
+        std::vector<char> bytes = intact;
+        FrameFileHeader header {};
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        header.value_bytes = 3;
+        std::memcpy(bytes.data(), &header, sizeof(header));
+        report.expect("unknown value size rejected", !opens(bytes));
+    }
+    {
+        // the first chunk claims more bytes than the file holds; only that frame fails
+        std::vector<char> bytes = intact;
+        FrameChunkHeader chunk {};
+        std::memcpy(&chunk, bytes.data() + sizeof(FrameFileHeader), sizeof(chunk));
+        chunk.bytes = std::numeric_limits<uint64_t>::max() - 8;
+        std::memcpy(bytes.data() + sizeof(FrameFileHeader), &chunk, sizeof(chunk));
+        write_bytes(damaged_path, bytes);
+        std::optional<FrameReader> reader = FrameReader::open(damaged_path);
+        std::vector<double> values;
+        report.expect("damaged chunk fails alone",
+                      reader.has_value() && !reader->read(0, values) && reader->read(1, values)
+                          && same_bits(values, recording.states[reader->step(1).value_or(1) - 1]));
+    }
+    std::filesystem::remove(damaged_path);
+    std::filesystem::remove(path);
+    report.expect("missing recording rejected", !FrameReader::open(path).has_value());
+    return report.exit_code();
+}
@@ -0,0 +1,562 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "checkpoint_chain.hpp"
+#include "colormap.hpp"
+#include "input_log.hpp"
+#include "keyframe_ring.hpp"
+#include "schrodinger_sim.hpp"
+#include "wave_sim.hpp"
+
+// Runs fixed scenes through the sims and compares the final state against golden snapshots made with the
+// reference kernels (WaveSim::update and the interleaved Euler SchrodingerSim). Every variant of a kernel is
+// checked against the same snapshot with its own tolerance. Codecs, recorders and file formats have their own tests
+// next to this one.
+//
+// usage: golden_test <golden dir> [--update]
+// --update rewrites the snapshots from the reference kernels; only do that for an intended change in results.
+
+// A value passes if it is within max_ulps of the golden value or within max_relative of the largest golden
+// magnitude. Thread count changes the order of normalize's sum and compilers may contract multiply-adds,
+// so even the reference kernels get a small relative tolerance.
+struct Tolerance {
+    uint64_t max_ulps;
+    double max_relative;
+};
+
+// Final state of a scene: components values per cell, row-major
+struct Snapshot {
+    int size;
+    int components;
+    std::vector<double> values;
+};
+
+struct Variant {
+    std::string name;
+    std::function<Snapshot()> run;
+    Tolerance tolerance;
+};
+
+struct Scene {
+    std::string name;
+    // the first variant is the reference the snapshot is made from
+    std::vector<Variant> variants;
+};
+
+// Snapshot files: "GOLD", uint32 size, uint32 components, then the doubles, all little-endian
+static constexpr char sc_magic[4] = { 'G', 'O', 'L', 'D' };
+
+static bool save_snapshot(const std::string& path, const Snapshot& snapshot)
+{
+    std::ofstream file(path, std::ios::binary);
+    const auto size = static_cast<uint32_t>(snapshot.size);
+    const auto components = static_cast<uint32_t>(snapshot.components);
+    file.write(sc_magic, sizeof(sc_magic));
+    file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    file.write(reinterpret_cast<const char*>(&components), sizeof(components));
+    file.write(
+        reinterpret_cast<const char*>(snapshot.values.data()),
+        static_cast<std::streamsize>(snapshot.values.size() * sizeof(double)));
+    return static_cast<bool>(file);
+}
+
+static bool load_snapshot(const std::string& path, Snapshot& snapshot)
+{
+    std::ifstream file(path, std::ios::binary);
+    char magic[sizeof(sc_magic)];
+    uint32_t size = 0;
+    uint32_t components = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&size), sizeof(size));
+    file.read(reinterpret_cast<char*>(&components), sizeof(components));
+    if (!file || std::memcmp(magic, sc_magic, sizeof(magic)) != 0) {
+        return false;
+    }
+    snapshot.size = static_cast<int>(size);
+    snapshot.components = static_cast<int>(components);
+    snapshot.values.resize(static_cast<size_t>(size) * size * components);
+    file.read(
+        reinterpret_cast<char*>(snapshot.values.data()),
+        static_cast<std::streamsize>(snapshot.values.size() * sizeof(double)));
+    return static_cast<bool>(file);
+}
+
+// Distance in representable doubles between a and b
+static uint64_t ulp_distance(const double a, const double b)
+{
+    // maps the sign-magnitude bit patterns onto a monotonic unsigned line
+    const auto ordered = [](const double value) {
+        const auto bits = std::bit_cast<uint64_t>(value);
+        return bits & (uint64_t { 1 } << 63) ? ~bits : bits | (uint64_t { 1 } << 63);
+    };
+    const uint64_t ordered_a = ordered(a);
+    const uint64_t ordered_b = ordered(b);
+    return ordered_a > ordered_b ? ordered_a - ordered_b : ordered_b - ordered_a;
+}
+
+static bool check(const std::string& name, const Snapshot& golden, const Snapshot& result, const Tolerance& tolerance)
+{
+    if (golden.size != result.size || golden.components != result.components) {
+        std::printf("FAIL %-40s shape %dx%dx%d, golden %dx%dx%d\n",
+                    name.c_str(),
+                    result.size,
+                    result.size,
+                    result.components,
+                    golden.size,
+                    golden.size,
+                    golden.components);
+        return false;
+    }
+    double max_abs = 0.0;
+    for (const double value : golden.values) {
+        max_abs = std::max(max_abs, std::abs(value));
+    }
+    uint64_t worst_ulps = 0;
+    double worst_relative = 0.0;
+    size_t failures = 0;
+    for (size_t i = 0; i < golden.values.size(); ++i) {
+        const uint64_t ulps = ulp_distance(golden.values[i], result.values[i]);
+        const double relative = std::abs(golden.values[i] - result.values[i]) / max_abs;
+        worst_ulps = std::max(worst_ulps, ulps);
+        // NaN compares false so it always fails
+        if (!(worst_relative >= relative)) {
+            worst_relative = relative;
+        }
+        if (ulps > tolerance.max_ulps && !(relative <= tolerance.max_relative)) {
+            ++failures;
+        }
+    }
+    std::printf("%s %-40s max %llu ulp, max relative %.3e\n",
+                failures == 0 ? "ok  " : "FAIL",
+                name.c_str(),
+                static_cast<unsigned long long>(worst_ulps),
+                worst_relative);
+    return failures == 0;
+}
+
+constexpr int sc_size = 48;
+
+// A checkpoint file in the temp directory, unique per variant
+static std::string checkpoint_path(const std::string& name)
+{
+    return (std::filesystem::temp_directory_path() / ("golden_test_" + name + ".ckpt")).string();
+}
+
+static Snapshot wave_snapshot(const WaveSim& sim)
+{
+    Snapshot snapshot { .size = sim.size(), .components = 1, .values = {} };
+    for (int y = 0; y < sim.size(); ++y) {
+        for (int x = 0; x < sim.size(); ++x) {
+            snapshot.values.push_back(sim.value_at({ x, y }));
+        }
+    }
+    return snapshot;
+}
+
+static Snapshot schrodinger_snapshot(const SchrodingerSim& sim)
+{
+    Snapshot snapshot { .size = sim.size(), .components = 2, .values = {} };
+    for (int i = 0; i < sim.size() * sim.size(); ++i) {
+        snapshot.values.push_back(sim.value_at_idx(i).real());
+        snapshot.values.push_back(sim.value_at_idx(i).imag());
+    }
+    return snapshot;
+}
+
+// The two impulses of the wave scenes as the wave app's edits
+static std::vector<InputEvent> wave_impulses()
+{
+    return { { .step = 0, .action = InputAction::add, .x = sc_size / 2, .y = sc_size / 4, .radius = 0, .amount = 10.0 },
+             { .step = 0,
+               .action = InputAction::add,
+               .x = sc_size / 2 + 3,
+               .y = sc_size / 4 + 1,
+               .radius = 0,
+               .amount = -4.0 } };
+}
+
+// A wall with two slits across the middle
+static void setup_walls(WaveSim& sim)
+{
+    for (int x = 0; x < sc_size; ++x) {
+        if (std::abs(x - sc_size / 2 + 6) > 2 && std::abs(x - sc_size / 2 - 6) > 2) {
+            sim.set_at({ x, sc_size / 2 }, 0.0);
+            sim.set_fixed_at({ x, sc_size / 2 }, true);
+        }
+    }
+}
+
+// Two impulses, optionally with the wall
+static void setup_wave(WaveSim& sim, const bool walls)
+{
+    for (const InputEvent& event : wave_impulses()) {
+        sim.set_at({ event.x, event.y }, event.amount);
+    }
+    if (walls) {
+        setup_walls(sim);
+    }
+}
+
+// Restarts must continue exactly where the run left off, so their result is compared bit for bit with an
+// uninterrupted run of the same build, which does not depend on the golden file's rounding. Any difference
+// poisons the snapshot with NaN.
+static Snapshot require_identical(Snapshot result, const Snapshot& uninterrupted)
+{
+    if (result.values.size() != uninterrupted.values.size()
+        || std::memcmp(result.values.data(), uninterrupted.values.data(), result.values.size() * sizeof(double)) != 0) {
+        std::printf("     differs from the uninterrupted run\n");
+        result.values.front() = std::numeric_limits<double>::quiet_NaN();
+    }
+    return result;
+}
+
+static Snapshot run_wave(const bool walls, const int steps)
+{
+    WaveSim sim({ .size = sc_size, .damping_width = 8 });
+    setup_wave(sim, walls);
+    for (int i = 0; i < steps; ++i) {
+        sim.update();
+    }
+    return wave_snapshot(sim);
+}
+
+// Runs past steps recording keyframes and steps back to steps through a window of window_budget bytes
+static Variant keyframe_rewind_variant(
+    const std::string& name, const bool walls, const uint64_t steps, const size_t window_budget)
+{
+    return { name,
+             [=] {
+                 WaveSim sim({ .size = sc_size, .damping_width = 8 });
+                 KeyframeRing keyframes(
+                     { .interval = 32, .memory_budget = size_t { 64 } << 20, .window_budget = window_budget });
+                 setup_wave(sim, walls);
+                 keyframes.mark_edit(sim.step());
+                 while (sim.step() < steps + 100) {
+                     sim.update();
+                     keyframes.record(sim);
+                 }
+                 while (sim.step() > steps && keyframes.step_backward(sim)) { }
+                 return wave_snapshot(sim);
+             },
+             { .max_ulps = 4, .max_relative = 1.0e-13 } };
+}
+
+static std::vector<Variant> wave_variants(const bool walls)
+{
+    constexpr int steps = 150;
+    constexpr Tolerance exact_order { .max_ulps = 4, .max_relative = 1.0e-13 };
+    return {
+        { "update (reference)", [=] { return run_wave(walls, steps); },
+          exact_order },
+        { "compute_next + advance",
+          [=] {
+              WaveSim sim({ .size = sc_size, .damping_width = 8 });
+              setup_wave(sim, walls);
+              for (int i = 0; i < steps; ++i) {
+                  sim.compute_next();
+                  sim.advance();
+              }
+              return wave_snapshot(sim);
+          },
+          exact_order },
+        { "fused colorize",
+          [=] {
+              WaveSim sim({ .size = sc_size, .damping_width = 8 });
+              setup_wave(sim, walls);
+              const Colormap colormap(Colormap::Preset::grayscale);
+              std::vector<uint32_t> pixels(static_cast<size_t>(sc_size) * sc_size);
+              const WaveSim::ColorTarget target {
+                  .colormap = &colormap, .min = -0.5, .max = 0.5, .absolute = false, .pixels = pixels.data()
+              };
+              for (int i = 0; i < steps; ++i) {
+                  sim.update(target);
+              }
+              return wave_snapshot(sim);
+          },
+          exact_order },
+        // the wall scene also covers the lossless codec and its delta of present against past
+        { walls ? "lossless checkpoint restart" : "checkpoint restart",
+          [=] {
+              const std::string path = checkpoint_path(walls ? "wave_slits" : "wave_impulse");
+              {
+                  WaveSim sim({ .size = sc_size, .damping_width = 8 });
+                  setup_wave(sim, walls);
+                  for (int i = 0; i < steps / 2; ++i) {
+                      sim.update();
+                  }
+                  sim.save_checkpoint(path, walls ? CheckpointCodec::lossless : CheckpointCodec::raw);
+              }
+              WaveSim sim(WaveSim::checkpoint_properties(path).value_or(WaveSim::Properties {}));
+              sim.load_checkpoint(path);
+              std::filesystem::remove(path);
+              while (sim.step() < steps) {
+                  sim.update();
+              }
+              return require_identical(wave_snapshot(sim), run_wave(walls, steps));
+          },
+          exact_order },
+        // the sim is damped, so stepping back recomputes from the keyframes, across several of them, through a
+        // window with room for every state and through one with room for a few
+        keyframe_rewind_variant("keyframe rewind", walls, steps, size_t { 64 } << 20),
+        keyframe_rewind_variant("keyframe rewind, small window", walls, steps, size_t { 256 } << 10),
+        { "keyframe ring seek",
+          [=] {
+              WaveSim sim({ .size = sc_size, .damping_width = 8 });
+              KeyframeRing keyframes({ .interval = 16, .memory_budget = size_t { 64 } << 20 });
+              setup_wave(sim, walls);
+              keyframes.record(sim);
+              while (sim.step() < steps + 40) {
+                  sim.update();
+                  keyframes.record(sim);
+              }
+              keyframes.seek(sim, steps);
+              return wave_snapshot(sim);
+          },
+          exact_order },
+        // the impulse starts in one tile, so early deltas leave tiles out, and a full checkpoint saved outside the
+        // chain between its saves must not move the base of its deltas. checkpoint_chain_test covers the index.
+        { walls ? "lossless delta chain restart" : "delta chain restart",
+          [=] {
+              const std::string index_path = checkpoint_path(walls ? "wave_slits_chain" : "wave_impulse_chain");
+              const CheckpointCodec codec = walls ? CheckpointCodec::lossless : CheckpointCodec::raw;
+              {
+                  WaveSim sim({ .size = sc_size, .damping_width = 8 });
+                  setup_wave(sim, walls);
+                  CheckpointChain chain(index_path, 2);
+                  for (int i = 0; i < steps / 2; ++i) {
+                      sim.update();
+                      if (i % 10 == 0) {
+                          chain.save(sim, codec);
+                      }
+                      if (i == 65) {
+                          sim.save_checkpoint(checkpoint_path(walls ? "wave_slits_aside" : "wave_impulse_aside"));
+                      }
+                  }
+              }
+              std::filesystem::remove(checkpoint_path(walls ? "wave_slits_aside" : "wave_impulse_aside"));
+              CheckpointChain chain(index_path, 2);
+              WaveSim sim(WaveSim::checkpoint_properties(index_path + "." + std::to_string(chain.entries().front().step)
+                                                         + ".full")
+                              .value_or(WaveSim::Properties {}));
+              chain.restore(sim);
+              for (const CheckpointChain::Entry& entry : chain.entries()) {
+                  std::filesystem::remove(std::filesystem::path(index_path).parent_path() / entry.file);
+              }
+              std::filesystem::remove(index_path);
+              while (sim.step() < steps) {
+                  sim.update();
+              }
+              return require_identical(wave_snapshot(sim), run_wave(walls, steps));
+          },
+          exact_order },
+        // the impulses are logged edits and the replay runs every step
+        { "input log replay",
+          [=] {
+              const std::string path = checkpoint_path(walls ? "wave_slits_inputs" : "wave_impulse_inputs");
+              {
+                  WaveSim sim({ .size = sc_size, .damping_width = 8 });
+                  if (walls) {
+                      setup_walls(sim);
+                  }
+                  sim.save_checkpoint(InputLog::checkpoint_path(path));
+                  InputLogWriter log(path, sim.step());
+                  for (const InputEvent& event : wave_impulses()) {
+                      apply_input(sim, event);
+                      log.write(event);
+                  }
+                  log.finish(steps);
+              }
+              WaveSim sim(
+                  WaveSim::checkpoint_properties(InputLog::checkpoint_path(path)).value_or(WaveSim::Properties {}));
+              sim.load_checkpoint(InputLog::checkpoint_path(path));
+              if (const std::optional<InputLog> log = InputLog::read(path); log.has_value()) {
+                  replay_inputs(sim, *log);
+              }
+              std::filesystem::remove(path);
+              std::filesystem::remove(InputLog::checkpoint_path(path));
+              return wave_snapshot(sim);
+          },
+          exact_order },
+    };
+}
+
+// The init_packet Gaussian of the Schrodinger app scaled to the grid, optionally with a wall across its path
+static void setup_schrodinger(SchrodingerSim& sim, const bool walls)
+{
+    constexpr auto i = std::complex(0.0, 1.0);
+    for (int j = 0; j < sc_size * sc_size; ++j) {
+        constexpr double sigma = sc_size / 16.0;
+        constexpr double mom_x = 2.0;
+        const auto [x, y] = sim.idx_to_pos(j);
+        const double x_term = std::exp(-std::pow(x - sc_size / 4.0, 2.0) / (2.0 * sigma * sigma));
+        const double y_term = std::exp(-std::pow(y - sc_size / 2.0, 2.0) / (2.0 * sigma * sigma));
+        sim.set_at({ x, y }, x_term * y_term * std::exp(i * mom_x * static_cast<double>(x)));
+    }
+    if (walls) {
+        for (int y = 0; y < sc_size; ++y) {
+            if (std::abs(y - sc_size / 2) > 3) {
+                sim.set_at({ sc_size / 2, y }, std::complex(0.0, 0.0));
+                sim.set_fixed_at({ sc_size / 2, y }, true);
+            }
+        }
+    }
+    sim.normalize();
+}
+
+static Variant schrodinger_variant(
+    const std::string& name,
+    const bool walls,
+    const SchrodingerSim::Integrator integrator,
+    const SchrodingerSim::Layout layout,
+    const Tolerance tolerance)
+{
+    return { name,
+             [=] {
+                 constexpr int steps = 100;
+                 SchrodingerSim sim({ .size = sc_size,
+                                      .grid_spacing = 1.0,
+                                      .timestep = 0.01,
+                                      .hbar = 1.0,
+                                      .mass = 1.0,
+                                      .integrator = integrator,
+                                      .layout = layout });
+                 setup_schrodinger(sim, walls);
+                 for (int i = 0; i < steps; ++i) {
+                     sim.update();
+                 }
+                 return schrodinger_snapshot(sim);
+             },
+             tolerance };
+}
+
+// Runs half the steps, saves a checkpoint and finishes in a new sim restored from it
+static Variant schrodinger_restart_variant(
+    const std::string& name,
+    const bool walls,
+    const SchrodingerSim::Integrator integrator,
+    const SchrodingerSim::Layout layout,
+    const CheckpointCodec codec,
+    const Tolerance tolerance)
+{
+    return { codec == CheckpointCodec::raw ? "checkpoint restart" : "lossless checkpoint restart",
+             [=] {
+                 constexpr uint64_t steps = 100;
+                 const std::string path = checkpoint_path(name);
+                 {
+                     SchrodingerSim sim({ .size = sc_size,
+                                          .grid_spacing = 1.0,
+                                          .timestep = 0.01,
+                                          .hbar = 1.0,
+                                          .mass = 1.0,
+                                          .integrator = integrator,
+                                          .layout = layout });
+                     setup_schrodinger(sim, walls);
+                     for (uint64_t i = 0; i < steps / 2; ++i) {
+                         sim.update();
+                     }
+                     sim.save_checkpoint(path, codec);
+                 }
+                 SchrodingerSim sim(
+                     SchrodingerSim::checkpoint_properties(path).value_or(SchrodingerSim::Properties {}));
+                 sim.load_checkpoint(path);
+                 std::filesystem::remove(path);
+                 while (sim.step() < steps) {
+                     sim.update();
+                 }
+                 SchrodingerSim uninterrupted({ .size = sc_size,
+                                                .grid_spacing = 1.0,
+                                                .timestep = 0.01,
+                                                .hbar = 1.0,
+                                                .mass = 1.0,
+                                                .integrator = integrator,
+                                                .layout = layout });
+                 setup_schrodinger(uninterrupted, walls);
+                 while (uninterrupted.step() < steps) {
+                     uninterrupted.update();
+                 }
+                 return require_identical(schrodinger_snapshot(sim), schrodinger_snapshot(uninterrupted));
+             },
+             tolerance };
+}
+
+static std::vector<Scene> scenes()
+{
+    using Integrator = SchrodingerSim::Integrator;
+    using Layout = SchrodingerSim::Layout;
+    constexpr Tolerance reduction_order { .max_ulps = 16, .max_relative = 1.0e-12 };
+    // the split layout expands the complex products into real arithmetic, which rounds differently
+    constexpr Tolerance expanded_arithmetic { .max_ulps = 64, .max_relative = 1.0e-10 };
+    std::vector<Scene> result;
+    result.push_back({ "wave_impulse", wave_variants(false) });
+    result.push_back({ "wave_slits", wave_variants(true) });
+    for (const bool walls : { false, true }) {
+        result.push_back(
+            { walls ? "schrodinger_euler_wall" : "schrodinger_euler_packet",
+              { schrodinger_variant("interleaved (reference)", walls, Integrator::euler, Layout::interleaved, reduction_order),
+                schrodinger_variant("split", walls, Integrator::euler, Layout::split, expanded_arithmetic),
+                schrodinger_restart_variant(
+                    walls ? "euler_wall" : "euler_packet",
+                    walls,
+                    Integrator::euler,
+                    Layout::interleaved,
+                    CheckpointCodec::raw,
+                    reduction_order) } });
+        result.push_back(
+            { walls ? "schrodinger_visscher_wall" : "schrodinger_visscher_packet",
+              { schrodinger_variant("visscher (reference)", walls, Integrator::visscher, Layout::split, reduction_order),
+                schrodinger_restart_variant(
+                    walls ? "visscher_wall" : "visscher_packet",
+                    walls,
+                    Integrator::visscher,
+                    Layout::split,
+                    CheckpointCodec::lossless,
+                    reduction_order) } });
+    }
+    return result;
+}
+
+int main(const int argc, char** argv)
+{
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <golden dir> [--update]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const std::string golden_dir = argv[1];
+    const bool update = argc > 2 && std::string(argv[2]) == "--update";
+
+    bool passed = true;
+    for (const Scene& scene : scenes()) {
+        const std::string path = golden_dir + "/" + scene.name + ".gold";
+        std::printf("%s\n", scene.name.c_str());
+        if (update) {
+            if (!save_snapshot(path, scene.variants.front().run())) {
+                std::printf("FAIL could not write %s\n", path.c_str());
+                passed = false;
+            }
+            continue;
+        }
+        Snapshot golden;
+        if (!load_snapshot(path, golden)) {
+            std::printf("FAIL could not read %s\n", path.c_str());
+            passed = false;
+            continue;
+        }
+        for (const Variant& variant : scene.variants) {
+            passed &= check(variant.name, golden, variant.run(), variant.tolerance);
+        }
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,113 @@
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "input_log.hpp"
+#include "test_common.hpp"
+#include "wave_sim.hpp"
+
+// Reading input logs back, whole, cut short and damaged, and replaying them
+
+constexpr int sc_size = 48;
+
+static std::vector<InputEvent> session()
+{
+    return {
+        { .step = 0, .action = InputAction::add, .x = sc_size / 2, .y = sc_size / 4, .radius = 0, .amount = 10.0 },
+        { .step = 12, .action = InputAction::paint_walls, .x = 10, .y = 30, .radius = 4, .amount = 0.0 },
+        { .step = 40, .action = InputAction::add, .x = 30, .y = 20, .radius = 0, .amount = -4.0 },
+        { .step = 55, .action = InputAction::erase_walls, .x = 11, .y = 31, .radius = 2, .amount = 0.0 },
+    };
+}
+
+static bool same_events(const std::vector<InputEvent>& a, const std::vector<InputEvent>& b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].step != b[i].step || a[i].action != b[i].action || a[i].x != b[i].x || a[i].y != b[i].y
+            || a[i].radius != b[i].radius || a[i].amount != b[i].amount) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    TestReport report;
+    const std::string path = temp_path("inputs.log");
+    constexpr uint64_t end_step = 80;
+
+    // the live run: edits applied as they happen, logged next to a checkpoint of the start
+    WaveSim live({ .size = sc_size, .damping_width = 8 });
+    for (int i = 0; i < 5; ++i) {
+        live.update();
+    }
+    live.save_checkpoint(InputLog::checkpoint_path(path));
+    {
+        const uint64_t start_step = live.step();
+        InputLogWriter writer(path, start_step);
+        for (InputEvent event : session()) {
+            event.step += start_step;
+            while (live.step() < event.step) {
+                live.update();
+            }
+            apply_input(live, event);
+            writer.write(event);
+        }
+        while (live.step() < end_step) {
+            live.update();
+        }
+        report.expect("writer finishes", writer.finish(live.step()) && writer.events_written() == session().size() + 1);
+    }
+
+    const std::optional<InputLog> log = InputLog::read(path);
+    report.expect("read returns every event and the end",
+                  log.has_value() && log->start_step == 5 && log->events.size() == session().size() + 1
+                      && log->events.back().action == InputAction::end && log->events.back().step == end_step);
+    {
+        WaveSim sim(WaveSim::checkpoint_properties(InputLog::checkpoint_path(path)).value_or(WaveSim::Properties {}));
+        const bool loaded = sim.load_checkpoint(InputLog::checkpoint_path(path));
+        report.expect("replay reproduces the live run bit for bit",
+                      loaded && log.has_value() && replay_inputs(sim, *log) && sim.step() == end_step
+                          && same_bits(wave_values(sim), wave_values(live)));
+        report.expect("replay needs the sim at the start step", log.has_value() && !replay_inputs(sim, *log));
+    }
+    {
+        WaveSim sim({ .size = sc_size, .damping_width = 8 });
+        InputLog shuffled { .start_step = 0, .events = session() };
+        std::swap(shuffled.events[1], shuffled.events[2]);
+        report.expect("replay rejects events out of order", !replay_inputs(sim, shuffled));
+    }
+
+    const auto full_bytes = std::filesystem::file_size(path);
+    const std::vector<InputEvent> logged = log.has_value() ? log->events : std::vector<InputEvent> {};
+    // cut inside the end event, as a crash while writing it would
+    std::filesystem::resize_file(path, full_bytes - sizeof(InputEvent) / 2);
+    const std::optional<InputLog> cut = InputLog::read(path);
+    report.expect("truncated log keeps its whole events",
+                  cut.has_value() && logged.size() > 1
+                      && same_events(cut->events, { logged.begin(), logged.end() - 1 }));
+    std::filesystem::resize_file(path, sizeof(InputLogHeader));
+    const std::optional<InputLog> empty = InputLog::read(path);
+    report.expect("log cut after its header has no events", empty.has_value() && empty->events.empty());
+    std::filesystem::resize_file(path, sizeof(InputLogHeader) - 1);
+    report.expect("log cut inside its header rejected", !InputLog::read(path).has_value());
+    {
+        InputLogHeader header { .magic = InputLogHeader::sc_magic,
+                                .version = InputLogHeader::sc_version + 1,
+                                .event_bytes = sizeof(InputEvent),
+                                .start_step = 0 };
+        std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(&header), sizeof(header));
+        report.expect("log of another version rejected", !InputLog::read(path).has_value());
+    }
+    std::filesystem::remove(path);
+    std::filesystem::remove(InputLog::checkpoint_path(path));
+    report.expect("missing log rejected", !InputLog::read(path).has_value());
+    return report.exit_code();
+}
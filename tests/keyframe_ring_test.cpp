@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "keyframe_ring.hpp"
+#include "test_common.hpp"
+#include "wave_sim.hpp"
+
+// Stepping back and seeking through a KeyframeRing against the states of the run it recorded
+
+constexpr int sc_size = 48;
+constexpr int sc_steps = 150;
+
+struct Run {
+    // the sim's state at each step, from step 0
+    std::vector<std::vector<double>> states;
+};
+
+// Updates sim for sc_steps recording keyframes into keyframes from step 0, and the states on the way
+static Run record(WaveSim& sim, KeyframeRing& keyframes)
+{
+    add_impulses(sim);
+    keyframes.mark_edit(sim.step());
+    keyframes.record(sim);
+    Run run { .states = { wave_values(sim) } };
+    for (int i = 0; i < sc_steps; ++i) {
+        sim.update();
+        keyframes.record(sim);
+        run.states.push_back(wave_values(sim));
+    }
+    return run;
+}
+
+// Steps sim back to step 0 and whether every state on the way is that of the run at its step, within tolerance of
+// the largest value of the run
+static bool retraces(WaveSim& sim, KeyframeRing& keyframes, const Run& run, const double tolerance)
+{
+    double max_abs = 0.0;
+    for (const std::vector<double>& state : run.states) {
+        for (const double value : state) {
+            max_abs = std::max(max_abs, std::abs(value));
+        }
+    }
+    while (sim.step() > 0) {
+        if (!keyframes.step_backward(sim)) {
+            return false;
+        }
+        const std::vector<double> values = wave_values(sim);
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (!(std::abs(values[i] - run.states[sim.step()][i]) <= tolerance * max_abs)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    TestReport report;
+    {
+        // undamped and loss-free, so stepping back runs the scheme backward instead of recomputing
+        WaveSim sim({ .size = sc_size, .loss = 1.0, .damping_strength = 0.0 });
+        KeyframeRing keyframes({ .interval = 32, .memory_budget = size_t { 64 } << 20 });
+        const Run run = record(sim, keyframes);
+        report.expect("reversible sim retraces the run up to rounding",
+                      sim.reversible() && retraces(sim, keyframes, run, 1.0e-12));
+    }
+    // the damped sim recomputes from keyframes, through a window with room for every state and one with room for a few
+    for (const size_t window_budget : { size_t { 64 } << 20, size_t { 256 } << 10 }) {
+        WaveSim sim({ .size = sc_size, .damping_width = 8 });
+        KeyframeRing keyframes(
+            { .interval = 32, .memory_budget = size_t { 64 } << 20, .window_budget = window_budget });
+        const std::string window = window_budget < (size_t { 1 } << 20) ? ", small window" : "";
+        const Run run = record(sim, keyframes);
+        report.expect("damped sim recomputes the run exactly" + window,
+                      !sim.reversible() && retraces(sim, keyframes, run, 0.0));
+        report.expect("no step before the first state" + window, !keyframes.step_backward(sim) && sim.step() == 0);
+    }
+    {
+        WaveSim sim({ .size = sc_size, .damping_width = 8 });
+        KeyframeRing keyframes({ .interval = 16, .memory_budget = size_t { 64 } << 20 });
+        const Run run = record(sim, keyframes);
+        bool ok = true;
+        for (const uint64_t step : { uint64_t { 100 }, uint64_t { 3 }, uint64_t { 64 }, uint64_t { 150 } }) {
+            ok &= keyframes.seek(sim, step) == std::optional(step) && same_bits(wave_values(sim), run.states[step]);
+        }
+        report.expect("seek lands on the recorded states", ok);
+    }
+    return report.exit_code();
+}
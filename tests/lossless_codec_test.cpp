@@ -0,0 +1,117 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "lossless_codec.hpp"
+#include "test_common.hpp"
+
+// Round trips of lossless::compress and the streams decompress() must reject
+
+static std::vector<double> smooth_field(const int size)
+{
+    std::vector<double> field;
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            field.push_back(std::sin(x * 0.1) * std::cos(y * 0.07) * std::exp(-(x + y) * 0.01));
+        }
+    }
+    return field;
+}
+
+static std::vector<uint8_t> compress(const std::vector<double>& values, const std::vector<double>* base)
+{
+    BS::thread_pool pool;
+    std::vector<uint8_t> compressed;
+    lossless::compress(values.data(),
+                       values.size() * sizeof(double),
+                       sizeof(double),
+                       base == nullptr ? nullptr : base->data(),
+                       compressed,
+                       pool);
+    return compressed;
+}
+
+// Whether stream decodes to exactly values
+static bool decodes_to(
+    const std::vector<uint8_t>& stream, const std::vector<double>& values, const std::vector<double>* base)
+{
+    BS::thread_pool pool;
+    const size_t bytes = values.size() * sizeof(double);
+    std::vector<double> decoded(values.size());
+    return lossless::decompress(
+               stream.data(), stream.size(), decoded.data(), bytes, base == nullptr ? nullptr : base->data(), pool)
+        && same_bits(decoded, values);
+}
+
+int main()
+{
+    TestReport report;
+    // large enough for several chunks
+    std::vector<double> field = smooth_field(400);
+    field[1] = std::numeric_limits<double>::quiet_NaN();
+    field[7] = std::numeric_limits<double>::infinity();
+    field[field.size() / 2] = -std::numeric_limits<double>::infinity();
+    field.back() = -std::numeric_limits<double>::denorm_min();
+    const std::vector<uint8_t> compressed = compress(field, nullptr);
+    report.expect("round trip with NaN and infinities is bit exact", decodes_to(compressed, field, nullptr));
+    report.expect("smooth field gets smaller", compressed.size() < field.size() * sizeof(double));
+
+    std::vector<double> next = field;
+    for (size_t i = 0; i < next.size(); i += 3) {
+        next[i] += 1.0e-3;
+    }
+    const std::vector<uint8_t> delta = compress(next, &field);
+    report.expect("round trip against a base", decodes_to(delta, next, &field));
+    report.expect("delta stream needs its base", !decodes_to(delta, next, nullptr));
+    report.expect("plain stream takes no base", !decodes_to(compressed, field, &next));
+
+    report.expect("empty array", decodes_to(compress({}, nullptr), {}, nullptr));
+    report.expect("single value", decodes_to(compress({ -2.5 }, nullptr), { -2.5 }, nullptr));
+    {
+        BS::thread_pool pool;
+        const std::vector<uint8_t> odd { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13 };
+        std::vector<uint8_t> stream;
+        lossless::compress(odd.data(), odd.size(), sizeof(double), nullptr, stream, pool);
+        std::vector<uint8_t> decoded(odd.size());
+        report.expect("bytes that are not whole elements",
+                      lossless::decompress(stream.data(), stream.size(), decoded.data(), odd.size(), nullptr, pool)
+                          && decoded == odd);
+    }
+
+    std::vector<uint8_t> wrapped = compressed;
+    const lossless::ChunkEntry entry { .bytes = std::numeric_limits<uint64_t>::max(), .stored = 0, .padding = 0 };
+    std::memcpy(wrapped.data() + sizeof(lossless::Header), &entry, sizeof(entry));
+    report.expect("chunk size that wraps its offset rejected", !decodes_to(wrapped, field, nullptr));
+    std::vector<uint8_t> bad_magic = compressed;
+    bad_magic[0] ^= 1;
+    report.expect("bad magic rejected", !decodes_to(bad_magic, field, nullptr));
+    {
+        BS::thread_pool pool;
+        std::vector<double> decoded(field.size() - 1);
+        report.expect("destination of another size rejected",
+                      !lossless::decompress(compressed.data(),
+                                            compressed.size(),
+                                            decoded.data(),
+                                            decoded.size() * sizeof(double),
+                                            nullptr,
+                                            pool));
+    }
+    bool truncations_rejected = true;
+    const std::vector<double> small = smooth_field(24);
+    const std::vector<uint8_t> small_stream = compress(small, nullptr);
+    for (size_t length = 0; length < small_stream.size(); ++length) {
+        truncations_rejected &= !decodes_to({ small_stream.begin(), small_stream.begin() + length }, small, nullptr);
+    }
+    report.expect("every truncation rejected", truncations_rejected);
+    bool corruptions_rejected = true;
+    for (size_t i = sizeof(lossless::Header) + sizeof(lossless::ChunkEntry); i < small_stream.size(); i += 7) {
+        std::vector<uint8_t> corrupted = small_stream;
+        corrupted[i] ^= 0x5a;
+        // a flipped literal can still decode, but must not decode to the original
+        corruptions_rejected &= !decodes_to(corrupted, small, nullptr);
+    }
+    report.expect("corrupted bytes never decode to the original", corruptions_rejected);
+    return report.exit_code();
+}
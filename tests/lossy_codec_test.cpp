@@ -0,0 +1,112 @@
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "lossy_codec.hpp"
+#include "test_common.hpp"
+
+// Error bounds of lossy::compress and the streams decompress() must reject
+
+static std::vector<uint8_t> compress(
+    const std::vector<double>& values, const int width, const int height, const int components, const double bound)
+{
+    BS::thread_pool pool;
+    std::vector<uint8_t> compressed;
+    lossy::compress(values.data(), width, height, components, bound, compressed, pool);
+    return compressed;
+}
+
+static bool decompress(const std::vector<uint8_t>& stream, std::vector<double>& values)
+{
+    BS::thread_pool pool;
+    return lossy::decompress(stream.data(), stream.size(), values, pool);
+}
+
+// Every finite value within bound of the original and every other one, or every value at a bound of zero, bit for bit
+static bool within_bound(const std::vector<double>& original, const std::vector<double>& decoded, const double bound)
+{
+    if (decoded.size() != original.size()) {
+        return false;
+    }
+    bool ok = true;
+    for (size_t i = 0; i < original.size(); ++i) {
+        ok &= std::isfinite(original[i]) && bound > 0.0
+            ? std::abs(decoded[i] - original[i]) <= bound
+            : std::bit_cast<uint64_t>(decoded[i]) == std::bit_cast<uint64_t>(original[i]);
+    }
+    return ok;
+}
+
+int main()
+{
+    TestReport report;
+    // more rows than a band, and a width that is not a multiple of anything
+    constexpr int width = 67;
+    constexpr int height = 75;
+    std::vector<double> field;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            field.push_back(std::sin(x * 0.2) * std::cos(y * 0.13));
+        }
+    }
+    field[1] = std::numeric_limits<double>::quiet_NaN();
+    field[width + 2] = std::numeric_limits<double>::infinity();
+    field[field.size() / 2] = -std::numeric_limits<double>::infinity();
+    field[field.size() / 2 + 1] = 1.0e300;
+    field.back() = -std::numeric_limits<double>::denorm_min();
+    for (const double bound : { 0.0, 1.0e-12, 1.0e-6, 1.0e-2 }) {
+        std::vector<double> decoded;
+        const bool ok = decompress(compress(field, width, height, 1, bound), decoded);
+        char name[64];
+        std::snprintf(name, sizeof(name), "NaN, infinities and outliers at bound %.0e", bound);
+        report.expect(name, ok && within_bound(field, decoded, bound));
+    }
+    {
+        // two components predicted separately, one smooth and one constant
+        std::vector<double> pairs;
+        for (const double value : field) {
+            pairs.push_back(value);
+            pairs.push_back(0.25);
+        }
+        std::vector<double> decoded;
+        const bool ok = decompress(compress(pairs, width, height, 2, 1.0e-4), decoded);
+        report.expect("two components", ok && within_bound(pairs, decoded, 1.0e-4));
+    }
+
+    for (const auto& [w, h] : { std::pair { 0, 0 }, std::pair { 0, 5 }, std::pair { 5, 0 }, std::pair { 1, 1 } }) {
+        const std::vector<double> values(static_cast<size_t>(w) * h, -3.5);
+        std::vector<double> decoded { 1.0 };
+        const bool ok = decompress(compress(values, w, h, 1, 1.0e-3), decoded);
+        char name[64];
+        std::snprintf(name, sizeof(name), "%dx%d field", w, h);
+        report.expect(name, ok && within_bound(values, decoded, 1.0e-3));
+    }
+
+    const std::vector<uint8_t> compressed = compress(field, width, height, 1, 1.0e-6);
+    std::vector<double> decoded;
+    std::vector<uint8_t> wrapped = compressed;
+    const uint64_t band_bytes = std::numeric_limits<uint64_t>::max();
+    std::memcpy(wrapped.data() + sizeof(lossy::Header), &band_bytes, sizeof(band_bytes));
+    report.expect("band size that wraps its offset rejected", !decompress(wrapped, decoded));
+    {
+        // one band of a single row, claiming far more values than the stream has bits
+        std::vector<uint8_t> oversized = compress({ 1.0, 2.0 }, 2, 1, 1, 1.0e-3);
+        lossy::Header header {};
+        std::memcpy(&header, oversized.data(), sizeof(header));
+        header.width = 1 << 30;
+        std::memcpy(oversized.data(), &header, sizeof(header));
+        report.expect("value count beyond the stream rejected before allocating", !decompress(oversized, decoded));
+    }
+    bool truncations_rejected = true;
+    const std::vector<double> corner(field.begin(), field.begin() + 8 * 9);
+    const std::vector<uint8_t> small = compress(corner, 8, 9, 1, 1.0e-6);
+    for (size_t length = 0; length < small.size(); ++length) {
+        truncations_rejected &= !decompress({ small.begin(), small.begin() + length }, decoded);
+    }
+    report.expect("every truncation rejected", truncations_rejected);
+    return report.exit_code();
+}
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "probe_recorder.hpp"
+#include "schrodinger_sim.hpp"
+#include "test_common.hpp"
+#include "wave_sim.hpp"
+
+// Probe series recorded through a file against sums over the field after every step
+
+constexpr int sc_size = 48;
+constexpr int sc_steps = 100;
+
+// A cell, a row, a column, an area across tile rows and an area clipped at the grid's corner
+static const std::vector<Recti> sc_probe_areas {
+    { sc_size / 2, sc_size / 4 + 5, 1, 1 },
+    { 0, sc_size / 3, sc_size, 1 },
+    { sc_size / 5, 0, 1, sc_size },
+    { 3, 20, 17, 30 },
+    { sc_size - 4, sc_size - 6, 10, 10 },
+};
+
+// Updates sim with probes recorded through a file and whether the series read back are the sums of value(sim, pos)
+// over the probe areas after every step
+template <typename Sim, typename CellValue>
+static bool probes_match(Sim& sim, const std::string& name, const CellValue& value)
+{
+    for (const Recti& area : sc_probe_areas) {
+        sim.add_probe(area);
+    }
+    const std::string path = temp_path(name + ".probes");
+    std::vector<std::vector<double>> expected(sc_probe_areas.size());
+    {
+        // chunks smaller than the run and a short queue, so record() waits for the writer
+        ProbeRecorder recorder(path, sim.probe_areas(), { .chunk_samples = 16, .queue_chunks = 2 });
+        for (int i = 0; i < sc_steps; ++i) {
+            sim.update();
+            recorder.record(sim.step(), sim.probe_values());
+            for (size_t probe = 0; probe < sim.probe_areas().size(); ++probe) {
+                const Recti& area = sim.probe_areas()[probe];
+                double sum = 0.0;
+                for (int y = area.y; y < area.y + area.height; ++y) {
+                    for (int x = area.x; x < area.x + area.width; ++x) {
+                        sum += value(sim, Vector2i { x, y });
+                    }
+                }
+                expected[probe].push_back(sum);
+            }
+        }
+        recorder.finish();
+    }
+    const std::optional<ProbeSeries> series = ProbeSeries::read(path);
+    std::filesystem::remove(path);
+    bool matches = series.has_value() && series->steps.size() == static_cast<size_t>(sc_steps)
+        && series->values.size() == expected.size();
+    for (size_t probe = 0; matches && probe < expected.size(); ++probe) {
+        for (size_t i = 0; i < expected[probe].size(); ++i) {
+            matches &= series->steps[i] == i + 1
+                && std::abs(series->values[probe][i] - expected[probe][i])
+                    <= 1.0e-12 * std::max(1.0, std::abs(expected[probe][i]));
+        }
+    }
+    return matches;
+}
+
+// A Gaussian packet moving right, optionally against a wall with a gap
+static void setup_packet(SchrodingerSim& sim, const bool walls)
+{
+    constexpr auto i = std::complex(0.0, 1.0);
+    constexpr double sigma = sc_size / 16.0;
+    for (int j = 0; j < sc_size * sc_size; ++j) {
+        const auto [x, y] = sim.idx_to_pos(j);
+        const double x_term = std::exp(-std::pow(x - sc_size / 4.0, 2.0) / (2.0 * sigma * sigma));
+        const double y_term = std::exp(-std::pow(y - sc_size / 2.0, 2.0) / (2.0 * sigma * sigma));
+        sim.set_at({ x, y }, x_term * y_term * std::exp(i * 2.0 * static_cast<double>(x)));
+    }
+    if (walls) {
+        for (int y = 0; y < sc_size; ++y) {
+            if (std::abs(y - sc_size / 2) > 3) {
+                sim.set_at({ sc_size / 2, y }, std::complex(0.0, 0.0));
+                sim.set_fixed_at({ sc_size / 2, y }, true);
+            }
+        }
+    }
+    sim.normalize();
+}
+
+int main()
+{
+    TestReport report;
+    const auto wave_value = [](const WaveSim& sim, const Vector2i pos) { return sim.value_at(pos); };
+    const auto density = [](const SchrodingerSim& sim, const Vector2i pos) { return std::norm(sim.value_at(pos)); };
+    for (const bool walls : { false, true }) {
+        const std::string scene = walls ? " with walls" : "";
+        WaveSim wave({ .size = sc_size, .damping_width = 8 });
+        add_impulses(wave);
+        if (walls) {
+            for (int x = 0; x < sc_size; x += 2) {
+                wave.set_fixed_at({ x, sc_size / 2 }, true);
+            }
+        }
+        report.expect("wave" + scene, probes_match(wave, "wave", wave_value));
+
+        using Integrator = SchrodingerSim::Integrator;
+        using Layout = SchrodingerSim::Layout;
+        for (const auto& [name, integrator, layout] :
+             { std::tuple { "euler interleaved", Integrator::euler, Layout::interleaved },
+               std::tuple { "euler split", Integrator::euler, Layout::split },
+               std::tuple { "visscher", Integrator::visscher, Layout::split } }) {
+            SchrodingerSim sim({ .size = sc_size,
+                                 .grid_spacing = 1.0,
+                                 .timestep = 0.01,
+                                 .hbar = 1.0,
+                                 .mass = 1.0,
+                                 .integrator = integrator,
+                                 .layout = layout });
+            setup_packet(sim, walls);
+            report.expect(name + scene, probes_match(sim, "schrodinger", density));
+        }
+    }
+    return report.exit_code();
+}
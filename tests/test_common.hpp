@@ -0,0 +1,64 @@
+#pragma once
+
+// Helpers shared by the per-module tests next to golden_test. Each test prints one line per case and exits with
+// failure if any case failed.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "common.hpp"
+#include "wave_sim.hpp"
+
+class TestReport {
+public:
+    // Prints name as passed or failed and returns ok
+    bool expect(const std::string& name, const bool ok)
+    {
+        std::printf("%s %s\n", ok ? "ok  " : "FAIL", name.c_str());
+        m_passed &= ok;
+        return ok;
+    }
+
+    [[nodiscard]] int exit_code() const
+    {
+        return m_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+private:
+    bool m_passed = true;
+};
+
+// A file in the temp directory, unique per test and case
+inline std::string temp_path(const std::string& name)
+{
+    return (std::filesystem::temp_directory_path() / ("sim_test_" + name)).string();
+}
+
+// Bit for bit, so NaN matches NaN
+inline bool same_bits(const std::vector<double>& a, const std::vector<double>& b)
+{
+    return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(double)) == 0);
+}
+
+// The field of sim, row-major
+inline std::vector<double> wave_values(const WaveSim& sim)
+{
+    std::vector<double> values;
+    for (int y = 0; y < sim.size(); ++y) {
+        for (int x = 0; x < sim.size(); ++x) {
+            values.push_back(sim.value_at({ x, y }));
+        }
+    }
+    return values;
+}
+
+// Two impulses off center in a damped sim, so early steps only touch a few tiles
+inline void add_impulses(WaveSim& sim)
+{
+    sim.set_at({ sim.size() / 2, sim.size() / 4 }, 10.0);
+    sim.set_at({ sim.size() / 2 + 3, sim.size() / 4 + 1 }, -4.0);
+}